@@ -1,12 +1,13 @@
 #version 330 core
 
 in vec2 texCoord;
+flat in float textureLayer;
 
-uniform sampler2D billboard_texture;
+uniform sampler2DArray billboard_textures;
 
 out vec4 fragColor;
 
 void main()
 {
-    fragColor = texture(billboard_texture, texCoord);
-}
\ No newline at end of file
+    fragColor = texture(billboard_textures, vec3(texCoord, textureLayer));
+}
@@ -3,7 +3,9 @@
 layout(location = 0) in vec3 inPosition;
 layout(location = 1) in vec2 inTexCoords;
 
-uniform mat4 model;
+// Per instance
+layout(location = 2) in vec4 inCenterScale; // xyz = world position, w = scale
+layout(location = 3) in float inTextureLayer;
 
 layout (std140) uniform ViewMatrices
 {
@@ -12,9 +14,17 @@ layout (std140) uniform ViewMatrices
 };
 
 out vec2 texCoord;
+flat out float textureLayer;
 
 void main()
 {
-    gl_Position = projection * view * model * vec4(inPosition, 1.0);
+    // Camera right and up are the first two rows of the view rotation
+    vec3 camera_right = vec3(view[0][0], view[1][0], view[2][0]);
+    vec3 camera_up = vec3(view[0][1], view[1][1], view[2][1]);
+
+    vec3 world_position = inCenterScale.xyz + (camera_right * inPosition.x + camera_up * inPosition.y) * inCenterScale.w;
+
+    gl_Position = projection * view * vec4(world_position, 1.0);
     texCoord = inTexCoords;
+    textureLayer = inTextureLayer;
 }
@@ -0,0 +1,25 @@
+#version 330 core
+
+in vec2 TexCoords;
+
+uniform sampler2D source_texture;
+uniform vec2 direction; // One tap step in uv, along x or y
+
+out vec4 FragColor;
+
+// 9-tap Gaussian with neighbouring taps merged into single bilinear fetches
+const float offsets[3] = float[](0.0, 1.3846153846, 3.2307692308);
+const float weights[3] = float[](0.2270270270, 0.3162162162, 0.0702702703);
+
+void main()
+{
+    vec4 color = texture(source_texture, TexCoords) * weights[0];
+
+    for (int i = 1; i < 3; i++)
+    {
+        color += texture(source_texture, TexCoords + direction * offsets[i]) * weights[i];
+        color += texture(source_texture, TexCoords - direction * offsets[i]) * weights[i];
+    }
+
+    FragColor = color;
+}
@@ -0,0 +1,36 @@
+// Fullscreen lighting pass of deferred shading. Compiled after lighting_common_fs.glsl
+// like mesh_fs.glsl, the surface comes from the G-buffer instead of the material.
+
+in vec2 TexCoords;
+
+uniform sampler2D gbuffer_albedo;
+uniform sampler2D gbuffer_normal_shininess;
+uniform sampler2D gbuffer_specular;
+uniform sampler2D gbuffer_depth;
+uniform mat4 inverse_view_projection;
+
+out vec4 FragColor;
+
+void main()
+{
+    float depth = texture(gbuffer_depth, TexCoords).r;
+
+    // Nothing was drawn here, keep the skybox or clear color
+    if (depth == 1.0) discard;
+
+    vec4 world_position = inverse_view_projection * vec4(vec3(TexCoords, depth) * 2.0 - 1.0, 1.0);
+    vec4 normal_shininess = texture(gbuffer_normal_shininess, TexCoords);
+
+    Surface surface;
+    surface.position = world_position.xyz / world_position.w;
+    surface.normal = normal_shininess.xyz;
+    surface.albedo = texture(gbuffer_albedo, TexCoords).rgb;
+    surface.specular = texture(gbuffer_specular, TexCoords).rgb;
+    surface.shininess = normal_shininess.w;
+
+    vec3 view_dir = normalize(view_coords.xyz - surface.position);
+    vec3 ambient = global_ambient_light.rgb * surface.albedo;
+    vec3 color_result = clustered_lights_color(surface, view_dir);
+
+    FragColor = vec4(color_result + ambient, 1.0);
+}
@@ -0,0 +1,22 @@
+#version 330 core
+
+in vec2 TexCoords;
+
+uniform sampler2D source_texture;
+uniform vec2 source_texel_size;
+
+out vec4 FragColor;
+
+void main()
+{
+    // Four bilinear taps between texels average a 4x4 footprint of the source,
+    // which keeps thin bright details from flickering as they move
+    vec2 offset = source_texel_size;
+
+    vec4 color = texture(source_texture, TexCoords + vec2(-offset.x, -offset.y));
+    color += texture(source_texture, TexCoords + vec2( offset.x, -offset.y));
+    color += texture(source_texture, TexCoords + vec2(-offset.x,  offset.y));
+    color += texture(source_texture, TexCoords + vec2( offset.x,  offset.y));
+
+    FragColor = color * 0.25;
+}
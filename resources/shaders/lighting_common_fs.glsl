@@ -0,0 +1,194 @@
+#version 330 core
+
+// Lighting shared by mesh_fs.glsl and deferred_lighting_fs.glsl, compiled ahead of
+// them (see compile_shader_with_include()). They only differ in where the surface comes from.
+
+// Member order follows PointlightStd140 and SpotlightStd140 in structs.h
+struct Pointlight {
+    vec3 position;
+    float range;
+    vec3 diffuse;
+    float specular;
+    float intensity;
+};
+
+struct Spotlight {
+    mat4 light_space_matrix;
+    vec4 shadow_rect; // xy = atlas uv offset, zw = uv scale, zero when unshadowed
+    vec3 position;
+    float range;
+    vec3 direction;
+    float cutoff;
+    vec3 diffuse;
+    float specular;
+    float outer_cutoff;
+};
+
+// Shaded surface, specular is zero when the surface has none
+struct Surface {
+    vec3 position;
+    vec3 normal;
+    vec3 albedo;
+    vec3 specular;
+    float shininess;
+};
+
+// Filled once per frame, only lights that are on are packed
+layout (std140) uniform Lights
+{
+    vec4 view_coords;
+    vec4 global_ambient_light;
+    ivec4 lights_count; // x = pointlights, y = spotlights
+    vec4 cluster_scale; // xy = clusters per pixel, z = depth slice scale, w = depth slice bias
+    Pointlight pointlights[128];
+    Spotlight spotlights[64];
+};
+
+layout (std140) uniform ViewMatrices
+{
+    mat4 projection;
+    mat4 view;
+};
+
+// Every spotlight shadow is a tile of this one depth texture
+uniform sampler2D shadow_atlas;
+
+// Light clusters, the grid must match LIGHT_CLUSTERS_* in constants.h.
+// cluster_grid holds the first index and pointlights | spotlights << 16 counts of each cluster.
+const int CLUSTERS_X = 16;
+const int CLUSTERS_Y = 9;
+const int CLUSTERS_Z = 24;
+uniform usamplerBuffer cluster_grid;
+uniform usamplerBuffer cluster_light_indices;
+
+float ShadowCalculation(vec4 fragPosLightSpace, vec3 frag_pos, vec3 frag_norm, vec3 light_pos, vec4 shadow_rect)
+{
+    // perform perspective divide
+    vec3 projCoords = fragPosLightSpace.xyz / fragPosLightSpace.w;
+
+    // transform to [0,1] range
+    projCoords = projCoords * 0.5 + 0.5;
+
+    if(projCoords.z > 1.0) return 0.0;
+
+    // outside of the light frustum, the neighbouring tiles belong to other lights
+    if (any(lessThan(projCoords.xy, vec2(0.0))) || any(greaterThan(projCoords.xy, vec2(1.0)))) return 0.0;
+
+    vec2 texelSize = 1.0 / textureSize(shadow_atlas, 0);
+    vec2 tile_min = shadow_rect.xy + texelSize * 0.5;
+    vec2 tile_max = shadow_rect.xy + shadow_rect.zw - texelSize * 0.5;
+    vec2 atlasCoords = shadow_rect.xy + projCoords.xy * shadow_rect.zw;
+
+    // get closest depth value from light's perspective (using [0,1] range fragPosLight as coords)
+    float closestDepth = texture(shadow_atlas, atlasCoords).r;
+
+    // get depth of current fragment from light's perspective
+    float currentDepth = projCoords.z;
+
+    vec3 light_dir = normalize(light_pos - frag_pos);
+    float fragment_dot = (1.0 - dot(frag_norm, light_dir));
+
+    if (currentDepth < closestDepth) return 0.0;
+
+    float shadow = 0;
+
+    for(int x = -1; x <= 1; ++x) {
+        for(int y = -1; y <= 1; ++y) {
+            vec2 sample_coords = clamp(atlasCoords + vec2(x, y) * texelSize, tile_min, tile_max);
+            float pcfDepth = texture(shadow_atlas, sample_coords).r;
+            shadow += currentDepth > pcfDepth ? 1.0 : 0.0;
+        }
+    }
+
+    shadow /= 9.0;
+    return shadow;
+}
+
+vec3 surface_specular(Surface surface, vec3 light_dir, vec3 view_dir, float light_specular, vec3 diffuse)
+{
+    if (all(equal(surface.specular, vec3(0.0)))) return vec3(0.0);
+
+    vec3 halfway_dir = normalize(light_dir + view_dir);
+    float spec = pow(max(dot(surface.normal, halfway_dir), 0.0), surface.shininess);
+    return light_specular * spec * surface.specular * diffuse;
+}
+
+vec3 point_lights_color(Pointlight light, Surface surface, vec3 view_dir)
+{
+    vec3 light_dir = normalize(light.position - surface.position);
+    float light_radius = light.range;
+
+    float distance = length(light.position - surface.position);
+    float attenuation = 1.0 / (1.0 + (distance / light_radius)); // * (distance / light_radius));
+
+    float diff = max(dot(surface.normal, light_dir), 0.0);
+    vec3 diffuse = light.diffuse * diff * surface.albedo;
+    vec3 specular = surface_specular(surface, light_dir, view_dir, light.specular, diffuse);
+
+    diffuse *= attenuation;
+    specular *= attenuation;
+
+    return vec3(diffuse + specular) * light.intensity;
+}
+
+vec3 spotlight_color(Spotlight light, Surface surface, vec3 view_dir)
+{
+    vec3 light_dir = normalize(light.position - surface.position);
+    float light_radius = light.range;
+    float distance = length(light.position - surface.position);
+    float attenuation = 1.0 / (1.0 + (distance / light_radius));
+
+    float theta = dot(light_dir, normalize(-light.direction));
+    float epsilon = light.cutoff - light.outer_cutoff;
+    float intensity = clamp((theta - light.outer_cutoff) / epsilon, 0.0, 1.0);
+
+    float diff = max(dot(surface.normal, light_dir), 0.0);
+    vec3 diffuse = light.diffuse * diff * surface.albedo;
+    vec3 specular = surface_specular(surface, light_dir, view_dir, light.specular, diffuse);
+
+    diffuse *= attenuation;
+    specular *= attenuation;
+
+    vec3 result = vec3(diffuse + specular) * intensity;
+
+    if (light.shadow_rect.z > 0.0)
+    {
+        vec4 fragPosLightSpace = light.light_space_matrix * vec4(surface.position, 1.0);
+        float shadow = ShadowCalculation(fragPosLightSpace, surface.position, surface.normal, light.position, light.shadow_rect);
+        result = result * (1.0 - shadow);
+    }
+
+    return result;
+}
+
+// Sum of the lights binned to the cluster of this fragment, ambient not included
+vec3 clustered_lights_color(Surface surface, vec3 view_dir)
+{
+    vec3 color_result = vec3(0);
+
+    float view_depth = -(view * vec4(surface.position, 1.0)).z;
+    ivec3 cluster = ivec3(
+        int(gl_FragCoord.x * cluster_scale.x),
+        int(gl_FragCoord.y * cluster_scale.y),
+        int(floor(log(view_depth) * cluster_scale.z - cluster_scale.w)));
+    cluster = clamp(cluster, ivec3(0), ivec3(CLUSTERS_X - 1, CLUSTERS_Y - 1, CLUSTERS_Z - 1));
+
+    uvec2 cluster_lights = texelFetch(cluster_grid, cluster.x + CLUSTERS_X * (cluster.y + CLUSTERS_Y * cluster.z)).xy;
+    int first_index = int(cluster_lights.x);
+    int pointlights_count = int(cluster_lights.y & 0xFFFFu);
+    int spotlights_count = int(cluster_lights.y >> 16);
+
+    for (int i = 0; i < pointlights_count; i++)
+    {
+        int light_index = int(texelFetch(cluster_light_indices, first_index + i).r);
+        color_result += point_lights_color(pointlights[light_index], surface, view_dir);
+    }
+
+    for (int i = 0; i < spotlights_count; i++)
+    {
+        int light_index = int(texelFetch(cluster_light_indices, first_index + pointlights_count + i).r);
+        color_result += spotlight_color(spotlights[light_index], surface, view_dir);
+    }
+
+    return color_result;
+}
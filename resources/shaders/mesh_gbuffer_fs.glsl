@@ -0,0 +1,37 @@
+#version 330 core
+
+// G-buffer pass of deferred shading, lit later by deferred_lighting_fs.glsl
+
+struct Material {
+    sampler2D color_texture;
+    sampler2D specular_texture;
+    float specular_mult;
+    float shininess;
+};
+
+in VS_OUT {
+    vec3 fragPos;
+    vec3 fragNormal;
+    vec2 TexCoord;
+} fs_in;
+
+uniform Material material;
+uniform bool use_specular_texture;
+
+layout (location = 0) out vec4 gAlbedo;
+layout (location = 1) out vec4 gNormalShininess;
+layout (location = 2) out vec4 gSpecular;
+
+void main()
+{
+    vec3 specular = vec3(0.0);
+
+    if (use_specular_texture)
+    {
+        specular = vec3(texture(material.specular_texture, fs_in.TexCoord)) * material.specular_mult;
+    }
+
+    gAlbedo = vec4(texture(material.color_texture, fs_in.TexCoord).rgb, 1.0);
+    gNormalShininess = vec4(normalize(fs_in.fragNormal), material.shininess);
+    gSpecular = vec4(specular, 1.0);
+}
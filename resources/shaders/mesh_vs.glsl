@@ -4,8 +4,10 @@ layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec2 aTexCoord;
 layout (location = 2) in vec3 aNormal;
 
-uniform mat4 model;
-uniform float uv_multiplier;
+// Per instance
+layout (location = 3) in mat4 aModel;
+layout (location = 7) in mat3 aNormalMatrix;
+layout (location = 10) in float aUvMultiplier;
 
 layout (std140) uniform ViewMatrices
 {
@@ -13,6 +15,9 @@ layout (std140) uniform ViewMatrices
     mat4 view;
 };
 
+// Depth pre-pass and lit pass share this shader, their depths must match for GL_EQUAL
+invariant gl_Position;
+
 out VS_OUT {
     vec3 fragPos;
     vec3 fragNormal;
@@ -21,16 +26,16 @@ out VS_OUT {
 
 void main()
 {
-    float scale_u = length(model[0].xyz); // Scale along the X-axis
-    float scale_v = length(model[2].xyz); // Scale along the Z-axis
+    float scale_u = length(aModel[0].xyz); // Scale along the X-axis
+    float scale_v = length(aModel[2].xyz); // Scale along the Z-axis
 
-	float used_uv_mult_u = scale_u / uv_multiplier;
-	float used_uv_mult_v = scale_v / uv_multiplier;
+	float used_uv_mult_u = scale_u / aUvMultiplier;
+	float used_uv_mult_v = scale_v / aUvMultiplier;
 
-	gl_Position = projection * view * model * vec4(aPos, 1.0);
+	gl_Position = projection * view * aModel * vec4(aPos, 1.0);
 	vs_out.TexCoord = vec2(aTexCoord.x * used_uv_mult_u, aTexCoord.y * used_uv_mult_v);
 
 	// Calculate the position and normal in world space
-    vs_out.fragPos = vec3(model * vec4(aPos, 1.0));
-    vs_out.fragNormal = mat3(transpose(inverse(model))) * aNormal;
+    vs_out.fragPos = vec3(aModel * vec4(aPos, 1.0));
+    vs_out.fragNormal = aNormalMatrix * aNormal;
 }
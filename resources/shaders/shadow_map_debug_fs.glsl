@@ -5,6 +5,7 @@ out vec4 FragColor;
 in vec2 TexCoords;
 
 uniform sampler2D depthMap;
+uniform vec4 tile_rect; // Light's tile in the shadow atlas, xy = uv offset, zw = uv scale
 uniform float near_plane;
 uniform float far_plane;
 
@@ -17,7 +18,7 @@ float LinearizeDepth(float depth)
 
 void main()
 {             
-    float depthValue = texture(depthMap, TexCoords).r;
+    float depthValue = texture(depthMap, tile_rect.xy + TexCoords * tile_rect.zw).r;
     FragColor = vec4(vec3(LinearizeDepth(depthValue) / far_plane), 1.0); // perspective
     // FragColor = vec4(vec3(depthValue), 1.0); // orthographic
 }
\ No newline at end of file
@@ -2,10 +2,27 @@
 
 layout (location = 0) in vec3 aPos;
 
+// Per instance
+layout (location = 3) in mat4 aModel;
+layout (location = 7) in mat3 aNormalMatrix;
+
 uniform mat4 lightSpaceMatrix;
-uniform mat4 model;
+uniform bool use_plane_bias;
+uniform vec3 light_position;
+uniform vec3 light_direction;
 
 void main()
 {
-    gl_Position = lightSpaceMatrix * model * vec4(aPos, 1.0);
+    vec3 local_pos = aPos;
+
+    // Push planes away from the light, more when the light faces them head on
+    if (use_plane_bias)
+    {
+        vec3 plane_normal = normalize(aNormalMatrix * vec3(0, 1.0, 0));
+        float shadow_bias = 0.025 + (0.05 * dot(light_direction, -plane_normal));
+        vec3 plane_view_dir = normalize(aModel[3].xyz - light_position);
+        local_pos += plane_view_dir * shadow_bias;
+    }
+
+    gl_Position = lightSpaceMatrix * aModel * vec4(local_pos, 1.0);
 }
\ No newline at end of file
@@ -1,13 +1,18 @@
 #version 330 core
 
 in vec2 texCoord;
+in vec4 textColor;
 
 out vec4 fragOutput;
 
+// Signed distance field, 0.5 is the glyph edge
 uniform sampler2D ourTexture;
-uniform vec3 textColor;
 
 void main()
 {
-    fragOutput = vec4(textColor.r, textColor.g, textColor.b, texture(ourTexture, texCoord).a);
+    float distance = texture(ourTexture, texCoord).r;
+    float edge_width = max(fwidth(distance) * 0.7, 0.001);
+    float coverage = smoothstep(0.5 - edge_width, 0.5 + edge_width, distance);
+    if (coverage <= 0.0) discard;
+    fragOutput = vec4(textColor.rgb, textColor.a * coverage);
 }
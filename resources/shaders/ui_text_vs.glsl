@@ -2,11 +2,14 @@
 
 layout(location = 0) in vec3 aPosition;
 layout(location = 1) in vec2 aTexCoord;
+layout(location = 2) in vec4 aColor;
 
 out vec2 texCoord;
+out vec4 textColor;
 
 void main()
 {
     gl_Position = vec4(aPosition, 1.0);
     texCoord = aTexCoord;
+    textColor = aColor;
 }
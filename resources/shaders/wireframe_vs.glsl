@@ -2,7 +2,8 @@
 
 layout (location = 0) in vec3 aPos;
 
-uniform mat4 model;
+// Per instance
+layout (location = 3) in mat4 aModel;
 
 layout (std140) uniform ViewMatrices
 {
@@ -12,5 +13,5 @@ layout (std140) uniform ViewMatrices
 
 void main()
 {
-	gl_Position = projection * view * model * vec4(aPos, 1.0);
+	gl_Position = projection * view * aModel * vec4(aPos, 1.0);
 }
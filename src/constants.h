@@ -4,6 +4,8 @@
 
 constexpr const char* MATERIALS_MANIFEST_PATH = "G:\\projects\\game\\Engine3D\\resources\\materials\\materials_manifest.txt";
 constexpr const char* MATERIALS_DIR_PATH = "G:\\projects\\game\\Engine3D\\resources\\materials\\";
+constexpr const char* PROFILER_TRACE_EXPORT_PATH = "G:\\projects\\game\\Engine3D\\debug\\trace.json";
+constexpr const char* PASS_TIMINGS_EXPORT_PATH = "G:\\projects\\game\\Engine3D\\debug\\pass_timings.csv";
 
 constexpr const s64 MATERIALS_MAX_COUNT = 64;
 constexpr const s64 MATERIALS_INDEXES_MAP_CAPACITY = MATERIALS_MAX_COUNT;
@@ -16,26 +18,115 @@ constexpr const char* spotlight_image_path = "G:\\projects\\game\\Engine3D\\reso
 constexpr const s64 SCENE_POINTLIGHTS_MAX_COUNT = 100;
 constexpr const s64 SCENE_SPOTLIGHTS_MAX_COUNT = 100;
 constexpr const s64 SCENE_TEXTURES_MAX_COUNT = 100;
-constexpr const s64 SCENE_PLANES_MAX_COUNT = 100;
-constexpr const s64 SCENE_MESHES_MAX_COUNT = 100;
+constexpr const s64 SCENE_PLANES_MAX_COUNT = 1000;
+constexpr const s64 SCENE_MESHES_MAX_COUNT = 10000;
 
 constexpr const s64 TEXTURE_SIZE_1K = 1024;
 
-constexpr const s64 MAX_LINES_BUFFERED = 200;
+constexpr const s64 SHADER_UNIFORMS_CAPACITY = 1024; // Power of two, kept at most half full
+constexpr const s64 SHADER_UNIFORM_BLOCKS_CAPACITY = 8;
+
+// Must match the array sizes of the Lights block in lighting_common_fs.glsl
+constexpr const s64 LIGHTS_UBO_POINTLIGHTS_MAX_COUNT = 128;
+constexpr const s64 LIGHTS_UBO_SPOTLIGHTS_MAX_COUNT = 64;
+
+// Light clusters, must match the grid constants in lighting_common_fs.glsl
+constexpr const s64 LIGHT_CLUSTERS_X = 16;
+constexpr const s64 LIGHT_CLUSTERS_Y = 9;
+constexpr const s64 LIGHT_CLUSTERS_Z = 24;
+constexpr const s64 LIGHT_CLUSTERS_COUNT = LIGHT_CLUSTERS_X * LIGHT_CLUSTERS_Y * LIGHT_CLUSTERS_Z;
+// Room for every packed light in every cluster, cutoff spheres of bright lights can cover the whole view
+constexpr const s64 LIGHT_CLUSTER_INDICES_MAX_COUNT = LIGHT_CLUSTERS_COUNT * (LIGHTS_UBO_POINTLIGHTS_MAX_COUNT + LIGHTS_UBO_SPOTLIGHTS_MAX_COUNT);
+
+// Lights are binned out to where they add less than half a step of the RGBA8 scene target
+constexpr const f32 LIGHT_CLUSTER_CUTOFF = 0.5f / 255.0f;
+
+constexpr const s64 PRIMITIVE_MESH_TYPES_COUNT = 2;
+constexpr const s64 PRIMITIVE_VERTEX_FLOATS = 8;
+
+constexpr const s64 MESH_INSTANCES_MAX_COUNT = SCENE_PLANES_MAX_COUNT + SCENE_MESHES_MAX_COUNT;
+constexpr const s64 MESH_BATCHES_MAX_COUNT = PRIMITIVE_MESH_TYPES_COUNT * 2 * SCENE_TEXTURES_MAX_COUNT;
+
+constexpr const s64 CULLING_BOUNDS_MAX_COUNT = MESH_INSTANCES_MAX_COUNT + SCENE_POINTLIGHTS_MAX_COUNT + SCENE_SPOTLIGHTS_MAX_COUNT;
+
+constexpr const s64 BILLBOARDS_MAX_COUNT = SCENE_POINTLIGHTS_MAX_COUNT + SCENE_SPOTLIGHTS_MAX_COUNT;
+
+constexpr const s64 RENDER_QUEUE_MAX_PACKETS = MESH_BATCHES_MAX_COUNT + SCENE_POINTLIGHTS_MAX_COUNT + SCENE_SPOTLIGHTS_MAX_COUNT;
+
+constexpr const s64 LINES_INITIAL_COUNT = 200;
 constexpr const s64 LINE_VERICIES = 12;
 
-constexpr const s64 MAX_UI_CHARS_BUFFERED = 500;
-constexpr const s64 UI_CHAR_VERTICIES = 30;
+constexpr const s64 UI_CHARS_INITIAL_COUNT = 500;
+constexpr const s64 UI_CHAR_VERTICIES = 6;
+
+constexpr const s64 TEXT_LAYOUT_CACHE_RUNS_COUNT = 512; // Power of two
+constexpr const s64 TEXT_LAYOUT_CACHE_VERTICES_COUNT = UI_CHARS_INITIAL_COUNT * UI_CHAR_VERTICIES * 8;
+
+constexpr const s64 STREAM_BUFFER_FRAMES = 3;
+constexpr const s64 STREAM_BUFFER_SEGMENT_SIZE = KILOBYTES(64);
 
 constexpr const s64 PROPERTIES_PANEL_WIDTH = 400;
 constexpr const s64 SIZEOF_VIEW_MATRICES = 2 * sizeof(glm::mat4);
+constexpr const s64 VIEW_MATRICES_UBO_BINDING = 0;
+constexpr const s64 LIGHTS_UBO_BINDING = 1;
 
 constexpr const s64 FILE_PATH_LEN = 256;
 constexpr const s64 FILENAME_LEN = FILE_PATH_LEN / 4;
 
-constexpr const u64 SHADOW_MAP_WIDTH = 1024;
-constexpr const u64 SHADOW_MAP_HEIGHT = 1024;
+constexpr const s64 POST_BLUR_LEVELS_COUNT = 5;
+
+constexpr const s64 RENDER_TARGET_MAX_COLORS = 3;
+constexpr const s64 RENDER_TARGET_POOL_MAX_COUNT = 32;
+constexpr const s64 RENDER_TARGET_IDLE_FRAMES = 60; // Free targets unused this long are deleted
+constexpr const f64 WINDOW_RESIZE_SETTLE_SECONDS = 0.15;
+
+constexpr const s64 FRAME_GRAPH_MAX_RESOURCES = 16;
+constexpr const s64 FRAME_GRAPH_MAX_PASSES = 16;
+constexpr const s64 FRAME_GRAPH_MAX_PASS_RESOURCES = 4;
+
+constexpr const s64 GPU_PROFILER_MAX_PASSES = 16;
+constexpr const s64 GPU_PROFILER_FRAMES = 4; // Query results are read this many frames later
+constexpr const s64 GPU_PROFILER_HISTORY_COUNT = 120; // Frames in the rolling average and max
+constexpr const s64 GPU_PROFILER_MAX_DEPTH = 4; // Zones open inside each other
+
+constexpr const s64 PROFILER_MAX_THREADS = 8;
+constexpr const s64 PROFILER_THREAD_EVENTS_COUNT = 16384; // Ring buffer size of each thread
+constexpr const s64 PROFILER_CAPTURE_FRAMES = 60;
+constexpr const s64 PROFILER_SPIKES_COUNT = 8; // Newest spike captures kept
+constexpr const s64 PROFILER_SPIKE_MAX_EVENTS = 256;
+constexpr const f32 PROFILER_SPIKE_BUDGET_MS = 33.3f;
+constexpr const f32 PROFILER_SPIKE_BUDGET_MIN_MS = 1.0f;
+
+constexpr const s64 GL_STATE_TEXTURE_UNITS = 16;
+constexpr const s64 GL_STATE_TEXTURE_TARGETS = 4; // 2D, 2D array, cube map, buffer
+constexpr const s64 GL_STATE_CAPABILITIES = 4; // Depth test, blend, cull face, scissor test
+constexpr const u32 GL_STATE_UNKNOWN = 0xFFFFFFFF;
+
+constexpr const s64 FRAME_TIMES_HISTORY_COUNT = 240;
+constexpr const s64 FRAME_TIMES_BUCKETS_COUNT = 1000;
+constexpr const f32 FRAME_TIMES_BUCKET_MS = 0.1f; // Percentile resolution, the last bucket holds everything slower
+
+// Spotlight shadows share one depth atlas, tiles are power of two multiples of a cell
+// The atlas doubles or halves between these to fit the tiles the lights want
+constexpr const s64 SHADOW_ATLAS_MIN_SIZE_PX = 1024;
+constexpr const s64 SHADOW_ATLAS_MAX_SIZE_PX = 4096;
+constexpr const s64 SHADOW_ATLAS_CELL_SIZE_PX = 256;
+constexpr const s64 SHADOW_ATLAS_CELLS_PER_ROW = SHADOW_ATLAS_MAX_SIZE_PX / SHADOW_ATLAS_CELL_SIZE_PX; // Row stride of the cells at any atlas size
+constexpr const s64 SHADOW_TILE_SIZE_LARGE_PX = 1024;
+constexpr const s64 SHADOW_TILE_SIZE_MEDIUM_PX = 512;
+constexpr const s64 SHADOW_TILE_SIZE_SMALL_PX = 256;
+constexpr const f32 SHADOW_TILE_SIZE_HYSTERESIS = 0.15f; // Coverage thresholds move this fraction away from the current size
 
 constexpr const f32 SHADOW_MAP_NEAR_PLANE = 0.25f;
 
-constexpr const float debug_font_vh = 1.0f;
\ No newline at end of file
+constexpr const float debug_font_vh = 1.0f;
+
+// Fonts are rendered once into a distance field atlas at this size and scaled when drawn
+constexpr const s64 FONT_SDF_REFERENCE_PX = 48;
+constexpr const s64 FONT_SDF_SPREAD_PX = 6;
+constexpr const s64 FONT_ATLAS_SIZE_PX = 1024;
+constexpr const s64 SKYLINE_MAX_NODES = 256;
+
+constexpr const s64 FONT_GLYPH_CACHE_MAX_COUNT = 1024;
+constexpr const s64 FONT_GLYPH_SLOTS_COUNT = FONT_GLYPH_CACHE_MAX_COUNT * 2; // Power of two
+constexpr const s64 FONT_GLYPH_FIELD_MAX_PX = FONT_SDF_REFERENCE_PX * 2 + FONT_SDF_SPREAD_PX * 2;
\ No newline at end of file
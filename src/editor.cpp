@@ -105,6 +105,12 @@ void delete_on_object_index(JArray* jarray_ptr, s64 jarray_index)
 
 void delete_selected_object()
 {
+	if (is_primitive(g_selected_object.type))
+	{
+		Mesh* mesh = (Mesh*)get_selected_object_ptr();
+		mark_shadows_dirty_in_bounds(get_mesh_world_bounds(mesh));
+	}
+
 	if (g_selected_object.type == ObjectType::Plane) delete_on_object_index(&g_scene.planes, g_selected_object.selection_index);
 	else if (g_selected_object.type == ObjectType::Cube) delete_on_object_index(&g_scene.meshes, g_selected_object.selection_index);
 	else if (g_selected_object.type == ObjectType::Pointlight) delete_on_object_index(&g_scene.pointlights, g_selected_object.selection_index);
@@ -129,6 +135,7 @@ s64 add_new_mesh(Mesh new_mesh)
 	}
 
 	ASSERT_TRUE(new_index != -1, "Add new mesh");
+	mark_shadows_dirty_in_bounds(get_mesh_world_bounds(&new_mesh));
 	return new_index;
 }
 
@@ -172,7 +179,8 @@ void duplicate_selected_object()
 	else if (g_selected_object.type == ObjectType::Spotlight)
 	{
 		Spotlight light_copy = *(Spotlight*)j_array_get(&g_scene.spotlights, g_selected_object.selection_index);
-		light_copy.shadow_map = init_spotlight_shadow_map();
+		light_copy.shadow_tile = {};
+		light_copy.shadow_dirty = true;
 		s64 index = add_new_spotlight(light_copy);
 		g_selected_object.type = ObjectType::Spotlight;
 		g_selected_object.selection_index = index;
@@ -586,10 +594,12 @@ void save_materials()
 
 void handle_tranformation_mode()
 {
+	PROFILE_ZONE("Transform mode");
 	glm::vec3 intersection_point;
 	g_transform_mode.transform_ray = get_camera_ray_from_scene_px(g_frame_data.mouse_x, g_frame_data.mouse_y);
 
 	Transforms* selected_t_ptr = get_selected_object_transforms();
+	Transforms prev_transforms = *selected_t_ptr;
 
 	bool intersection = calculate_plane_ray_intersection(
 		g_transform_mode.transform_plane_normal,
@@ -676,4 +686,16 @@ void handle_tranformation_mode()
 			}
 		}
 	}
+
+	if (transforms_equal(&prev_transforms, selected_t_ptr)) return;
+
+	if (is_primitive(g_selected_object.type))
+	{
+		mark_mesh_shadows_dirty((Mesh*)get_selected_object_ptr());
+	}
+	else if (g_selected_object.type == ObjectType::Spotlight)
+	{
+		Spotlight* spotlight = (Spotlight*)get_selected_object_ptr();
+		spotlight->shadow_dirty = true;
+	}
 }
\ No newline at end of file
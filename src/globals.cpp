@@ -23,6 +23,11 @@ MemoryBuffer g_ui_text_vertex_buffer = {};
 MemoryBuffer g_materials_memory = {};
 MemoryBuffer g_scene_planes_memory = {};
 MemoryBuffer g_scene_meshes_memory = {};
+MemoryBuffer g_mesh_instances_memory = {};
+MemoryBuffer g_render_queue_memory = {};
+MemoryBuffer g_billboards_memory = {};
+MemoryBuffer g_culling_memory = {};
+MemoryBuffer g_light_clusters_memory = {};
 MemoryBuffer g_scene_pointlights_memory = {};
 MemoryBuffer g_scene_spotlights_memory = {};
 MemoryBuffer g_texture_memory = {};
@@ -46,13 +51,27 @@ SimpleShader g_skybox_shader = {};
 SimpleShader g_shdow_map_debug_shader = {};
 SimpleShader g_shdow_map_shader = {};
 SimpleShader g_mesh_shader = {};
+SimpleShader g_mesh_gbuffer_shader = {};
+SimpleShader g_deferred_lighting_shader = {};
+SimpleShader g_downsample_shader = {};
+SimpleShader g_blur_shader = {};
+SimpleShader g_depth_prepass_shader = {};
 SimpleShader g_billboard_shader = {};
 SimpleShader g_ui_text_shader = {};
 SimpleShader g_line_shader = {};
 SimpleShader g_wireframe_shader = {};
 SimpleShader g_scene_framebuffer_shader = {};
 
-Framebuffer g_scene_framebuffer = {};
+RenderTargetPool g_render_target_pool = {};
+RenderTarget* g_scene_target = nullptr;
+RenderTarget* g_editor_target = nullptr;
+RenderTarget* g_gbuffer_target = nullptr;
+FrameGraph g_frame_graph = {};
+GpuProfiler g_gpu_profiler = {};
+Profiler g_profiler = {};
+FrameTimes g_frame_times = {};
+GlState g_gl_state = {};
+WindowResize g_pending_resize = {};
 
 UserSettings g_user_settings = {
 	.world_ambient = glm::vec3(0.075f),
@@ -60,11 +79,16 @@ UserSettings g_user_settings = {
 	.transform_clip = 0.25f,
 	.transform_rotation_clip = 15.0f,
 	.use_skybox = false,
+	.use_deferred_shading = false,
+	.use_depth_prepass = false,
 };
 
 s64 g_rects_buffered = 0;
-s64 g_lines_buffered = 0;
-s64 g_ui_chars_buffered = 0;
+TransientVertices g_line_vertices = {};
+TransientVertices g_ui_text_vertices = {};
+StreamBuffer g_stream_buffer = {};
+TextLayoutCache g_text_layout_cache = {};
+MemoryBuffer g_text_layout_cache_memory = {};
 
 FontData g_debug_font = {};
 
@@ -72,11 +96,20 @@ PostProcessingSettings g_pp_settings = {};
 
 unsigned int g_skybox_cubemap = 0;
 unsigned int g_view_proj_ubo = 0;
+unsigned int g_lights_ubo = 0;
+
+ShadowAtlas g_shadow_atlas = {};
+
+PrimitiveGeometry g_primitive_geometry = {};
+MeshInstances g_mesh_instances = {};
+ShadowCasters g_shadow_casters = {};
+BillboardBatch g_billboard_batch = {};
+RenderQueue g_scene_render_queue = {};
+SceneVisibility g_scene_visibility = {};
+LightClusters g_light_clusters = {};
+LightClusterBuffers g_light_cluster_buffers = {};
 
 bool g_use_linear_texture_filtering = false;
 bool g_generate_texture_mipmaps = false;
 bool g_load_texture_sRGB = false;
 
-Framebuffer editor_framebuffer = {};
-Texture pointlight_texture = {};
-Texture spotlight_texture = {};
@@ -6,8 +6,18 @@
 
 #include "j_array.h"
 #include "j_buffers.h"
+#include "j_culling.h"
+#include "j_frame_graph.h"
+#include "j_frame_times.h"
+#include "j_gl_state.h"
+#include "j_gpu_profiler.h"
+#include "j_light_clusters.h"
 #include "j_map.h"
+#include "j_profiler.h"
+#include "j_render_queue.h"
+#include "j_stream_buffer.h"
 #include "j_strings.h"
+#include "j_text_layout_cache.h"
 #include "structs.h"
 #include "types.h"
 
@@ -26,6 +36,11 @@ extern MemoryBuffer TEMP_MEMORY;
 extern MemoryBuffer g_materials_memory;
 extern MemoryBuffer g_scene_planes_memory;
 extern MemoryBuffer g_scene_meshes_memory;
+extern MemoryBuffer g_mesh_instances_memory;
+extern MemoryBuffer g_render_queue_memory;
+extern MemoryBuffer g_billboards_memory;
+extern MemoryBuffer g_culling_memory;
+extern MemoryBuffer g_light_clusters_memory;
 extern MemoryBuffer g_scene_pointlights_memory;
 extern MemoryBuffer g_scene_spotlights_memory;
 extern MemoryBuffer g_texture_memory;
@@ -54,19 +69,36 @@ extern SimpleShader g_skybox_shader;
 extern SimpleShader g_shdow_map_debug_shader;
 extern SimpleShader g_shdow_map_shader;
 extern SimpleShader g_mesh_shader;
+extern SimpleShader g_mesh_gbuffer_shader;
+extern SimpleShader g_deferred_lighting_shader;
+extern SimpleShader g_downsample_shader;
+extern SimpleShader g_blur_shader;
+extern SimpleShader g_depth_prepass_shader;
 extern SimpleShader g_billboard_shader;
 extern SimpleShader g_ui_text_shader;
 extern SimpleShader g_line_shader;
 extern SimpleShader g_wireframe_shader;
 extern SimpleShader g_scene_framebuffer_shader;
 
-extern Framebuffer g_scene_framebuffer;
+extern RenderTargetPool g_render_target_pool;
+extern RenderTarget* g_scene_target;
+extern RenderTarget* g_editor_target;
+extern RenderTarget* g_gbuffer_target;
+extern FrameGraph g_frame_graph;
+extern GpuProfiler g_gpu_profiler;
+extern Profiler g_profiler;
+extern FrameTimes g_frame_times;
+extern GlState g_gl_state;
+extern WindowResize g_pending_resize;
 
 extern UserSettings g_user_settings;
 
 extern s64 g_rects_buffered;
-extern s64 g_lines_buffered;
-extern s64 g_ui_chars_buffered;
+extern TransientVertices g_line_vertices;
+extern TransientVertices g_ui_text_vertices;
+extern StreamBuffer g_stream_buffer;
+extern TextLayoutCache g_text_layout_cache;
+extern MemoryBuffer g_text_layout_cache_memory;
 
 extern FontData g_debug_font;
 
@@ -74,11 +106,20 @@ extern PostProcessingSettings g_pp_settings;
 
 extern unsigned int g_skybox_cubemap;
 extern unsigned int g_view_proj_ubo;
+extern unsigned int g_lights_ubo;
+
+extern ShadowAtlas g_shadow_atlas;
+
+extern PrimitiveGeometry g_primitive_geometry;
+extern MeshInstances g_mesh_instances;
+extern ShadowCasters g_shadow_casters;
+extern BillboardBatch g_billboard_batch;
+extern RenderQueue g_scene_render_queue;
+extern SceneVisibility g_scene_visibility;
+extern LightClusters g_light_clusters;
+extern LightClusterBuffers g_light_cluster_buffers;
 
 extern bool g_use_linear_texture_filtering;
 extern bool g_generate_texture_mipmaps;
 extern bool g_load_texture_sRGB;
 
-extern Framebuffer editor_framebuffer;
-extern Texture pointlight_texture;
-extern Texture spotlight_texture;
@@ -0,0 +1,431 @@
+#include "j_culling.h"
+
+#include <bit>
+#include <cstdlib>
+#include <cstring>
+
+#define GLFW_INCLUDE_NONE
+#include <GLFW/glfw3.h>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define CULLING_USE_AVX
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define CULLING_USE_SSE
+#endif
+
+#include "j_assert.h"
+#include "globals.h"
+#include "utils.h"
+
+CullingBounds culling_bounds_init(MemoryBuffer* memory, s64 max_bounds)
+{
+	s64 array_size = sizeof(f32) * max_bounds;
+
+	CullingBounds bounds = {
+		.center_x = (f32*)memory_buffer_suballocate(memory, array_size).memory,
+		.center_y = (f32*)memory_buffer_suballocate(memory, array_size).memory,
+		.center_z = (f32*)memory_buffer_suballocate(memory, array_size).memory,
+		.extent_x = (f32*)memory_buffer_suballocate(memory, array_size).memory,
+		.extent_y = (f32*)memory_buffer_suballocate(memory, array_size).memory,
+		.extent_z = (f32*)memory_buffer_suballocate(memory, array_size).memory,
+		.count = 0,
+		.capacity = max_bounds,
+	};
+	return bounds;
+}
+
+SceneVisibility scene_visibility_init(MemoryBuffer* memory, s64 max_bounds)
+{
+	SceneVisibility visibility = {
+		.bounds = culling_bounds_init(memory, max_bounds),
+		.visible_indices = (s32*)memory_buffer_suballocate(memory, sizeof(s32) * max_bounds).memory,
+		.visible_count = 0,
+		.is_visible = (bool*)memory_buffer_suballocate(memory, sizeof(bool) * max_bounds).memory,
+	};
+	return visibility;
+}
+
+Frustum frustum_from_matrix(glm::mat4 view_projection)
+{
+	// Planes point inwards, extracted from the rows of the matrix
+	glm::mat4 m = glm::transpose(view_projection);
+	Frustum frustum = {};
+	frustum.planes[0] = m[3] + m[0]; // Left
+	frustum.planes[1] = m[3] - m[0]; // Right
+	frustum.planes[2] = m[3] + m[1]; // Bottom
+	frustum.planes[3] = m[3] - m[1]; // Top
+	frustum.planes[4] = m[3] + m[2]; // Near
+	frustum.planes[5] = m[3] - m[2]; // Far
+
+	for (int i = 0; i < 6; i++)
+	{
+		frustum.planes[i] /= glm::length(glm::vec3(frustum.planes[i]));
+	}
+
+	return frustum;
+}
+
+Aabb aabb_transform(Aabb local_bounds, glm::mat4 transform)
+{
+	glm::vec3 local_center = (local_bounds.min + local_bounds.max) * 0.5f;
+	glm::vec3 local_extent = (local_bounds.max - local_bounds.min) * 0.5f;
+
+	glm::mat3 abs_rotation_scale = glm::mat3(transform);
+
+	for (int i = 0; i < 3; i++)
+	{
+		abs_rotation_scale[i] = glm::abs(abs_rotation_scale[i]);
+	}
+
+	glm::vec3 center = glm::vec3(transform * glm::vec4(local_center, 1.0f));
+	glm::vec3 extent = abs_rotation_scale * local_extent;
+
+	Aabb result = {
+		.min = center - extent,
+		.max = center + extent,
+	};
+	return result;
+}
+
+Aabb get_mesh_world_bounds(Mesh* mesh)
+{
+	if (transforms_equal(&mesh->transforms, &mesh->bounds_transforms)) return mesh->bounds;
+
+	// Plane is anchored to its corner, cube is centered to origin
+	Aabb local_bounds = {};
+
+	if (mesh->mesh_type == MeshType::Plane)
+	{
+		local_bounds.min = glm::vec3(0.0f);
+		local_bounds.max = glm::vec3(1.0f, 0.0f, 1.0f);
+	}
+	else
+	{
+		local_bounds.min = glm::vec3(-0.5f);
+		local_bounds.max = glm::vec3(0.5f);
+	}
+
+	mesh->bounds = aabb_transform(local_bounds, get_model_matrix(mesh));
+	mesh->bounds_transforms = mesh->transforms;
+	return mesh->bounds;
+}
+
+void culling_bounds_add(CullingBounds* bounds, Aabb aabb)
+{
+	ASSERT_TRUE(bounds->count < bounds->capacity, "Culling bounds has space");
+
+	glm::vec3 center = (aabb.min + aabb.max) * 0.5f;
+	glm::vec3 extent = (aabb.max - aabb.min) * 0.5f;
+
+	s64 i = bounds->count++;
+	bounds->center_x[i] = center.x;
+	bounds->center_y[i] = center.y;
+	bounds->center_z[i] = center.z;
+	bounds->extent_x[i] = extent.x;
+	bounds->extent_y[i] = extent.y;
+	bounds->extent_z[i] = extent.z;
+}
+
+bool aabb_in_frustum(Aabb aabb, Frustum* frustum)
+{
+	glm::vec3 center = (aabb.min + aabb.max) * 0.5f;
+	glm::vec3 extent = (aabb.max - aabb.min) * 0.5f;
+
+	for (int p = 0; p < 6; p++)
+	{
+		glm::vec4 plane = frustum->planes[p];
+		f32 distance = glm::dot(glm::vec3(plane), center) + plane.w;
+		f32 radius = glm::dot(glm::abs(glm::vec3(plane)), extent);
+		if (distance + radius < 0.0f) return false;
+	}
+
+	return true;
+}
+
+s64 cull_bounds_frustum_scalar(CullingBounds* bounds, Frustum* frustum, s64 start_index, s32* visible_indices)
+{
+	s64 visible_count = 0;
+
+	for (s64 i = start_index; i < bounds->count; i++)
+	{
+		bool is_inside = true;
+
+		for (int p = 0; p < 6 && is_inside; p++)
+		{
+			glm::vec4 plane = frustum->planes[p];
+			f32 distance = plane.x * bounds->center_x[i] + plane.y * bounds->center_y[i] + plane.z * bounds->center_z[i] + plane.w;
+			f32 radius = glm::abs(plane.x) * bounds->extent_x[i] + glm::abs(plane.y) * bounds->extent_y[i] + glm::abs(plane.z) * bounds->extent_z[i];
+			is_inside = 0.0f <= distance + radius;
+		}
+
+		if (is_inside) visible_indices[visible_count++] = (s32)i;
+	}
+
+	return visible_count;
+}
+
+#if defined(CULLING_USE_AVX)
+
+constexpr const s64 CULLING_LANES = 8;
+
+s64 cull_bounds_frustum_simd(CullingBounds* bounds, Frustum* frustum, s64 batches_end, s32* visible_indices)
+{
+	__m256 plane_x[6], plane_y[6], plane_z[6], plane_w[6];
+	__m256 abs_x[6], abs_y[6], abs_z[6];
+
+	for (int p = 0; p < 6; p++)
+	{
+		glm::vec4 plane = frustum->planes[p];
+		plane_x[p] = _mm256_set1_ps(plane.x);
+		plane_y[p] = _mm256_set1_ps(plane.y);
+		plane_z[p] = _mm256_set1_ps(plane.z);
+		plane_w[p] = _mm256_set1_ps(plane.w);
+		abs_x[p] = _mm256_set1_ps(glm::abs(plane.x));
+		abs_y[p] = _mm256_set1_ps(glm::abs(plane.y));
+		abs_z[p] = _mm256_set1_ps(glm::abs(plane.z));
+	}
+
+	__m256 zero = _mm256_setzero_ps();
+	s64 visible_count = 0;
+
+	for (s64 i = 0; i < batches_end; i += CULLING_LANES)
+	{
+		__m256 cx = _mm256_loadu_ps(&bounds->center_x[i]);
+		__m256 cy = _mm256_loadu_ps(&bounds->center_y[i]);
+		__m256 cz = _mm256_loadu_ps(&bounds->center_z[i]);
+		__m256 ex = _mm256_loadu_ps(&bounds->extent_x[i]);
+		__m256 ey = _mm256_loadu_ps(&bounds->extent_y[i]);
+		__m256 ez = _mm256_loadu_ps(&bounds->extent_z[i]);
+		__m256 inside = _mm256_cmp_ps(zero, zero, _CMP_EQ_OQ);
+
+		for (int p = 0; p < 6; p++)
+		{
+			// Same addition order as the scalar kernel, so boxes touching a plane classify identically
+			__m256 distance = _mm256_add_ps(
+				_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(cx, plane_x[p]), _mm256_mul_ps(cy, plane_y[p])), _mm256_mul_ps(cz, plane_z[p])),
+				plane_w[p]);
+			__m256 radius = _mm256_add_ps(
+				_mm256_add_ps(_mm256_mul_ps(ex, abs_x[p]), _mm256_mul_ps(ey, abs_y[p])),
+				_mm256_mul_ps(ez, abs_z[p]));
+			inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_add_ps(distance, radius), zero, _CMP_GE_OQ));
+		}
+
+		u32 mask = (u32)_mm256_movemask_ps(inside);
+
+		while (mask != 0)
+		{
+			visible_indices[visible_count++] = (s32)(i + std::countr_zero(mask));
+			mask &= mask - 1;
+		}
+	}
+
+	return visible_count;
+}
+
+#elif defined(CULLING_USE_SSE)
+
+constexpr const s64 CULLING_LANES = 4;
+
+s64 cull_bounds_frustum_simd(CullingBounds* bounds, Frustum* frustum, s64 batches_end, s32* visible_indices)
+{
+	__m128 plane_x[6], plane_y[6], plane_z[6], plane_w[6];
+	__m128 abs_x[6], abs_y[6], abs_z[6];
+
+	for (int p = 0; p < 6; p++)
+	{
+		glm::vec4 plane = frustum->planes[p];
+		plane_x[p] = _mm_set1_ps(plane.x);
+		plane_y[p] = _mm_set1_ps(plane.y);
+		plane_z[p] = _mm_set1_ps(plane.z);
+		plane_w[p] = _mm_set1_ps(plane.w);
+		abs_x[p] = _mm_set1_ps(glm::abs(plane.x));
+		abs_y[p] = _mm_set1_ps(glm::abs(plane.y));
+		abs_z[p] = _mm_set1_ps(glm::abs(plane.z));
+	}
+
+	__m128 zero = _mm_setzero_ps();
+	s64 visible_count = 0;
+
+	for (s64 i = 0; i < batches_end; i += CULLING_LANES)
+	{
+		__m128 cx = _mm_loadu_ps(&bounds->center_x[i]);
+		__m128 cy = _mm_loadu_ps(&bounds->center_y[i]);
+		__m128 cz = _mm_loadu_ps(&bounds->center_z[i]);
+		__m128 ex = _mm_loadu_ps(&bounds->extent_x[i]);
+		__m128 ey = _mm_loadu_ps(&bounds->extent_y[i]);
+		__m128 ez = _mm_loadu_ps(&bounds->extent_z[i]);
+		__m128 inside = _mm_cmpeq_ps(zero, zero);
+
+		for (int p = 0; p < 6; p++)
+		{
+			// Same addition order as the scalar kernel, so boxes touching a plane classify identically
+			__m128 distance = _mm_add_ps(
+				_mm_add_ps(_mm_add_ps(_mm_mul_ps(cx, plane_x[p]), _mm_mul_ps(cy, plane_y[p])), _mm_mul_ps(cz, plane_z[p])),
+				plane_w[p]);
+			__m128 radius = _mm_add_ps(
+				_mm_add_ps(_mm_mul_ps(ex, abs_x[p]), _mm_mul_ps(ey, abs_y[p])),
+				_mm_mul_ps(ez, abs_z[p]));
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(distance, radius), zero));
+		}
+
+		u32 mask = (u32)_mm_movemask_ps(inside);
+
+		while (mask != 0)
+		{
+			visible_indices[visible_count++] = (s32)(i + std::countr_zero(mask));
+			mask &= mask - 1;
+		}
+	}
+
+	return visible_count;
+}
+
+#endif
+
+s64 cull_bounds_frustum(CullingBounds* bounds, Frustum* frustum, s32* visible_indices)
+{
+	s64 visible_count = 0;
+	s64 batches_end = 0;
+
+#if defined(CULLING_USE_AVX) || defined(CULLING_USE_SSE)
+	// Full batches go through the vector kernel, the tail through the scalar one
+	batches_end = bounds->count - bounds->count % CULLING_LANES;
+	visible_count = cull_bounds_frustum_simd(bounds, frustum, batches_end, visible_indices);
+#endif
+
+	visible_count += cull_bounds_frustum_scalar(bounds, frustum, batches_end, &visible_indices[visible_count]);
+	return visible_count;
+}
+
+void update_scene_visibility()
+{
+	PROFILE_ZONE("Scene visibility");
+	f64 start_time = glfwGetTime();
+
+	SceneVisibility* visibility = &g_scene_visibility;
+	CullingBounds* bounds = &visibility->bounds;
+	bounds->count = 0;
+
+	visibility->planes_offset = bounds->count;
+
+	for (int i = 0; i < g_scene.planes.items_count; i++)
+	{
+		Mesh* plane = (Mesh*)j_array_get(&g_scene.planes, i);
+		culling_bounds_add(bounds, get_mesh_world_bounds(plane));
+	}
+
+	visibility->meshes_offset = bounds->count;
+
+	for (int i = 0; i < g_scene.meshes.items_count; i++)
+	{
+		Mesh* mesh = (Mesh*)j_array_get(&g_scene.meshes, i);
+		culling_bounds_add(bounds, get_mesh_world_bounds(mesh));
+	}
+
+	// Lights are culled by their billboard, spotlights also by their direction line
+	glm::vec3 billboard_extent = glm::vec3(0.5f);
+	visibility->pointlights_offset = bounds->count;
+
+	for (int i = 0; i < g_scene.pointlights.items_count; i++)
+	{
+		Pointlight* light = (Pointlight*)j_array_get(&g_scene.pointlights, i);
+		glm::vec3 position = light->transforms.translation;
+		culling_bounds_add(bounds, { position - billboard_extent, position + billboard_extent });
+	}
+
+	visibility->spotlights_offset = bounds->count;
+
+	for (int i = 0; i < g_scene.spotlights.items_count; i++)
+	{
+		Spotlight* light = (Spotlight*)j_array_get(&g_scene.spotlights, i);
+		glm::vec3 position = light->transforms.translation;
+		glm::vec3 line_end = position + get_spotlight_dir(*light);
+		Aabb light_bounds = {
+			.min = glm::min(position - billboard_extent, line_end),
+			.max = glm::max(position + billboard_extent, line_end),
+		};
+		culling_bounds_add(bounds, light_bounds);
+	}
+
+	Frustum frustum = frustum_from_matrix(get_projection_matrix() * get_view_matrix());
+	visibility->visible_count = cull_bounds_frustum(bounds, &frustum, visibility->visible_indices);
+
+	memset(visibility->is_visible, 0, bounds->count * sizeof(bool));
+
+	for (s64 i = 0; i < visibility->visible_count; i++)
+	{
+		visibility->is_visible[visibility->visible_indices[i]] = true;
+	}
+
+	g_frame_data.objects_visible = visibility->visible_count;
+	g_frame_data.objects_culled = bounds->count - visibility->visible_count;
+	g_frame_data.culling_ms = (f32)((glfwGetTime() - start_time) * 1000.0);
+}
+
+s64 cull_spotlight_shadow_casters(Spotlight* spotlight, s32* caster_indices)
+{
+	// Planes and meshes are at the start of the scene bounds, built this frame by update_scene_visibility()
+	CullingBounds casters = g_scene_visibility.bounds;
+	casters.count = g_scene_visibility.pointlights_offset;
+
+	// Far plane of the light frustum is the range the shadow map covers
+	Frustum light_frustum = frustum_from_matrix(get_spotlight_light_space_matrix(*spotlight));
+	return cull_bounds_frustum(&casters, &light_frustum, caster_indices);
+}
+
+void run_culling_benchmark()
+{
+	constexpr const s64 bench_sizes[] = { 10000, 100000, 1000000 };
+	constexpr const s64 bench_iterations = 20;
+	constexpr const f32 bench_area = 1000.0f;
+
+	Frustum frustum = frustum_from_matrix(get_projection_matrix() * get_view_matrix());
+
+	for (s64 boxes_count : bench_sizes)
+	{
+		MemoryBuffer bench_memory = {};
+		s64 bench_memory_size = (6 * sizeof(f32) + 2 * sizeof(s32)) * boxes_count;
+		memory_buffer_mallocate(&bench_memory, bench_memory_size, const_cast<char*>("Culling benchmark"));
+
+		CullingBounds bounds = culling_bounds_init(&bench_memory, boxes_count);
+		s32* visible_indices = (s32*)memory_buffer_suballocate(&bench_memory, sizeof(s32) * boxes_count).memory;
+		s32* scalar_indices = (s32*)memory_buffer_suballocate(&bench_memory, sizeof(s32) * boxes_count).memory;
+
+		srand(1234);
+
+		for (s64 i = 0; i < boxes_count; i++)
+		{
+			glm::vec3 center = glm::vec3(rand(), rand(), rand()) / (f32)RAND_MAX * bench_area - bench_area * 0.5f;
+			glm::vec3 extent = glm::vec3(rand(), rand(), rand()) / (f32)RAND_MAX * 2.0f + 0.1f;
+			culling_bounds_add(&bounds, { center - extent, center + extent });
+		}
+
+		s64 visible_count = 0;
+		f64 start_time = glfwGetTime();
+
+		for (s64 i = 0; i < bench_iterations; i++)
+		{
+			visible_count = cull_bounds_frustum(&bounds, &frustum, visible_indices);
+		}
+
+		f64 kernel_ms = (glfwGetTime() - start_time) * 1000.0 / bench_iterations;
+
+		s64 scalar_visible_count = 0;
+		start_time = glfwGetTime();
+
+		for (s64 i = 0; i < bench_iterations; i++)
+		{
+			scalar_visible_count = cull_bounds_frustum_scalar(&bounds, &frustum, 0, scalar_indices);
+		}
+
+		f64 scalar_ms = (glfwGetTime() - start_time) * 1000.0 / bench_iterations;
+
+		printf("Culling %lld boxes: %.3f ms (scalar %.3f ms), %lld visible.\n", boxes_count, kernel_ms, scalar_ms, visible_count);
+		ASSERT_TRUE(visible_count == scalar_visible_count, "Culling kernel matches scalar reference");
+		ASSERT_TRUE(memcmp(visible_indices, scalar_indices, sizeof(s32) * visible_count) == 0, "Culling kernel visible indices match scalar reference");
+
+		memory_buffer_free(&bench_memory);
+	}
+}
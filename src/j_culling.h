@@ -0,0 +1,57 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include "types.h"
+#include "structs.h"
+#include "j_buffers.h"
+
+typedef struct Frustum {
+	glm::vec4 planes[6];
+} Frustum;
+
+// Structure of arrays so the kernels can load several boxes per instruction
+typedef struct CullingBounds {
+	f32* center_x;
+	f32* center_y;
+	f32* center_z;
+	f32* extent_x;
+	f32* extent_y;
+	f32* extent_z;
+	s64 count;
+	s64 capacity;
+} CullingBounds;
+
+// Scene objects share one bounds array: planes, meshes, pointlights, spotlights
+typedef struct SceneVisibility {
+	CullingBounds bounds;
+	s32* visible_indices;
+	s64 visible_count;
+	bool* is_visible;
+	s64 planes_offset;
+	s64 meshes_offset;
+	s64 pointlights_offset;
+	s64 spotlights_offset;
+} SceneVisibility;
+
+CullingBounds culling_bounds_init(MemoryBuffer* memory, s64 max_bounds);
+
+SceneVisibility scene_visibility_init(MemoryBuffer* memory, s64 max_bounds);
+
+Frustum frustum_from_matrix(glm::mat4 view_projection);
+
+Aabb aabb_transform(Aabb local_bounds, glm::mat4 transform);
+
+Aabb get_mesh_world_bounds(Mesh* mesh);
+
+bool aabb_in_frustum(Aabb aabb, Frustum* frustum);
+
+void culling_bounds_add(CullingBounds* bounds, Aabb aabb);
+
+s64 cull_bounds_frustum(CullingBounds* bounds, Frustum* frustum, s32* visible_indices);
+
+void update_scene_visibility();
+
+s64 cull_spotlight_shadow_casters(Spotlight* spotlight, s32* caster_indices);
+
+void run_culling_benchmark();
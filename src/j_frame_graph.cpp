@@ -0,0 +1,196 @@
+#include "j_frame_graph.h"
+
+#include <glad/glad.h>
+
+#include "j_assert.h"
+#include "j_render_targets.h"
+#include "globals.h"
+
+void frame_graph_reset(FrameGraph* graph)
+{
+	graph->resources_count = 0;
+	graph->passes_count = 0;
+	graph->culled_passes_count = 0;
+	graph->clears_count = 0;
+}
+
+s64 frame_graph_add_resource(FrameGraph* graph, const char* name, FrameGraphResourceType type)
+{
+	ASSERT_TRUE(graph->resources_count < FRAME_GRAPH_MAX_RESOURCES, "Frame graph resources not full");
+
+	s64 index = graph->resources_count++;
+	FrameGraphResource* resource = &graph->resources[index];
+	*resource = {};
+	resource->name = name;
+	resource->type = type;
+	resource->first_pass = -1;
+	resource->last_pass = -1;
+	return index;
+}
+
+s64 frame_graph_create_target(FrameGraph* graph, const char* name, RenderTargetDesc desc, RenderTarget** binding)
+{
+	s64 index = frame_graph_add_resource(graph, name, FrameGraphResourceType::Transient);
+	graph->resources[index].desc = desc;
+	graph->resources[index].binding = binding;
+	*binding = nullptr;
+	return index;
+}
+
+s64 frame_graph_import(FrameGraph* graph, const char* name, FrameGraphResourceType type)
+{
+	ASSERT_TRUE(type != FrameGraphResourceType::Transient, "Imported resource is not transient");
+	return frame_graph_add_resource(graph, name, type);
+}
+
+s64 frame_graph_add_pass(FrameGraph* graph, const char* name, FrameGraphExecute execute)
+{
+	ASSERT_TRUE(graph->passes_count < FRAME_GRAPH_MAX_PASSES, "Frame graph passes not full");
+
+	s64 index = graph->passes_count++;
+	FrameGraphPass* pass = &graph->passes[index];
+	*pass = {};
+	pass->name = name;
+	pass->execute = execute;
+	return index;
+}
+
+void frame_graph_read(FrameGraph* graph, s64 pass_index, s64 resource_index)
+{
+	FrameGraphPass* pass = &graph->passes[pass_index];
+	ASSERT_TRUE(pass->reads_count < FRAME_GRAPH_MAX_PASS_RESOURCES, "Frame graph pass reads not full");
+	pass->reads[pass->reads_count++] = resource_index;
+}
+
+// The first pass writing a resource clears it with its clear color, later writers draw on top
+void frame_graph_write(FrameGraph* graph, s64 pass_index, s64 resource_index, glm::vec4 clear_color)
+{
+	FrameGraphPass* pass = &graph->passes[pass_index];
+	ASSERT_TRUE(pass->writes_count < FRAME_GRAPH_MAX_PASS_RESOURCES, "Frame graph pass writes not full");
+	pass->writes[pass->writes_count++] = resource_index;
+	pass->clear_color = clear_color;
+
+	if (graph->resources[resource_index].type == FrameGraphResourceType::Backbuffer) pass->has_side_effects = true;
+}
+
+// Passes whose results outlive the frame, like cached shadow tiles, are never culled
+void frame_graph_set_side_effects(FrameGraph* graph, s64 pass_index)
+{
+	graph->passes[pass_index].has_side_effects = true;
+}
+
+void frame_graph_compile(FrameGraph* graph)
+{
+	// Walk backwards: a pass is kept if it has side effects or writes something a kept pass reads
+	for (s64 i = graph->passes_count - 1; 0 <= i; i--)
+	{
+		FrameGraphPass* pass = &graph->passes[i];
+		bool is_needed = pass->has_side_effects;
+
+		for (s64 w = 0; w < pass->writes_count && !is_needed; w++)
+		{
+			is_needed = graph->resources[pass->writes[w]].is_needed;
+		}
+
+		pass->is_culled = !is_needed;
+
+		if (pass->is_culled)
+		{
+			graph->culled_passes_count++;
+			continue;
+		}
+
+		for (s64 r = 0; r < pass->reads_count; r++)
+		{
+			graph->resources[pass->reads[r]].is_needed = true;
+		}
+	}
+
+	// Lifetimes span from the first to the last kept pass touching the resource
+	for (s64 i = 0; i < graph->passes_count; i++)
+	{
+		FrameGraphPass* pass = &graph->passes[i];
+		if (pass->is_culled) continue;
+
+		for (s64 r = 0; r < pass->reads_count + pass->writes_count; r++)
+		{
+			s64 resource_index = r < pass->reads_count ? pass->reads[r] : pass->writes[r - pass->reads_count];
+			FrameGraphResource* resource = &graph->resources[resource_index];
+
+			if (resource->first_pass < 0) resource->first_pass = i;
+			resource->last_pass = i;
+		}
+	}
+}
+
+void bind_pass_target(FrameGraph* graph, FrameGraphPass* pass, s64 pass_index)
+{
+	for (s64 w = 0; w < pass->writes_count; w++)
+	{
+		FrameGraphResource* resource = &graph->resources[pass->writes[w]];
+		if (resource->type == FrameGraphResourceType::External) continue;
+
+		GLbitfield clear_mask = GL_COLOR_BUFFER_BIT;
+
+		if (resource->type == FrameGraphResourceType::Transient)
+		{
+			RenderTarget* target = *resource->binding;
+			gl_bind_framebuffer(GL_FRAMEBUFFER, target->id);
+			gl_viewport(0, 0, target->desc.width_px, target->desc.height_px);
+			render_target_set_draw_buffers(target, render_target_colors_count(&resource->desc));
+			if (target->desc.depth_format != 0) clear_mask |= GL_DEPTH_BUFFER_BIT;
+		}
+		else
+		{
+			gl_bind_framebuffer(GL_FRAMEBUFFER, 0);
+			gl_viewport(0, 0, g_game_metrics.scene_width_px, g_game_metrics.scene_height_px);
+		}
+
+		if (resource->first_pass == pass_index)
+		{
+			gl_depth_mask(GL_TRUE);
+			glClearColor(pass->clear_color.r, pass->clear_color.g, pass->clear_color.b, pass->clear_color.a);
+			glClear(clear_mask);
+			graph->clears_count++;
+		}
+
+		// Only one target can be bound, further writes are done by the pass itself
+		return;
+	}
+}
+
+void frame_graph_execute(FrameGraph* graph, RenderTargetPool* pool)
+{
+	for (s64 i = 0; i < graph->passes_count; i++)
+	{
+		FrameGraphPass* pass = &graph->passes[i];
+		if (pass->is_culled) continue;
+
+		PROFILE_ZONE(pass->name);
+
+		for (s64 r = 0; r < graph->resources_count; r++)
+		{
+			FrameGraphResource* resource = &graph->resources[r];
+			if (resource->type != FrameGraphResourceType::Transient || resource->first_pass != i) continue;
+
+			*resource->binding = render_target_acquire_alias(pool, resource->desc);
+		}
+
+		gpu_profiler_begin_pass(&g_gpu_profiler, pass->name);
+		bind_pass_target(graph, pass, i);
+		pass->execute();
+		gpu_profiler_end_pass(&g_gpu_profiler);
+
+		// Released targets go back to the pool, so later transients of the same size and formats reuse their memory
+		for (s64 r = 0; r < graph->resources_count; r++)
+		{
+			FrameGraphResource* resource = &graph->resources[r];
+			if (resource->type != FrameGraphResourceType::Transient || resource->last_pass != i) continue;
+
+			render_target_release(pool, *resource->binding);
+			*resource->binding = nullptr;
+		}
+	}
+
+	gl_bind_framebuffer(GL_FRAMEBUFFER, 0);
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "types.h"
+#include "constants.h"
+#include "structs.h"
+
+typedef void (*FrameGraphExecute)();
+
+// Transients come from the render target pool between their first and last use,
+// the backbuffer and external resources (like the shadow atlas) live outside the graph
+typedef struct FrameGraphResource {
+	const char* name;
+	FrameGraphResourceType type;
+	RenderTargetDesc desc;
+	RenderTarget** binding; // Points to the acquired target while it is alive
+	s64 first_pass;
+	s64 last_pass;
+	bool is_needed;
+} FrameGraphResource;
+
+typedef struct FrameGraphPass {
+	const char* name;
+	FrameGraphExecute execute;
+	s64 reads[FRAME_GRAPH_MAX_PASS_RESOURCES];
+	s64 reads_count;
+	s64 writes[FRAME_GRAPH_MAX_PASS_RESOURCES];
+	s64 writes_count;
+	glm::vec4 clear_color;
+	bool has_side_effects;
+	bool is_culled;
+} FrameGraphPass;
+
+// Rebuilt every frame: passes are added in execution order, then compiled and executed
+typedef struct FrameGraph {
+	FrameGraphResource resources[FRAME_GRAPH_MAX_RESOURCES];
+	s64 resources_count;
+	FrameGraphPass passes[FRAME_GRAPH_MAX_PASSES];
+	s64 passes_count;
+	s64 culled_passes_count;
+	s64 clears_count;
+} FrameGraph;
+
+void frame_graph_reset(FrameGraph* graph);
+
+s64 frame_graph_create_target(FrameGraph* graph, const char* name, RenderTargetDesc desc, RenderTarget** binding);
+
+s64 frame_graph_import(FrameGraph* graph, const char* name, FrameGraphResourceType type);
+
+s64 frame_graph_add_pass(FrameGraph* graph, const char* name, FrameGraphExecute execute);
+
+void frame_graph_read(FrameGraph* graph, s64 pass_index, s64 resource_index);
+
+void frame_graph_write(FrameGraph* graph, s64 pass_index, s64 resource_index, glm::vec4 clear_color);
+
+void frame_graph_set_side_effects(FrameGraph* graph, s64 pass_index);
+
+void frame_graph_compile(FrameGraph* graph);
+
+void frame_graph_execute(FrameGraph* graph, RenderTargetPool* pool);
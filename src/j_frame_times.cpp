@@ -0,0 +1,58 @@
+#include "j_frame_times.h"
+
+s64 get_frame_time_bucket(f32 elapsed_ms)
+{
+	s64 bucket = (s64)(elapsed_ms / FRAME_TIMES_BUCKET_MS);
+	if (bucket < 0) return 0;
+	if (FRAME_TIMES_BUCKETS_COUNT <= bucket) return FRAME_TIMES_BUCKETS_COUNT - 1;
+	return bucket;
+}
+
+void frame_time_series_push(FrameTimeSeries* series, f32 elapsed_ms)
+{
+	if (series->samples_count == FRAME_TIMES_HISTORY_COUNT)
+	{
+		f32 oldest_ms = series->samples_ms[series->sample_index];
+		series->histogram[get_frame_time_bucket(oldest_ms)]--;
+	}
+	else series->samples_count++;
+
+	series->samples_ms[series->sample_index] = elapsed_ms;
+	series->sample_index = (series->sample_index + 1) % FRAME_TIMES_HISTORY_COUNT;
+	series->histogram[get_frame_time_bucket(elapsed_ms)]++;
+
+	series->max_ms = 0.0f;
+
+	for (s64 i = 0; i < series->samples_count; i++)
+	{
+		if (series->max_ms < series->samples_ms[i]) series->max_ms = series->samples_ms[i];
+	}
+
+	// Percentiles are the upper edge of the bucket they fall in, never above the real max
+	s64 p50_rank = (series->samples_count * 50 + 99) / 100;
+	s64 p95_rank = (series->samples_count * 95 + 99) / 100;
+	s64 p99_rank = (series->samples_count * 99 + 99) / 100;
+	s64 seen_count = 0;
+	series->p50_ms = 0.0f;
+	series->p95_ms = 0.0f;
+	series->p99_ms = 0.0f;
+
+	for (s64 i = 0; i < FRAME_TIMES_BUCKETS_COUNT && seen_count < p99_rank; i++)
+	{
+		s64 prev_seen_count = seen_count;
+		seen_count += series->histogram[i];
+
+		f32 bucket_top_ms = (f32)(i + 1) * FRAME_TIMES_BUCKET_MS;
+		if (series->max_ms < bucket_top_ms) bucket_top_ms = series->max_ms;
+
+		if (prev_seen_count < p50_rank && p50_rank <= seen_count) series->p50_ms = bucket_top_ms;
+		if (prev_seen_count < p95_rank && p95_rank <= seen_count) series->p95_ms = bucket_top_ms;
+		if (prev_seen_count < p99_rank && p99_rank <= seen_count) series->p99_ms = bucket_top_ms;
+	}
+}
+
+s64 frame_time_series_offset(FrameTimeSeries* series)
+{
+	if (series->samples_count < FRAME_TIMES_HISTORY_COUNT) return 0;
+	return series->sample_index;
+}
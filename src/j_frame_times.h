@@ -0,0 +1,27 @@
+#pragma once
+
+#include "types.h"
+#include "constants.h"
+
+// Last FRAME_TIMES_HISTORY_COUNT frame times. The histogram is updated as samples enter and
+// leave the window, so percentiles never need a sort.
+typedef struct FrameTimeSeries {
+	f32 samples_ms[FRAME_TIMES_HISTORY_COUNT];
+	s64 sample_index;
+	s64 samples_count;
+	u16 histogram[FRAME_TIMES_BUCKETS_COUNT];
+	f32 p50_ms;
+	f32 p95_ms;
+	f32 p99_ms;
+	f32 max_ms;
+} FrameTimeSeries;
+
+typedef struct FrameTimes {
+	FrameTimeSeries cpu;
+	FrameTimeSeries gpu;
+} FrameTimes;
+
+void frame_time_series_push(FrameTimeSeries* series, f32 elapsed_ms);
+
+// Offset of the oldest sample, for plotting the window in order
+s64 frame_time_series_offset(FrameTimeSeries* series);
@@ -0,0 +1,233 @@
+#include "j_gl_state.h"
+
+#include <cstring>
+
+#include "globals.h"
+
+bool gl_state_skip(u32* cached, u32 value)
+{
+	if (*cached == value)
+	{
+		g_frame_data.gl_calls_skipped++;
+		return true;
+	}
+
+	*cached = value;
+	g_frame_data.gl_calls_issued++;
+	return false;
+}
+
+s64 get_texture_target_index(GLenum target)
+{
+	switch (target)
+	{
+		case GL_TEXTURE_2D: return 0;
+		case GL_TEXTURE_2D_ARRAY: return 1;
+		case GL_TEXTURE_CUBE_MAP: return 2;
+		case GL_TEXTURE_BUFFER: return 3;
+	}
+
+	return -1;
+}
+
+s64 get_capability_index(GLenum capability)
+{
+	switch (capability)
+	{
+		case GL_DEPTH_TEST: return 0;
+		case GL_BLEND: return 1;
+		case GL_CULL_FACE: return 2;
+		case GL_SCISSOR_TEST: return 3;
+	}
+
+	return -1;
+}
+
+u32* get_cached_buffer(GLenum target)
+{
+	switch (target)
+	{
+		case GL_ARRAY_BUFFER: return &g_gl_state.array_buffer;
+		case GL_UNIFORM_BUFFER: return &g_gl_state.uniform_buffer;
+		case GL_TEXTURE_BUFFER: return &g_gl_state.texture_buffer;
+	}
+
+	// Element array binding belongs to the bound VAO, it is not cached
+	return nullptr;
+}
+
+// Call after code outside the wrappers has touched GL state, like ImGui rendering
+void gl_state_invalidate(GlState* state)
+{
+	memset(state, 0xFF, sizeof(GlState));
+}
+
+void gl_use_program(u32 program)
+{
+	if (gl_state_skip(&g_gl_state.program, program)) return;
+	glUseProgram(program);
+}
+
+void gl_bind_vertex_array(u32 vertex_array)
+{
+	if (gl_state_skip(&g_gl_state.vertex_array, vertex_array)) return;
+	glBindVertexArray(vertex_array);
+}
+
+void gl_bind_buffer(GLenum target, u32 buffer)
+{
+	u32* cached = get_cached_buffer(target);
+
+	if (cached == nullptr) g_frame_data.gl_calls_issued++;
+	else if (gl_state_skip(cached, buffer)) return;
+
+	glBindBuffer(target, buffer);
+}
+
+// Binding a range also binds the buffer to the generic target
+void gl_bind_buffer_range(GLenum target, u32 index, u32 buffer, GLintptr offset, GLsizeiptr size)
+{
+	u32* cached = get_cached_buffer(target);
+	if (cached != nullptr) *cached = buffer;
+
+	g_frame_data.gl_calls_issued++;
+	glBindBufferRange(target, index, buffer, offset, size);
+}
+
+void gl_active_texture(GLenum texture_unit)
+{
+	if (gl_state_skip(&g_gl_state.active_texture, texture_unit)) return;
+	glActiveTexture(texture_unit);
+}
+
+void gl_bind_texture(GLenum target, u32 texture)
+{
+	s64 target_index = get_texture_target_index(target);
+	s64 unit = (s64)g_gl_state.active_texture - GL_TEXTURE0;
+
+	// Unknown active unit or target, the binding cannot be tracked
+	if (target_index < 0 || unit < 0 || GL_STATE_TEXTURE_UNITS <= unit)
+	{
+		g_frame_data.gl_calls_issued++;
+		glBindTexture(target, texture);
+		return;
+	}
+
+	if (gl_state_skip(&g_gl_state.textures[unit][target_index], texture)) return;
+	glBindTexture(target, texture);
+}
+
+void gl_enable(GLenum capability)
+{
+	s64 index = get_capability_index(capability);
+	if (0 <= index && gl_state_skip(&g_gl_state.capabilities[index], GL_TRUE)) return;
+	if (index < 0) g_frame_data.gl_calls_issued++;
+
+	glEnable(capability);
+}
+
+void gl_disable(GLenum capability)
+{
+	s64 index = get_capability_index(capability);
+	if (0 <= index && gl_state_skip(&g_gl_state.capabilities[index], GL_FALSE)) return;
+	if (index < 0) g_frame_data.gl_calls_issued++;
+
+	glDisable(capability);
+}
+
+void gl_blend_func(GLenum src, GLenum dst)
+{
+	if (g_gl_state.blend_src == src && g_gl_state.blend_dst == dst)
+	{
+		g_frame_data.gl_calls_skipped++;
+		return;
+	}
+
+	g_gl_state.blend_src = src;
+	g_gl_state.blend_dst = dst;
+	g_frame_data.gl_calls_issued++;
+	glBlendFunc(src, dst);
+}
+
+void gl_depth_func(GLenum func)
+{
+	if (gl_state_skip(&g_gl_state.depth_func, func)) return;
+	glDepthFunc(func);
+}
+
+void gl_depth_mask(GLboolean flag)
+{
+	if (gl_state_skip(&g_gl_state.depth_mask, flag)) return;
+	glDepthMask(flag);
+}
+
+void gl_cull_face(GLenum mode)
+{
+	if (gl_state_skip(&g_gl_state.cull_face, mode)) return;
+	glCullFace(mode);
+}
+
+void gl_viewport(s32 x, s32 y, s32 width, s32 height)
+{
+	s32* viewport = g_gl_state.viewport;
+
+	if (viewport[0] == x && viewport[1] == y && viewport[2] == width && viewport[3] == height)
+	{
+		g_frame_data.gl_calls_skipped++;
+		return;
+	}
+
+	viewport[0] = x;
+	viewport[1] = y;
+	viewport[2] = width;
+	viewport[3] = height;
+	g_frame_data.gl_calls_issued++;
+	glViewport(x, y, width, height);
+}
+
+void gl_bind_framebuffer(GLenum target, u32 framebuffer)
+{
+	bool sets_draw = target == GL_FRAMEBUFFER || target == GL_DRAW_FRAMEBUFFER;
+	bool sets_read = target == GL_FRAMEBUFFER || target == GL_READ_FRAMEBUFFER;
+	bool is_current = (!sets_draw || g_gl_state.draw_framebuffer == framebuffer)
+		&& (!sets_read || g_gl_state.read_framebuffer == framebuffer);
+
+	if (is_current)
+	{
+		g_frame_data.gl_calls_skipped++;
+		return;
+	}
+
+	if (sets_draw) g_gl_state.draw_framebuffer = framebuffer;
+	if (sets_read) g_gl_state.read_framebuffer = framebuffer;
+	g_frame_data.gl_calls_issued++;
+	glBindFramebuffer(target, framebuffer);
+}
+
+// Deleted names unbind themselves and may be handed out again, so they must not stay cached
+void gl_delete_textures(s32 count, u32* textures)
+{
+	for (s32 i = 0; i < count; i++)
+	{
+		for (s64 unit = 0; unit < GL_STATE_TEXTURE_UNITS; unit++)
+		{
+			for (s64 target = 0; target < GL_STATE_TEXTURE_TARGETS; target++)
+			{
+				if (g_gl_state.textures[unit][target] == textures[i]) g_gl_state.textures[unit][target] = 0;
+			}
+		}
+	}
+
+	glDeleteTextures(count, textures);
+}
+
+void gl_delete_framebuffers(s32 count, u32* framebuffers)
+{
+	for (s32 i = 0; i < count; i++)
+	{
+		if (g_gl_state.draw_framebuffer == framebuffers[i]) g_gl_state.draw_framebuffer = 0;
+		if (g_gl_state.read_framebuffer == framebuffers[i]) g_gl_state.read_framebuffer = 0;
+	}
+
+	glDeleteFramebuffers(count, framebuffers);
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include "types.h"
+#include "constants.h"
+
+// Last values set through the gl_* wrappers. GL_STATE_UNKNOWN marks values that
+// were changed behind the cache's back, the next call with any value is issued.
+typedef struct GlState {
+	u32 program;
+	u32 vertex_array;
+	u32 array_buffer;
+	u32 uniform_buffer;
+	u32 texture_buffer;
+	u32 active_texture;
+	u32 textures[GL_STATE_TEXTURE_UNITS][GL_STATE_TEXTURE_TARGETS];
+	u32 capabilities[GL_STATE_CAPABILITIES];
+	u32 blend_src;
+	u32 blend_dst;
+	u32 depth_func;
+	u32 depth_mask;
+	u32 cull_face;
+	s32 viewport[4];
+	u32 draw_framebuffer;
+	u32 read_framebuffer;
+} GlState;
+
+void gl_state_invalidate(GlState* state);
+
+void gl_use_program(u32 program);
+
+void gl_bind_vertex_array(u32 vertex_array);
+
+void gl_bind_buffer(GLenum target, u32 buffer);
+
+void gl_bind_buffer_range(GLenum target, u32 index, u32 buffer, GLintptr offset, GLsizeiptr size);
+
+void gl_active_texture(GLenum texture_unit);
+
+void gl_bind_texture(GLenum target, u32 texture);
+
+void gl_enable(GLenum capability);
+
+void gl_disable(GLenum capability);
+
+void gl_blend_func(GLenum src, GLenum dst);
+
+void gl_depth_func(GLenum func);
+
+void gl_depth_mask(GLboolean flag);
+
+void gl_cull_face(GLenum mode);
+
+void gl_viewport(s32 x, s32 y, s32 width, s32 height);
+
+void gl_bind_framebuffer(GLenum target, u32 framebuffer);
+
+void gl_delete_textures(s32 count, u32* textures);
+
+void gl_delete_framebuffers(s32 count, u32* framebuffers);
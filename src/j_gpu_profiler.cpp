@@ -0,0 +1,182 @@
+#include "j_gpu_profiler.h"
+
+#include <cstdio>
+#include <cstring>
+#include <glad/glad.h>
+
+#define GLFW_INCLUDE_NONE
+#include <GLFW/glfw3.h>
+
+#include "j_assert.h"
+
+void pass_timings_push(PassTimings* timings, f32 elapsed_ms)
+{
+	timings->samples_ms[timings->sample_index] = elapsed_ms;
+	timings->sample_index = (timings->sample_index + 1) % GPU_PROFILER_HISTORY_COUNT;
+	if (timings->samples_count < GPU_PROFILER_HISTORY_COUNT) timings->samples_count++;
+
+	f32 total_ms = 0.0f;
+	f32 max_ms = 0.0f;
+
+	for (s64 i = 0; i < timings->samples_count; i++)
+	{
+		total_ms += timings->samples_ms[i];
+		if (max_ms < timings->samples_ms[i]) max_ms = timings->samples_ms[i];
+	}
+
+	timings->average_ms = total_ms / (f32)timings->samples_count;
+	timings->max_ms = max_ms;
+}
+
+void gpu_profiler_init(GpuProfiler* profiler)
+{
+	*profiler = {};
+
+	// Implementations may report zero bits when timestamps are unsupported, CPU timings still work then
+	s32 counter_bits = 0;
+	glGetQueryiv(GL_TIMESTAMP, GL_QUERY_COUNTER_BITS, &counter_bits);
+	profiler->has_timestamps = 0 < counter_bits;
+
+	if (!profiler->has_timestamps) return;
+
+	for (s64 i = 0; i < GPU_PROFILER_FRAMES; i++)
+	{
+		glGenQueries(GPU_PROFILER_MAX_PASSES * 2, profiler->frames[i].queries);
+	}
+}
+
+// Reads back the oldest frame before its queries are reused. Results that are not
+// ready are dropped instead of waited for.
+// Returns true when the results of an earlier frame were read back into frame_gpu_ms
+bool gpu_profiler_begin_frame(GpuProfiler* profiler)
+{
+	ASSERT_TRUE(profiler->open_passes_count == 0, "Profiled passes closed before the frame ends");
+
+	profiler->frames_count++;
+	profiler->frame_index = (profiler->frame_index + 1) % GPU_PROFILER_FRAMES;
+	GpuProfilerFrame* frame = &profiler->frames[profiler->frame_index];
+	bool has_results = false;
+
+	if (0 < frame->samples_count)
+	{
+		s32 is_available = 0;
+		glGetQueryObjectiv(frame->queries[frame->last_query_index], GL_QUERY_RESULT_AVAILABLE, &is_available);
+
+		if (is_available)
+		{
+			profiler->frame_gpu_ms = 0.0f;
+
+			for (s64 i = 0; i < frame->samples_count; i++)
+			{
+				GLuint64 begin_ns = 0;
+				GLuint64 end_ns = 0;
+				glGetQueryObjectui64v(frame->queries[i * 2], GL_QUERY_RESULT, &begin_ns);
+				glGetQueryObjectui64v(frame->queries[i * 2 + 1], GL_QUERY_RESULT, &end_ns);
+
+				ProfiledPass* pass = &profiler->passes[frame->pass_indices[i]];
+				f32 elapsed_ms = (f32)(end_ns - begin_ns) / 1000000.0f;
+				pass_timings_push(&pass->gpu, elapsed_ms);
+				if (frame->depths[i] == 0) profiler->frame_gpu_ms += elapsed_ms;
+			}
+
+			has_results = true;
+		}
+		else profiler->samples_dropped += frame->samples_count;
+	}
+
+	frame->samples_count = 0;
+	return has_results;
+}
+
+s64 get_profiled_pass_index(GpuProfiler* profiler, const char* name)
+{
+	for (s64 i = 0; i < profiler->passes_count; i++)
+	{
+		if (strcmp(profiler->passes[i].name, name) == 0) return i;
+	}
+
+	ASSERT_TRUE(profiler->passes_count < GPU_PROFILER_MAX_PASSES, "Profiled passes not full");
+
+	s64 index = profiler->passes_count++;
+	profiler->passes[index] = {};
+	profiler->passes[index].name = name;
+	return index;
+}
+
+void gpu_profiler_begin_pass(GpuProfiler* profiler, const char* name)
+{
+	ASSERT_TRUE(profiler->open_passes_count < GPU_PROFILER_MAX_DEPTH, "Profiled passes not nested too deep");
+
+	s64 pass_index = get_profiled_pass_index(profiler, name);
+	ProfiledPass* pass = &profiler->passes[pass_index];
+
+	// Passes that were skipped for a while start a fresh window instead of showing stale timings
+	if (!gpu_profiler_pass_is_active(profiler, pass))
+	{
+		pass->gpu = {};
+		pass->cpu = {};
+	}
+
+	pass->last_frame = profiler->frames_count;
+
+	OpenProfiledPass* open_pass = &profiler->open_passes[profiler->open_passes_count++];
+	open_pass->pass_index = pass_index;
+	open_pass->sample_index = -1;
+	open_pass->cpu_time = glfwGetTime();
+
+	if (!profiler->has_timestamps) return;
+
+	GpuProfilerFrame* frame = &profiler->frames[profiler->frame_index];
+	ASSERT_TRUE(frame->samples_count < GPU_PROFILER_MAX_PASSES, "Profiled frame samples not full");
+
+	s64 sample_index = frame->samples_count++;
+	frame->pass_indices[sample_index] = pass_index;
+	frame->depths[sample_index] = profiler->open_passes_count - 1;
+	open_pass->sample_index = sample_index;
+	glQueryCounter(frame->queries[sample_index * 2], GL_TIMESTAMP);
+}
+
+void gpu_profiler_end_pass(GpuProfiler* profiler)
+{
+	ASSERT_TRUE(0 < profiler->open_passes_count, "Profiled pass is open");
+
+	OpenProfiledPass* open_pass = &profiler->open_passes[--profiler->open_passes_count];
+	ProfiledPass* pass = &profiler->passes[open_pass->pass_index];
+	f64 cpu_elapsed_ms = (glfwGetTime() - open_pass->cpu_time) * 1000.0;
+	pass_timings_push(&pass->cpu, (f32)cpu_elapsed_ms);
+
+	if (!profiler->has_timestamps) return;
+
+	GpuProfilerFrame* frame = &profiler->frames[profiler->frame_index];
+	frame->last_query_index = open_pass->sample_index * 2 + 1;
+	glQueryCounter(frame->queries[frame->last_query_index], GL_TIMESTAMP);
+}
+
+// Passes not begun within the last GPU_PROFILER_FRAMES frames, like the depth pre-pass
+// in deferred mode, are left out of the overlay and exports
+bool gpu_profiler_pass_is_active(GpuProfiler* profiler, ProfiledPass* pass)
+{
+	return profiler->frames_count - pass->last_frame <= GPU_PROFILER_FRAMES;
+}
+
+// Writes the rolling GPU and CPU timings of every pass as CSV
+bool gpu_profiler_export(GpuProfiler* profiler, const char* path)
+{
+	FILE* file;
+	int success = fopen_s(&file, path, "w");
+	if (success != 0) return false;
+
+	fprintf(file, "pass,gpu_average_ms,gpu_max_ms,cpu_average_ms,cpu_max_ms,samples\n");
+
+	for (s64 i = 0; i < profiler->passes_count; i++)
+	{
+		ProfiledPass* pass = &profiler->passes[i];
+		if (!gpu_profiler_pass_is_active(profiler, pass)) continue;
+
+		fprintf(file, "%s,%.4f,%.4f,%.4f,%.4f,%lld\n",
+			pass->name, pass->gpu.average_ms, pass->gpu.max_ms, pass->cpu.average_ms, pass->cpu.max_ms, pass->cpu.samples_count);
+	}
+
+	fclose(file);
+	return true;
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "types.h"
+#include "constants.h"
+
+// Rolling window of the last GPU_PROFILER_HISTORY_COUNT samples
+typedef struct PassTimings {
+	f32 samples_ms[GPU_PROFILER_HISTORY_COUNT];
+	s64 sample_index;
+	s64 samples_count;
+	f32 average_ms;
+	f32 max_ms;
+} PassTimings;
+
+typedef struct ProfiledPass {
+	const char* name;
+	PassTimings gpu;
+	PassTimings cpu;
+	s64 last_frame; // Profiler frame the pass was last begun in
+} ProfiledPass;
+
+// GL_TIMESTAMP pair per pass, unlike GL_TIME_ELAPSED queries timestamps can be
+// taken inside another pass so zones nest
+typedef struct GpuProfilerFrame {
+	u32 queries[GPU_PROFILER_MAX_PASSES * 2];
+	s64 pass_indices[GPU_PROFILER_MAX_PASSES];
+	s64 depths[GPU_PROFILER_MAX_PASSES]; // Only top level samples add to frame_gpu_ms
+	s64 samples_count;
+	s64 last_query_index; // Issued last, its result is ready when all others are
+} GpuProfilerFrame;
+
+typedef struct OpenProfiledPass {
+	s64 pass_index;
+	s64 sample_index;
+	f64 cpu_time;
+} OpenProfiledPass;
+
+typedef struct GpuProfiler {
+	ProfiledPass passes[GPU_PROFILER_MAX_PASSES];
+	s64 passes_count;
+	GpuProfilerFrame frames[GPU_PROFILER_FRAMES];
+	s64 frame_index;
+	s64 frames_count;
+	OpenProfiledPass open_passes[GPU_PROFILER_MAX_DEPTH];
+	s64 open_passes_count;
+	s64 samples_dropped; // Results not yet available when their frame came around again
+	f32 frame_gpu_ms; // Sum of the top level passes of the newest frame read back
+	bool has_timestamps;
+} GpuProfiler;
+
+void gpu_profiler_init(GpuProfiler* profiler);
+
+bool gpu_profiler_begin_frame(GpuProfiler* profiler);
+
+void gpu_profiler_begin_pass(GpuProfiler* profiler, const char* name);
+
+void gpu_profiler_end_pass(GpuProfiler* profiler);
+
+bool gpu_profiler_pass_is_active(GpuProfiler* profiler, ProfiledPass* pass);
+
+bool gpu_profiler_export(GpuProfiler* profiler, const char* path);
@@ -9,6 +9,7 @@
 #include "scene.h"
 #include "j_platform.h"
 #include "j_assert.h"
+#include "j_render.h"
 
 void imgui_new_frame()
 {
@@ -71,10 +72,86 @@ void main_menu_bar()
 			ImGui::EndMenu();
 		}
 
+		if (ImGui::BeginMenu("Debug"))
+		{
+			if (ImGui::MenuItem("Run culling benchmark", nullptr, false, true))
+			{
+				run_culling_benchmark();
+			}
+
+			if (ImGui::MenuItem("Run light clustering benchmark", nullptr, false, true))
+			{
+				run_light_clusters_check();
+				run_light_clusters_benchmark();
+			}
+
+			if (ImGui::MenuItem("Run UI text benchmark", nullptr, false, true))
+			{
+				run_ui_text_benchmark();
+			}
+
+			if (ImGui::MenuItem("Export pass timings", nullptr, false, true))
+			{
+				bool exported = gpu_profiler_export(&g_gpu_profiler, PASS_TIMINGS_EXPORT_PATH);
+				printf("Pass timings %s %s\n", exported ? "exported to" : "could not be written to", PASS_TIMINGS_EXPORT_PATH);
+			}
+
+			if (ImGui::MenuItem("Capture CPU trace", nullptr, false, !g_profiler.is_capturing))
+			{
+				profiler_request_capture(&g_profiler, PROFILER_CAPTURE_FRAMES);
+			}
+
+			ImGui::EndMenu();
+		}
+
 		ImGui::EndMenuBar();
 	}
 }
 
+void frame_time_plot(const char* label, FrameTimeSeries* series)
+{
+	char overlay_str[64];
+	sprintf_s(overlay_str, "p50 %.2f p95 %.2f p99 %.2f max %.2f", series->p50_ms, series->p95_ms, series->p99_ms, series->max_ms);
+
+	f32 plot_max_ms = g_profiler.spike_budget_ms;
+	if (plot_max_ms < series->max_ms) plot_max_ms = series->max_ms;
+
+	ImGui::PlotLines(label, series->samples_ms, (int)series->samples_count, (int)frame_time_series_offset(series),
+		overlay_str, 0.0f, plot_max_ms, ImVec2(0, 48.0f));
+}
+
+void frame_times_panel()
+{
+	ImGui::Text("Frame times (ms)");
+	frame_time_plot("CPU", &g_frame_times.cpu);
+	if (g_gpu_profiler.has_timestamps) frame_time_plot("GPU", &g_frame_times.gpu);
+	ImGui::InputFloat("Spike budget ms", &g_profiler.spike_budget_ms, 0, 0, "%.1f");
+	if (g_profiler.spike_budget_ms < PROFILER_SPIKE_BUDGET_MIN_MS) g_profiler.spike_budget_ms = PROFILER_SPIKE_BUDGET_MIN_MS;
+
+	s64 spikes_kept = g_profiler.spikes_count < PROFILER_SPIKES_COUNT ? g_profiler.spikes_count : PROFILER_SPIKES_COUNT;
+
+	// Newest first, every zone is indented by its depth
+	for (s64 i = 0; i < spikes_kept; i++)
+	{
+		SpikeCapture* spike = &g_profiler.spikes[(g_profiler.spikes_count - 1 - i) % PROFILER_SPIKES_COUNT];
+		ImGui::PushID((int)i);
+
+		if (ImGui::TreeNode("spike", "Frame %lld: %.2fms", spike->frame, spike->frame_ms))
+		{
+			for (s64 e = 0; e < spike->events_count; e++)
+			{
+				ProfileEvent* event = &spike->events[e];
+				f32 event_ms = (f32)(event->end_ns - event->begin_ns) / 1000000.0f;
+				ImGui::Text("%*s%s %.3f", event->depth * 2, "", event->name, event_ms);
+			}
+
+			ImGui::TreePop();
+		}
+
+		ImGui::PopID();
+	}
+}
+
 void right_hand_editor_panel()
 {
 	ImGui::SetNextWindowPos(ImVec2(static_cast<float>(g_game_metrics.game_width_px - PROPERTIES_PANEL_WIDTH), 0), ImGuiCond_Always);
@@ -133,9 +210,12 @@ void right_hand_editor_panel()
 			Mesh* selected_mesh_ptr = (Mesh*)get_selected_object_ptr();
 
 			ImGui::Text("Mesh properties");
-			ImGui::InputFloat3("Translation", &selected_mesh_ptr->transforms.translation[0], "%.2f");
-			ImGui::InputFloat3("Rotation", &selected_mesh_ptr->transforms.rotation[0], "%.2f");
-			ImGui::InputFloat3("Scale", &selected_mesh_ptr->transforms.scale[0], "%.2f");
+			bool transforms_edited = false;
+			transforms_edited |= ImGui::InputFloat3("Translation", &selected_mesh_ptr->transforms.translation[0], "%.2f");
+			transforms_edited |= ImGui::InputFloat3("Rotation", &selected_mesh_ptr->transforms.rotation[0], "%.2f");
+			transforms_edited |= ImGui::InputFloat3("Scale", &selected_mesh_ptr->transforms.scale[0], "%.2f");
+
+			if (transforms_edited) mark_mesh_shadows_dirty(selected_mesh_ptr);
 
 			ImGui::Text("Select material");
 			ImGui::Image((ImTextureID)selected_mesh_ptr->material->color_texture->gpu_id, ImVec2(128, 128));
@@ -176,12 +256,18 @@ void right_hand_editor_panel()
 			ImGui::Text("Spotlight properties");
 			ImGui::Checkbox("On/off", &selected_spotlight_ptr->is_on);
 			ImGui::ColorEdit3("Color", &selected_spotlight_ptr->diffuse[0], 0);
-			ImGui::InputFloat3("Position", &selected_spotlight_ptr->transforms.translation[0], "%.2f");
-			ImGui::InputFloat3("Rotation", &selected_spotlight_ptr->transforms.rotation[0], "%.2f");
+
+			// Fields used by the light space matrix invalidate the shadow map
+			bool shadow_edited = false;
+			shadow_edited |= ImGui::InputFloat3("Position", &selected_spotlight_ptr->transforms.translation[0], "%.2f");
+			shadow_edited |= ImGui::InputFloat3("Rotation", &selected_spotlight_ptr->transforms.rotation[0], "%.2f");
 			ImGui::InputFloat("Specular", &selected_spotlight_ptr->specular, 0, 0, "%.2f");
-			ImGui::InputFloat("Range", &selected_spotlight_ptr->range, 0, 0, "%.2f");
+			shadow_edited |= ImGui::InputFloat("Range", &selected_spotlight_ptr->range, 0, 0, "%.2f");
 			ImGui::InputFloat("FOV", &selected_spotlight_ptr->fov, 0, 0, "%.1f");
-			ImGui::InputFloat("Outer cutoff", &selected_spotlight_ptr->outer_cutoff_fov, 0, 0, "%.1f");
+			shadow_edited |= ImGui::InputFloat("Outer cutoff", &selected_spotlight_ptr->outer_cutoff_fov, 0, 0, "%.1f");
+
+			if (shadow_edited) selected_spotlight_ptr->shadow_dirty = true;
+			ImGui::Text("Shadow casters: %lld", selected_spotlight_ptr->shadow_casters_count);
 			ImGui::Checkbox("DEBUG_SHADOWMAP", &DEBUG_SHADOWMAP);
 		}
 	}
@@ -193,6 +279,8 @@ void right_hand_editor_panel()
 	ImGui::Text("Scene settings");
 	ImGui::ColorEdit3("Global ambient", &g_user_settings.world_ambient[0], 0);
 	ImGui::Checkbox("Skybox", &g_user_settings.use_skybox);
+	ImGui::Checkbox("Deferred shading", &g_user_settings.use_deferred_shading);
+	ImGui::Checkbox("Depth pre-pass", &g_user_settings.use_depth_prepass);
 
 	ImGui::Text("Game window");
 	ImGui::InputInt2("Screen width px", &g_user_settings.window_size_px[0]);
@@ -205,11 +293,17 @@ void right_hand_editor_panel()
 	ImGui::InputFloat("Blur amount", &g_pp_settings.blur_effect_amount, 0, 0, "%.1f");
 	ImGui::InputFloat("Gamma", &g_pp_settings.gamma_amount, 0, 0, "%.1f");
 
+	frame_times_panel();
+
 	ImGui::End();
 }
 
 void imgui_end_frame()
 {
+	PROFILE_ZONE("ImGui render");
 	ImGui::Render();
 	ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+
+	// The backend sets GL state without going through the cache
+	gl_state_invalidate(&g_gl_state);
 }
@@ -0,0 +1,305 @@
+#include "j_light_clusters.h"
+
+#include <cstdlib>
+#include <cstring>
+
+#define GLFW_INCLUDE_NONE
+#include <GLFW/glfw3.h>
+
+#include "j_assert.h"
+#include "constants.h"
+
+s64 light_clusters_memory_size(s64 lights_capacity, s64 light_indices_capacity)
+{
+	s64 clusters_size = 4 * sizeof(u32) * LIGHT_CLUSTERS_COUNT;
+	s64 indices_size = sizeof(u16) * light_indices_capacity;
+	s64 ranges_size = sizeof(LightClusterRange) * lights_capacity;
+	return clusters_size + indices_size + ranges_size;
+}
+
+LightClusters light_clusters_init(MemoryBuffer* memory, s64 lights_capacity, s64 light_indices_capacity)
+{
+	ASSERT_TRUE(lights_capacity <= 0xFFFF, "Light indices fit 16 bits");
+
+	LightClusters clusters = {
+		.cluster_data = (u32*)memory_buffer_suballocate(memory, 2 * sizeof(u32) * LIGHT_CLUSTERS_COUNT).memory,
+		.point_cursors = (u32*)memory_buffer_suballocate(memory, sizeof(u32) * LIGHT_CLUSTERS_COUNT).memory,
+		.spot_cursors = (u32*)memory_buffer_suballocate(memory, sizeof(u32) * LIGHT_CLUSTERS_COUNT).memory,
+		.light_indices = (u16*)memory_buffer_suballocate(memory, sizeof(u16) * light_indices_capacity).memory,
+		.light_indices_count = 0,
+		.light_indices_capacity = light_indices_capacity,
+		.light_ranges = (LightClusterRange*)memory_buffer_suballocate(memory, sizeof(LightClusterRange) * lights_capacity).memory,
+		.lights_capacity = lights_capacity,
+	};
+	return clusters;
+}
+
+void light_clusters_set_projection(LightClusters* clusters, f32 fov_y_radians, f32 aspect_ratio, f32 near_plane, f32 far_plane)
+{
+	clusters->near_plane = near_plane;
+	clusters->far_plane = far_plane;
+	clusters->tan_half_fov_y = glm::tan(fov_y_radians * 0.5f);
+	clusters->tan_half_fov_x = clusters->tan_half_fov_y * aspect_ratio;
+
+	// slice = log(depth) * scale - bias, so slices grow with distance like the depth buffer precision
+	f32 log_depth_ratio = glm::log(far_plane / near_plane);
+	clusters->slice_scale = (f32)LIGHT_CLUSTERS_Z / log_depth_ratio;
+	clusters->slice_bias = (f32)LIGHT_CLUSTERS_Z * glm::log(near_plane) / log_depth_ratio;
+}
+
+s64 get_light_cluster_slice(LightClusters* clusters, f32 view_depth)
+{
+	f32 slice = glm::floor(glm::log(view_depth) * clusters->slice_scale - clusters->slice_bias);
+	return glm::clamp((s64)slice, (s64)0, LIGHT_CLUSTERS_Z - 1);
+}
+
+s32 get_light_cluster_tile(f32 ndc, s64 tiles_count)
+{
+	s64 tile = (s64)glm::floor((ndc + 1.0f) * 0.5f * tiles_count);
+	return (s32)glm::clamp(tile, (s64)0, tiles_count - 1);
+}
+
+LightClusterRange get_light_cluster_range(LightClusters* clusters, LightSphere sphere)
+{
+	LightClusterRange empty = { 0, -1, 0, -1, 0, -1 };
+	glm::vec3 center = sphere.view_position;
+	f32 radius = sphere.radius;
+
+	f32 min_depth = -center.z - radius;
+	f32 max_depth = -center.z + radius;
+	if (max_depth < clusters->near_plane || clusters->far_plane < min_depth) return empty;
+
+	LightClusterRange range = {
+		.min_x = 0,
+		.max_x = LIGHT_CLUSTERS_X - 1,
+		.min_y = 0,
+		.max_y = LIGHT_CLUSTERS_Y - 1,
+		.min_z = (s32)get_light_cluster_slice(clusters, glm::max(min_depth, clusters->near_plane)),
+		.max_z = (s32)get_light_cluster_slice(clusters, glm::min(max_depth, clusters->far_plane)),
+	};
+
+	// Spheres crossing the near plane can cover any tile
+	if (min_depth <= clusters->near_plane) return range;
+
+	// x / depth is monotonic in depth, so the extremes of the sphere's box are at its nearest and farthest depth
+	f32 ndc_min_x = glm::min((center.x - radius) / (min_depth * clusters->tan_half_fov_x), (center.x - radius) / (max_depth * clusters->tan_half_fov_x));
+	f32 ndc_max_x = glm::max((center.x + radius) / (min_depth * clusters->tan_half_fov_x), (center.x + radius) / (max_depth * clusters->tan_half_fov_x));
+	f32 ndc_min_y = glm::min((center.y - radius) / (min_depth * clusters->tan_half_fov_y), (center.y - radius) / (max_depth * clusters->tan_half_fov_y));
+	f32 ndc_max_y = glm::max((center.y + radius) / (min_depth * clusters->tan_half_fov_y), (center.y + radius) / (max_depth * clusters->tan_half_fov_y));
+
+	if (ndc_max_x < -1.0f || 1.0f < ndc_min_x || ndc_max_y < -1.0f || 1.0f < ndc_min_y) return empty;
+
+	range.min_x = get_light_cluster_tile(ndc_min_x, LIGHT_CLUSTERS_X);
+	range.max_x = get_light_cluster_tile(ndc_max_x, LIGHT_CLUSTERS_X);
+	range.min_y = get_light_cluster_tile(ndc_min_y, LIGHT_CLUSTERS_Y);
+	range.max_y = get_light_cluster_tile(ndc_max_y, LIGHT_CLUSTERS_Y);
+	return range;
+}
+
+// Distance where the 1 / (1 + distance / range) falloff of the lighting shader times
+// brightness drops below LIGHT_CLUSTER_CUTOFF. The falloff never reaches zero.
+f32 get_light_cluster_radius(f32 range, f32 brightness)
+{
+	return range * glm::max(brightness / LIGHT_CLUSTER_CUTOFF - 1.0f, 0.0f);
+}
+
+inline s64 get_light_cluster_index(s64 x, s64 y, s64 z)
+{
+	return x + LIGHT_CLUSTERS_X * (y + LIGHT_CLUSTERS_Y * z);
+}
+
+void light_clusters_count(LightClusters* clusters, LightSphere* lights, s64 lights_count, LightClusterRange* ranges, u32* counts)
+{
+	for (s64 i = 0; i < lights_count; i++)
+	{
+		LightClusterRange range = get_light_cluster_range(clusters, lights[i]);
+		ranges[i] = range;
+
+		for (s64 z = range.min_z; z <= range.max_z; z++)
+		{
+			for (s64 y = range.min_y; y <= range.max_y; y++)
+			{
+				for (s64 x = range.min_x; x <= range.max_x; x++)
+				{
+					counts[get_light_cluster_index(x, y, z)]++;
+				}
+			}
+		}
+	}
+}
+
+void light_clusters_fill(LightClusters* clusters, s64 lights_count, LightClusterRange* ranges, u32* cursors, bool is_spotlight)
+{
+	for (s64 i = 0; i < lights_count; i++)
+	{
+		LightClusterRange range = ranges[i];
+
+		for (s64 z = range.min_z; z <= range.max_z; z++)
+		{
+			for (s64 y = range.min_y; y <= range.max_y; y++)
+			{
+				for (s64 x = range.min_x; x <= range.max_x; x++)
+				{
+					s64 cluster = get_light_cluster_index(x, y, z);
+					u32 first = clusters->cluster_data[2 * cluster];
+					u32 counts = clusters->cluster_data[2 * cluster + 1];
+					u32 end = first + (counts & 0xFFFF) + (is_spotlight ? counts >> 16 : 0);
+
+					// Lights past a full index list are dropped from the cluster
+					if (cursors[cluster] < end) clusters->light_indices[cursors[cluster]++] = (u16)i;
+				}
+			}
+		}
+	}
+}
+
+void light_clusters_bin(LightClusters* clusters, LightSphere* pointlights, s64 pointlights_count, LightSphere* spotlights, s64 spotlights_count)
+{
+	ASSERT_TRUE(pointlights_count + spotlights_count <= clusters->lights_capacity, "Light clusters have capacity for lights");
+
+	LightClusterRange* point_ranges = clusters->light_ranges;
+	LightClusterRange* spot_ranges = &clusters->light_ranges[pointlights_count];
+
+	memset(clusters->point_cursors, 0, sizeof(u32) * LIGHT_CLUSTERS_COUNT);
+	memset(clusters->spot_cursors, 0, sizeof(u32) * LIGHT_CLUSTERS_COUNT);
+
+	light_clusters_count(clusters, pointlights, pointlights_count, point_ranges, clusters->point_cursors);
+	light_clusters_count(clusters, spotlights, spotlights_count, spot_ranges, clusters->spot_cursors);
+
+	// Prefix sum into list offsets, the counts are clamped once the index list is full
+	s64 offset = 0;
+
+	for (s64 i = 0; i < LIGHT_CLUSTERS_COUNT; i++)
+	{
+		s64 free_indices = clusters->light_indices_capacity - offset;
+		s64 point_count = glm::min((s64)clusters->point_cursors[i], free_indices);
+		s64 spot_count = glm::min((s64)clusters->spot_cursors[i], free_indices - point_count);
+
+		clusters->cluster_data[2 * i] = (u32)offset;
+		clusters->cluster_data[2 * i + 1] = (u32)(point_count | (spot_count << 16));
+		clusters->point_cursors[i] = (u32)offset;
+		clusters->spot_cursors[i] = (u32)(offset + point_count);
+		offset += point_count + spot_count;
+	}
+
+	clusters->light_indices_count = offset;
+
+	light_clusters_fill(clusters, pointlights_count, point_ranges, clusters->point_cursors, false);
+	light_clusters_fill(clusters, spotlights_count, spot_ranges, clusters->spot_cursors, true);
+}
+
+bool light_cluster_has_lights(LightClusters* clusters, s64 x, s64 y, s64 z, const u16* pointlights, s64 pointlights_count, const u16* spotlights, s64 spotlights_count)
+{
+	s64 cluster = get_light_cluster_index(x, y, z);
+	u32 first = clusters->cluster_data[2 * cluster];
+	u32 counts = clusters->cluster_data[2 * cluster + 1];
+
+	if ((counts & 0xFFFF) != pointlights_count || (counts >> 16) != spotlights_count) return false;
+
+	for (s64 i = 0; i < pointlights_count; i++)
+	{
+		if (clusters->light_indices[first + i] != pointlights[i]) return false;
+	}
+
+	for (s64 i = 0; i < spotlights_count; i++)
+	{
+		if (clusters->light_indices[first + pointlights_count + i] != spotlights[i]) return false;
+	}
+
+	return true;
+}
+
+// Bins a known light set and compares clusters against lists worked out by hand.
+// Near 1 and far 2^24 make the depth slice of a view depth floor(log2(depth)).
+void run_light_clusters_check()
+{
+	constexpr const s64 check_lights_count = 5;
+	constexpr const s64 check_indices_capacity = 1024;
+
+	MemoryBuffer check_memory = {};
+	memory_buffer_mallocate(&check_memory, light_clusters_memory_size(check_lights_count, check_indices_capacity), const_cast<char*>("Light clusters check"));
+
+	LightClusters clusters = light_clusters_init(&check_memory, check_lights_count, check_indices_capacity);
+	light_clusters_set_projection(&clusters, glm::radians(90.0f), 1.0f, 1.0f, 16777216.0f);
+
+	// At full brightness the light is binned out to 509 times its range
+	ASSERT_TRUE(glm::abs(get_light_cluster_radius(2.0f, 1.0f) - 1018.0f) < 0.01f, "Light cluster radius follows the shader falloff");
+	ASSERT_TRUE(get_light_cluster_radius(2.0f, LIGHT_CLUSTER_CUTOFF * 0.5f) == 0.0f, "Light cluster radius of a light below the cutoff is zero");
+
+	LightSphere pointlights[] = {
+		{ glm::vec3(0.0f, 0.0f, -12.0f), 2.0f }, // Tiles x 6..9, y 3..5, slice 3
+		{ glm::vec3(0.0f, 0.0f, 10.0f), 1.0f }, // Behind the camera
+		{ glm::vec3(0.0f, 0.0f, -1.5f), 1.0f }, // Crosses the near plane, every tile of slices 0..1
+		{ glm::vec3(3.5f, 0.0f, -12.0f), 2.0f }, // Tiles x 8..12, y 3..5, slice 3
+	};
+	LightSphere spotlights[] = {
+		{ glm::vec3(0.0f, 0.0f, -40.0f), 3.0f }, // Tiles x 7..8, y 4, slice 5
+	};
+
+	light_clusters_bin(&clusters, pointlights, 4, spotlights, 1);
+
+	const u16 first_only[] = { 0 };
+	const u16 first_and_last[] = { 0, 3 };
+	const u16 last_only[] = { 3 };
+	const u16 near_only[] = { 2 };
+
+	ASSERT_TRUE(clusters.light_indices_count == 12 + 16 * 9 * 2 + 15 + 2, "Light clusters index count");
+	ASSERT_TRUE(light_cluster_has_lights(&clusters, 6, 3, 3, first_only, 1, nullptr, 0), "Light cluster 6, 3, 3");
+	ASSERT_TRUE(light_cluster_has_lights(&clusters, 8, 4, 3, first_and_last, 2, nullptr, 0), "Light cluster 8, 4, 3");
+	ASSERT_TRUE(light_cluster_has_lights(&clusters, 12, 5, 3, last_only, 1, nullptr, 0), "Light cluster 12, 5, 3");
+	ASSERT_TRUE(light_cluster_has_lights(&clusters, 10, 6, 3, nullptr, 0, nullptr, 0), "Light cluster 10, 6, 3");
+	ASSERT_TRUE(light_cluster_has_lights(&clusters, 7, 4, 5, nullptr, 0, first_only, 1), "Light cluster 7, 4, 5");
+	ASSERT_TRUE(light_cluster_has_lights(&clusters, 7, 4, 4, nullptr, 0, nullptr, 0), "Light cluster 7, 4, 4");
+	ASSERT_TRUE(light_cluster_has_lights(&clusters, 0, 0, 0, near_only, 1, nullptr, 0), "Light cluster 0, 0, 0");
+	ASSERT_TRUE(light_cluster_has_lights(&clusters, 15, 8, 1, near_only, 1, nullptr, 0), "Light cluster 15, 8, 1");
+	ASSERT_TRUE(light_cluster_has_lights(&clusters, 15, 8, 2, nullptr, 0, nullptr, 0), "Light cluster 15, 8, 2");
+
+	printf("Light clusters check passed, %lld indices.\n", clusters.light_indices_count);
+	memory_buffer_free(&check_memory);
+}
+
+void run_light_clusters_benchmark()
+{
+	constexpr const s64 bench_sizes[] = { 1000, 5000, 10000 };
+	constexpr const s64 bench_iterations = 20;
+	constexpr const s64 bench_indices_capacity = 1 << 22;
+	constexpr const f32 bench_far_plane = 500.0f;
+
+	for (s64 lights_count : bench_sizes)
+	{
+		MemoryBuffer bench_memory = {};
+		s64 bench_memory_size = light_clusters_memory_size(lights_count, bench_indices_capacity) + sizeof(LightSphere) * lights_count;
+		memory_buffer_mallocate(&bench_memory, bench_memory_size, const_cast<char*>("Light clusters benchmark"));
+
+		LightClusters clusters = light_clusters_init(&bench_memory, lights_count, bench_indices_capacity);
+		light_clusters_set_projection(&clusters, glm::radians(60.0f), 16.0f / 9.0f, 0.1f, bench_far_plane);
+
+		LightSphere* lights = (LightSphere*)memory_buffer_suballocate(&bench_memory, sizeof(LightSphere) * lights_count).memory;
+
+		srand(1234);
+
+		for (s64 i = 0; i < lights_count; i++)
+		{
+			glm::vec3 random = glm::vec3(rand(), rand(), rand()) / (f32)RAND_MAX;
+			f32 depth = 1.0f + random.z * bench_far_plane * 0.5f;
+			lights[i].view_position = glm::vec3((random.x * 2.0f - 1.0f) * depth, (random.y * 2.0f - 1.0f) * depth * 0.6f, -depth);
+			lights[i].radius = 1.0f + (f32)rand() / (f32)RAND_MAX * 9.0f;
+		}
+
+		// Half pointlights, half spotlights
+		s64 pointlights_count = lights_count / 2;
+		f64 start_time = glfwGetTime();
+
+		for (s64 i = 0; i < bench_iterations; i++)
+		{
+			light_clusters_bin(&clusters, lights, pointlights_count, &lights[pointlights_count], lights_count - pointlights_count);
+		}
+
+		f64 bin_ms = (glfwGetTime() - start_time) * 1000.0 / bench_iterations;
+
+		printf("Light clusters %lld lights: %.3f ms, %lld indices (%.2f per cluster).\n",
+			lights_count, bin_ms, clusters.light_indices_count, (f64)clusters.light_indices_count / LIGHT_CLUSTERS_COUNT);
+
+		memory_buffer_free(&bench_memory);
+	}
+}
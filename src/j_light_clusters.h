@@ -0,0 +1,59 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include "types.h"
+#include "j_buffers.h"
+
+// Light influence volume in view space, the camera looks down -z
+typedef struct LightSphere {
+	glm::vec3 view_position;
+	f32 radius;
+} LightSphere;
+
+// Clusters touched by one light, empty when min_x > max_x
+typedef struct LightClusterRange {
+	s32 min_x;
+	s32 max_x;
+	s32 min_y;
+	s32 max_y;
+	s32 min_z;
+	s32 max_z;
+} LightClusterRange;
+
+// Froxel grid of LIGHT_CLUSTERS_X * LIGHT_CLUSTERS_Y tiles and LIGHT_CLUSTERS_Z exponential depth slices.
+// No GL calls, the arrays are uploaded by the renderer as they are.
+typedef struct LightClusters {
+	f32 near_plane;
+	f32 far_plane;
+	f32 tan_half_fov_x;
+	f32 tan_half_fov_y;
+	f32 slice_scale;
+	f32 slice_bias;
+	u32* cluster_data; // Two per cluster: first index, pointlights count | spotlights count << 16
+	u32* point_cursors;
+	u32* spot_cursors;
+	u16* light_indices; // Pointlight indices of a cluster followed by its spotlight indices
+	s64 light_indices_count;
+	s64 light_indices_capacity;
+	LightClusterRange* light_ranges;
+	s64 lights_capacity;
+} LightClusters;
+
+s64 light_clusters_memory_size(s64 lights_capacity, s64 light_indices_capacity);
+
+LightClusters light_clusters_init(MemoryBuffer* memory, s64 lights_capacity, s64 light_indices_capacity);
+
+void light_clusters_set_projection(LightClusters* clusters, f32 fov_y_radians, f32 aspect_ratio, f32 near_plane, f32 far_plane);
+
+s64 get_light_cluster_slice(LightClusters* clusters, f32 view_depth);
+
+LightClusterRange get_light_cluster_range(LightClusters* clusters, LightSphere sphere);
+
+f32 get_light_cluster_radius(f32 range, f32 brightness);
+
+void light_clusters_bin(LightClusters* clusters, LightSphere* pointlights, s64 pointlights_count, LightSphere* spotlights, s64 spotlights_count);
+
+void run_light_clusters_check();
+
+void run_light_clusters_benchmark();
@@ -0,0 +1,92 @@
+#include "j_post_process.h"
+
+#include <glad/glad.h>
+
+#include "j_assert.h"
+#include "j_render.h"
+#include "j_render_targets.h"
+#include "globals.h"
+
+// Texels covered by one side of the linear sampled 9-tap Gaussian in blur_fs.glsl
+constexpr const f32 BLUR_KERNEL_REACH_TEXELS = 3.2307692308f;
+
+void draw_fullscreen_pass(RenderTarget* target, u32 source_texture_id)
+{
+	gl_bind_framebuffer(GL_FRAMEBUFFER, target->id);
+	gl_viewport(0, 0, target->desc.width_px, target->desc.height_px);
+
+	gl_active_texture(GL_TEXTURE0);
+	gl_bind_texture(GL_TEXTURE_2D, source_texture_id);
+	glDrawArrays(GL_TRIANGLES, 0, 6);
+	g_frame_data.draw_calls++;
+}
+
+// Downsamples until the blur fits the kernel, then blurs that level with two separable passes.
+// The returned target is acquired from the pool and has to be released after use.
+RenderTarget* blur_texture(RenderTargetPool* pool, u32 source_texture_id, s32 source_width_px, s32 source_height_px, f32 radius_px)
+{
+	gl_disable(GL_DEPTH_TEST);
+	gl_disable(GL_BLEND);
+	gl_bind_vertex_array(g_scene_framebuffer_shader.vao);
+
+	// Each level halves the radius in texels, the last level takes whatever is left as a wider tap step
+	s64 level_index = 0;
+	f32 level_radius_texels = radius_px * 0.5f;
+
+	while (level_index < POST_BLUR_LEVELS_COUNT - 1 && BLUR_KERNEL_REACH_TEXELS < level_radius_texels)
+	{
+		level_index++;
+		level_radius_texels *= 0.5f;
+	}
+
+	gl_use_program(g_downsample_shader.id);
+	s32 texel_size_loc = get_uniform_location(&g_downsample_shader, uniform_id("source_texel_size"));
+
+	RenderTarget* level = nullptr;
+	u32 level_source_id = source_texture_id;
+	s32 level_width_px = source_width_px;
+	s32 level_height_px = source_height_px;
+
+	for (s64 i = 0; i <= level_index; i++)
+	{
+		glUniform2f(texel_size_loc, 1.0f / level_width_px, 1.0f / level_height_px);
+
+		level_width_px = glm::max(level_width_px / 2, 1);
+		level_height_px = glm::max(level_height_px / 2, 1);
+
+		RenderTargetDesc level_desc = {
+			.width_px = level_width_px,
+			.height_px = level_height_px,
+			.color_formats = { GL_RGBA8 }
+		};
+
+		RenderTarget* previous_level = level;
+		level = render_target_acquire(pool, level_desc);
+		draw_fullscreen_pass(level, level_source_id);
+
+		if (previous_level != nullptr) render_target_release(pool, previous_level);
+		level_source_id = level->color_textures[0];
+	}
+
+	RenderTarget* pong = render_target_acquire(pool, level->desc);
+	f32 tap_step = glm::max(level_radius_texels / BLUR_KERNEL_REACH_TEXELS, 0.0f);
+
+	gl_use_program(g_blur_shader.id);
+	s32 direction_loc = get_uniform_location(&g_blur_shader, uniform_id("direction"));
+
+	glUniform2f(direction_loc, tap_step / level_width_px, 0.0f);
+	draw_fullscreen_pass(pong, level->color_textures[0]);
+
+	glUniform2f(direction_loc, 0.0f, tap_step / level_height_px);
+	draw_fullscreen_pass(level, pong->color_textures[0]);
+
+	render_target_release(pool, pong);
+
+	gl_bind_framebuffer(GL_FRAMEBUFFER, 0);
+	gl_viewport(0, 0, g_game_metrics.scene_width_px, g_game_metrics.scene_height_px);
+	gl_enable(GL_BLEND);
+	gl_use_program(0);
+	gl_bind_vertex_array(0);
+
+	return level;
+}
@@ -0,0 +1,6 @@
+#pragma once
+
+#include "types.h"
+#include "structs.h"
+
+RenderTarget* blur_texture(RenderTargetPool* pool, u32 source_texture_id, s32 source_width_px, s32 source_height_px, f32 radius_px);
@@ -0,0 +1,175 @@
+#include "j_profiler.h"
+
+#include <chrono>
+#include <cstdio>
+
+#include "j_assert.h"
+#include "globals.h"
+
+thread_local ProfilerThreadBuffer* t_profiler_thread = nullptr;
+
+s64 profiler_now_ns()
+{
+	auto since_epoch = std::chrono::steady_clock::now().time_since_epoch();
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(since_epoch).count();
+}
+
+// Threads claim their buffer on their first zone, no locks are taken afterwards
+ProfilerThreadBuffer* get_profiler_thread(Profiler* profiler)
+{
+	if (t_profiler_thread != nullptr) return t_profiler_thread;
+
+	s64 thread_index = profiler->threads_count.fetch_add(1);
+	ASSERT_TRUE(thread_index < PROFILER_MAX_THREADS, "Profiler threads not full");
+
+	t_profiler_thread = &profiler->threads[thread_index];
+	t_profiler_thread->thread_index = (s32)thread_index;
+	return t_profiler_thread;
+}
+
+ProfileZone::ProfileZone(const char* zone_name)
+{
+	ProfilerThreadBuffer* thread = get_profiler_thread(&g_profiler);
+	thread->depth++;
+	name = zone_name;
+	begin_ns = profiler_now_ns();
+}
+
+ProfileZone::~ProfileZone()
+{
+	s64 end_ns = profiler_now_ns();
+	ProfilerThreadBuffer* thread = t_profiler_thread;
+	thread->depth--;
+
+	s64 write_count = thread->write_count.load(std::memory_order_relaxed);
+	ProfileEvent* event = &thread->events[write_count % PROFILER_THREAD_EVENTS_COUNT];
+	event->name = name;
+	event->begin_ns = begin_ns;
+	event->end_ns = end_ns;
+	event->depth = thread->depth;
+
+	// Publishes the event to readers on other threads
+	thread->write_count.store(write_count + 1, std::memory_order_release);
+}
+
+void profiler_request_capture(Profiler* profiler, s64 frames_count)
+{
+#ifdef JMF_PROFILER
+	if (profiler->is_capturing) return;
+
+	profiler->capture_frames_left = frames_count;
+	profiler->is_capturing = true;
+	profiler->capture_begin_ns = profiler_now_ns();
+	printf("Capturing trace of %lld frames\n", frames_count);
+#else
+	printf("Profiler zones are compiled out, build with /DJMF_PROFILER to capture traces\n");
+#endif
+}
+
+void profiler_init(Profiler* profiler)
+{
+	profiler->spike_budget_ms = PROFILER_SPIKE_BUDGET_MS;
+	profiler->frame_begin_ns = profiler_now_ns();
+}
+
+// Copies the calling thread's zones of the frame that just ended
+void capture_spike(Profiler* profiler, s64 frame_end_ns)
+{
+	SpikeCapture* spike = &profiler->spikes[profiler->spikes_count % PROFILER_SPIKES_COUNT];
+	profiler->spikes_count++;
+	spike->frame = profiler->frames;
+	spike->frame_ms = profiler->last_frame_ms;
+	spike->events_count = 0;
+
+	ProfilerThreadBuffer* thread = get_profiler_thread(profiler);
+	s64 write_count = thread->write_count.load(std::memory_order_acquire);
+	s64 first_event = write_count < PROFILER_THREAD_EVENTS_COUNT ? 0 : write_count - PROFILER_THREAD_EVENTS_COUNT;
+
+	for (s64 i = first_event; i < write_count && spike->events_count < PROFILER_SPIKE_MAX_EVENTS; i++)
+	{
+		ProfileEvent event = thread->events[i % PROFILER_THREAD_EVENTS_COUNT];
+		if (event.begin_ns < profiler->frame_begin_ns || frame_end_ns <= event.begin_ns) continue;
+
+		// Zones are written when they end, children before their parent. Insertion by begin time
+		// puts parents first so the capture reads as a tree.
+		s64 insert_index = spike->events_count++;
+
+		while (0 < insert_index)
+		{
+			ProfileEvent* prev_event = &spike->events[insert_index - 1];
+			bool is_before = event.begin_ns < prev_event->begin_ns
+				|| (event.begin_ns == prev_event->begin_ns && event.depth < prev_event->depth);
+
+			if (!is_before) break;
+
+			spike->events[insert_index] = spike->events[insert_index - 1];
+			insert_index--;
+		}
+
+		spike->events[insert_index] = event;
+	}
+
+	// Console writes block and would slow down the frames that follow, so a burst is logged once
+	if (profiler->spike_burst_frames++ == 0)
+	{
+		printf("Frame %lld took %.2fms, over the %.2fms budget, %lld zones captured\n",
+			spike->frame, spike->frame_ms, profiler->spike_budget_ms, spike->events_count);
+	}
+}
+
+// Call at the start of every frame. Spikes of the previous frame are captured
+// and a finished trace capture is written out here.
+void profiler_begin_frame(Profiler* profiler)
+{
+	s64 frame_end_ns = profiler_now_ns();
+	profiler->last_frame_ms = (f32)(frame_end_ns - profiler->frame_begin_ns) / 1000000.0f;
+
+	if (0 < profiler->frames && profiler->spike_budget_ms < profiler->last_frame_ms) capture_spike(profiler, frame_end_ns);
+	else profiler->spike_burst_frames = 0;
+
+	profiler->frame_begin_ns = frame_end_ns;
+	profiler->frames++;
+
+	if (!profiler->is_capturing) return;
+	if (0 < profiler->capture_frames_left--) return;
+
+	profiler->is_capturing = false;
+	bool exported = profiler_export_trace(profiler, PROFILER_TRACE_EXPORT_PATH, profiler->capture_begin_ns, profiler_now_ns());
+	printf("Trace %s %s\n", exported ? "written to" : "could not be written to", PROFILER_TRACE_EXPORT_PATH);
+}
+
+// Writes the zones that began in [begin_ns, end_ns) as Chrome trace JSON (chrome://tracing, Perfetto)
+bool profiler_export_trace(Profiler* profiler, const char* path, s64 begin_ns, s64 end_ns)
+{
+	FILE* file;
+	int success = fopen_s(&file, path, "w");
+	if (success != 0) return false;
+
+	fprintf(file, "{\"traceEvents\":[\n");
+	bool is_first = true;
+	s64 threads_count = profiler->threads_count.load();
+
+	for (s64 t = 0; t < threads_count; t++)
+	{
+		ProfilerThreadBuffer* thread = &profiler->threads[t];
+		s64 write_count = thread->write_count.load(std::memory_order_acquire);
+		s64 first_event = write_count < PROFILER_THREAD_EVENTS_COUNT ? 0 : write_count - PROFILER_THREAD_EVENTS_COUNT;
+
+		for (s64 i = first_event; i < write_count; i++)
+		{
+			ProfileEvent* event = &thread->events[i % PROFILER_THREAD_EVENTS_COUNT];
+			if (event->begin_ns < begin_ns || end_ns <= event->begin_ns) continue;
+
+			f64 ts_us = (f64)(event->begin_ns - begin_ns) / 1000.0;
+			f64 duration_us = (f64)(event->end_ns - event->begin_ns) / 1000.0;
+
+			fprintf(file, "%s{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%lld}",
+				is_first ? "" : ",\n", event->name, ts_us, duration_us, t);
+			is_first = false;
+		}
+	}
+
+	fprintf(file, "\n]}\n");
+	fclose(file);
+	return true;
+}
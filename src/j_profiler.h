@@ -0,0 +1,73 @@
+#pragma once
+
+#include <atomic>
+
+#include "types.h"
+#include "constants.h"
+
+// Zones are compiled in with /DJMF_PROFILER (see build.bat), otherwise PROFILE_ZONE expands to nothing
+#ifdef JMF_PROFILER
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_ZONE(name) ProfileZone PROFILE_CONCAT(profile_zone_, __LINE__)(name)
+#else
+#define PROFILE_ZONE(name)
+#endif
+
+typedef struct ProfileEvent {
+	const char* name;
+	s64 begin_ns;
+	s64 end_ns;
+	s32 depth;
+} ProfileEvent;
+
+// Written only by the owning thread. Readers see events up to write_count, older than
+// write_count - PROFILER_THREAD_EVENTS_COUNT have been overwritten.
+typedef struct ProfilerThreadBuffer {
+	ProfileEvent events[PROFILER_THREAD_EVENTS_COUNT];
+	std::atomic<s64> write_count;
+	s32 depth;
+	s32 thread_index;
+} ProfilerThreadBuffer;
+
+// Zones of one frame that went over the spike budget, ordered by begin time
+typedef struct SpikeCapture {
+	ProfileEvent events[PROFILER_SPIKE_MAX_EVENTS];
+	s64 events_count;
+	s64 frame;
+	f32 frame_ms;
+} SpikeCapture;
+
+typedef struct Profiler {
+	ProfilerThreadBuffer threads[PROFILER_MAX_THREADS];
+	std::atomic<s64> threads_count;
+	s64 capture_begin_ns;
+	s64 capture_frames_left;
+	bool is_capturing;
+	s64 frame_begin_ns;
+	s64 frames;
+	f32 last_frame_ms;
+	f32 spike_budget_ms;
+	s64 spike_burst_frames; // Over budget frames in a row, only the first of a burst is logged
+	SpikeCapture spikes[PROFILER_SPIKES_COUNT];
+	s64 spikes_count; // Total, the newest is at (spikes_count - 1) % PROFILER_SPIKES_COUNT
+} Profiler;
+
+// Times its own scope, use through PROFILE_ZONE
+struct ProfileZone {
+	const char* name;
+	s64 begin_ns;
+
+	ProfileZone(const char* zone_name);
+	~ProfileZone();
+};
+
+s64 profiler_now_ns();
+
+void profiler_init(Profiler* profiler);
+
+void profiler_begin_frame(Profiler* profiler);
+
+void profiler_request_capture(Profiler* profiler, s64 frames_count);
+
+bool profiler_export_trace(Profiler* profiler, const char* path, s64 begin_ns, s64 end_ns);
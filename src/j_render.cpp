@@ -5,10 +5,15 @@
 
 #include "j_assert.h"
 #include "jfiles.h"
+#include "jfont.h"
+#include "j_post_process.h"
+#include "j_render_targets.h"
 #include "globals.h"
 #include "constants.h"
 #include "utils.h"
 #include "editor.h"
+#include "j_render_queue.h"
+#include "j_shadow_atlas.h"
 
 bool check_shader_compile_error(GLuint shader)
 {
@@ -46,7 +51,14 @@ bool check_shader_link_error(GLuint shader)
 	return true; // Returns success
 }
 
-int compile_shader(const char* vertex_shader_path, const char* fragment_shader_path, MemoryBuffer* buffer)
+void compile_shader(SimpleShader* shader, const char* vertex_shader_path, const char* fragment_shader_path, MemoryBuffer* buffer)
+{
+	compile_shader_with_include(shader, vertex_shader_path, nullptr, fragment_shader_path, buffer);
+}
+
+// The include is passed to glShaderSource ahead of the fragment shader, which is
+// compiled as their concatenation. The include holds the #version line then.
+void compile_shader_with_include(SimpleShader* shader, const char* vertex_shader_path, const char* fragment_include_path, const char* fragment_shader_path, MemoryBuffer* buffer)
 {
 	int shader_id;
 	char* vertex_shader_code = nullptr;
@@ -61,10 +73,24 @@ int compile_shader(const char* vertex_shader_path, const char* fragment_shader_p
 	bool vs_compile_success = check_shader_compile_error(vertex_shader);
 	ASSERT_TRUE(vs_compile_success, "Vertex shader compile");
 
-	read_file_to_memory(fragment_shader_path, buffer);
-	auto fragment_code = (char*)buffer->memory;
+	s64 buffer_used = buffer->used_sub_allocation_capacity;
+	const char* fragment_sources[2];
+	s32 fragment_sources_count = 0;
+
+	if (fragment_include_path)
+	{
+		MemoryBuffer include_buffer = memory_buffer_suballocate(buffer, (buffer->size - buffer_used) / 2);
+		read_file_to_memory(fragment_include_path, &include_buffer);
+		fragment_sources[fragment_sources_count++] = (char*)include_buffer.memory;
+	}
+
+	MemoryBuffer fragment_buffer = memory_buffer_suballocate(buffer, buffer->size - buffer->used_sub_allocation_capacity);
+	read_file_to_memory(fragment_shader_path, &fragment_buffer);
+	fragment_sources[fragment_sources_count++] = (char*)fragment_buffer.memory;
+	buffer->used_sub_allocation_capacity = buffer_used;
+
 	int fragment_shader = glCreateShader(GL_FRAGMENT_SHADER);
-	glShaderSource(fragment_shader, 1, &fragment_code, NULL);
+	glShaderSource(fragment_shader, fragment_sources_count, fragment_sources, NULL);
 	glCompileShader(fragment_shader);
 
 	bool fs_compile_success = check_shader_compile_error(fragment_shader);
@@ -81,507 +107,704 @@ int compile_shader(const char* vertex_shader_path, const char* fragment_shader_p
 	glDeleteShader(vertex_shader);
 	glDeleteShader(fragment_shader);
 
-	return shader_id;
+	shader->id = shader_id;
+	reflect_shader_uniforms(shader);
 }
 
-void draw_billboard(glm::vec3 position, Texture texture, float scale)
+void shader_add_uniform(SimpleShader* shader, u32 name_hash, s32 location)
 {
-	glUseProgram(g_billboard_shader.id);
-	glBindVertexArray(g_billboard_shader.vao);
-
-	glm::mat4 model = glm::mat4(1.0f);
-	model = glm::translate(model, position);
-
-	auto billboard_normal = glm::vec3(0, 0, 1.0f);
-	auto billboard_dir = glm::normalize(g_scene_camera.position - position);
-
-	glm::vec3 right = glm::cross(glm::vec3(0, 1.0f, 0), billboard_dir);
-	glm::vec3 up = glm::cross(billboard_dir, right);
+	// Keep the table at most half full so probes stay short
+	ASSERT_TRUE(shader->uniforms_count < SHADER_UNIFORMS_CAPACITY / 2, "Shader uniform table has capacity left");
+	u64 index = name_hash & (SHADER_UNIFORMS_CAPACITY - 1);
 
-	glm::mat4 rotation_matrix(1.0f);
-	rotation_matrix[0] = glm::vec4(right, 0.0f);
-	rotation_matrix[1] = glm::vec4(up, 0.0f);
-	rotation_matrix[2] = glm::vec4(billboard_dir, 0.0f);
-
-	model = model * rotation_matrix;
-	model = glm::scale(model, glm::vec3(scale));
-
-	unsigned int model_loc = glGetUniformLocation(g_billboard_shader.id, "model");
-	glUniformMatrix4fv(model_loc, 1, GL_FALSE, glm::value_ptr(model));
+	for (;;)
+	{
+		ShaderUniform* slot = &shader->uniforms[index];
+		ASSERT_TRUE(slot->name_hash != name_hash, "Shader uniform name hash is unique");
 
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, texture.gpu_id);
-	glDrawArrays(GL_TRIANGLES, 0, 6);
-	g_frame_data.draw_calls++;
+		if (slot->name_hash == 0)
+		{
+			slot->name_hash = name_hash;
+			slot->location = location;
+			shader->uniforms_count++;
+			return;
+		}
 
-	glUseProgram(0);
-	glBindVertexArray(0);
+		index = (index + 1) & (SHADER_UNIFORMS_CAPACITY - 1);
+	}
 }
 
-void draw_mesh_shadow_map(Mesh* mesh, Spotlight* spotlight)
+void reflect_shader_uniforms(SimpleShader* shader)
 {
-	glm::mat4 model = get_model_matrix(mesh);
-	unsigned int model_loc = glGetUniformLocation(g_shdow_map_shader.id, "model");
+	constexpr int name_length = 128;
+	char name[name_length];
 
-	s64 draw_indicies = 0;
+	memset(shader->uniforms, 0x00, sizeof(shader->uniforms));
+	memset(shader->uniform_blocks, 0x00, sizeof(shader->uniform_blocks));
+	shader->uniforms_count = 0;
+	shader->uniform_blocks_count = 0;
 
-	if (mesh->mesh_type == MeshType::Plane)
+	// Uniforms
 	{
-		float vertices[] =
+		GLint active_uniforms = 0;
+		glGetProgramiv(shader->id, GL_ACTIVE_UNIFORMS, &active_uniforms);
+
+		for (int i = 0; i < active_uniforms; i++)
 		{
-			// Coords		
-			1.0f, 0.0f, 0.0f, // top right
-			0.0f, 0.0f, 0.0f, // top left
-			0.0f, 0.0f, 1.0f, // bot left
-
-			1.0f, 0.0f, 0.0f, // top right
-			0.0f, 0.0f, 1.0f, // bot left 
-			1.0f, 0.0f, 1.0f, // bot right
-		};
+			GLint array_size;
+			GLenum type;
+			glGetActiveUniform(shader->id, i, name_length, NULL, &array_size, &type, name);
 
-		glm::mat4 rotation = get_rotation_matrix(mesh->transforms.rotation);
-		glm::vec3 plane_normal = glm::vec3(rotation * glm::vec4(0, 1.0f, 0, 0));
+			// Uniforms inside blocks have no location
+			s32 location = glGetUniformLocation(shader->id, name);
+			if (location == -1) continue;
 
-		glm::mat4 sp_rotation = get_rotation_matrix(spotlight->transforms.rotation);
-		glm::vec3 spotlight_view_dir = glm::normalize(glm::vec3(sp_rotation * glm::vec4(0, -1.0f, 0, 0)));
+			// Arrays of basic types are reported once as "name[0]"
+			s64 str_len = strlen(name);
+			bool is_array = 3 < str_len && strcmp(&name[str_len - 3], "[0]") == 0;
 
-		float dot_result = glm::dot(glm::normalize(spotlight_view_dir), -plane_normal);
-		float dot_result_mult = dot_result;
-		float shadow_bias = 0.025f + (0.05f * dot_result_mult);
+			if (is_array)
+			{
+				name[str_len - 3] = '\0';
+				char element_name[name_length + 16];
 
-		glm::vec3 plane_view_dir = glm::normalize(glm::vec3(mesh->transforms.translation - spotlight->transforms.translation));
-		model = glm::translate(model, plane_view_dir * shadow_bias);
+				for (int element = 0; element < array_size; element++)
+				{
+					sprintf_s(element_name, "%s[%d]", name, element);
+					shader_add_uniform(shader, str_hash(element_name), location + element);
+				}
+			}
 
-		draw_indicies = 6;
-		glBindBuffer(GL_ARRAY_BUFFER, g_shdow_map_shader.vbo);
-		glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_DYNAMIC_DRAW);
+			shader_add_uniform(shader, str_hash(name), location);
+		}
 	}
-	else if (mesh->mesh_type == MeshType::Cube)
+
+	// Uniform blocks
 	{
-		float vertices[] =
-		{
-			// Coords		
-			// Ceiling
-			0.5f,  0.5f, -0.5f,// top right
-		   -0.5f,  0.5f, -0.5f,// top left
-		   -0.5f,  0.5f,  0.5f,// bot left
-
-			0.5f,  0.5f, -0.5f,// top right
-		   -0.5f,  0.5f,  0.5f,// bot left 
-			0.5f,  0.5f,  0.5f,// bot right
-
-			// Floor
-		   -0.5f, -0.5f,  0.5f,// bot left 
-			0.5f, -0.5f, -0.5f,// top right
-			0.5f, -0.5f,  0.5f,// bot right
-
-		   -0.5f, -0.5f,  0.5f,// bot left
-		   -0.5f, -0.5f, -0.5f,// top left
-			0.5f, -0.5f, -0.5f,// top right
-
-			// North
-		   -0.5f, -0.5f, -0.5f, // bot left 
-			0.5f,  0.5f, -0.5f, // top right
-			0.5f, -0.5f, -0.5f, // bot right
-
-		   -0.5f, -0.5f, -0.5f, // bot left
-		   -0.5f,  0.5f, -0.5f, // top left
-			0.5f,  0.5f, -0.5f, // top right
-
-			// South
-			0.5f,  0.5f,  0.5f, // top right
-		   -0.5f, -0.5f,  0.5f, // bot left 
-			0.5f, -0.5f,  0.5f, // bot right
-
-		   -0.5f,  0.5f,  0.5f, // top left
-		   -0.5f, -0.5f,  0.5f, // bot left
-			0.5f,  0.5f,  0.5f, // top right
-
-			// West
-		   -0.5f, -0.5f,  0.5f, // bot left 
-		   -0.5f,  0.5f, -0.5f, // top right
-		   -0.5f, -0.5f, -0.5f, // bot right
-
-		   -0.5f, -0.5f,  0.5f, // bot left
-		   -0.5f,  0.5f,  0.5f, // top left
-		   -0.5f,  0.5f, -0.5f, // top right
-
-		   // East
-		   0.5f,  0.5f, -0.5f, // top right
-		   0.5f, -0.5f,  0.5f, // bot left 
-		   0.5f, -0.5f, -0.5f, // bot right
-
-		   0.5f,  0.5f,  0.5f, // top left
-		   0.5f, -0.5f,  0.5f, // bot left
-		   0.5f,  0.5f, -0.5f, // top right
-		};
+		GLint active_blocks = 0;
+		glGetProgramiv(shader->id, GL_ACTIVE_UNIFORM_BLOCKS, &active_blocks);
+		ASSERT_TRUE(active_blocks <= SHADER_UNIFORM_BLOCKS_CAPACITY, "Shader uniform block table has capacity");
 
-		draw_indicies = 36;
-		glBindBuffer(GL_ARRAY_BUFFER, g_shdow_map_shader.vbo);
-		glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_DYNAMIC_DRAW);
+		for (int i = 0; i < active_blocks; i++)
+		{
+			glGetActiveUniformBlockName(shader->id, i, name_length, NULL, name);
+			ShaderUniform block = {
+				.name_hash = str_hash(name),
+				.location = i,
+			};
+			shader->uniform_blocks[shader->uniform_blocks_count++] = block;
+		}
 	}
-
-	glUniformMatrix4fv(model_loc, 1, GL_FALSE, glm::value_ptr(model));
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, 0);
-	glDrawArrays(GL_TRIANGLES, 0, draw_indicies);
-	g_frame_data.draw_calls++;
 }
 
-void draw_mesh(Mesh* mesh)
+s32 get_uniform_location(SimpleShader* shader, u32 name_hash)
 {
-	glUseProgram(g_mesh_shader.id);
-	glBindVertexArray(g_mesh_shader.vao);
+	u64 index = name_hash & (SHADER_UNIFORMS_CAPACITY - 1);
 
-	glm::mat4 model = get_model_matrix(mesh);
+	for (;;)
+	{
+		ShaderUniform* slot = &shader->uniforms[index];
+		if (slot->name_hash == name_hash) return slot->location;
+		if (slot->name_hash == 0) return -1; // Not active, glUniform*() ignores -1
+		index = (index + 1) & (SHADER_UNIFORMS_CAPACITY - 1);
+	}
+}
 
-	unsigned int model_loc = glGetUniformLocation(g_mesh_shader.id, "model");
-	unsigned int camera_view_loc = glGetUniformLocation(g_mesh_shader.id, "view_coords");
+u32 get_uniform_block_index(SimpleShader* shader, u32 name_hash)
+{
+	for (int i = 0; i < shader->uniform_blocks_count; i++)
+	{
+		if (shader->uniform_blocks[i].name_hash == name_hash) return shader->uniform_blocks[i].location;
+	}
 
-	unsigned int ambient_loc = glGetUniformLocation(g_mesh_shader.id, "global_ambient_light");
-	unsigned int use_texture_loc = glGetUniformLocation(g_mesh_shader.id, "use_texture");
-	unsigned int use_gloss_texture_loc = glGetUniformLocation(g_mesh_shader.id, "use_specular_texture");
-	unsigned int uv_loc = glGetUniformLocation(g_mesh_shader.id, "uv_multiplier");
+	ASSERT_TRUE(false, "Shader has the uniform block");
+	return GL_INVALID_INDEX;
+}
 
-	unsigned int color_texture_loc = glGetUniformLocation(g_mesh_shader.id, "material.color_texture");
-	unsigned int specular_texture_loc = glGetUniformLocation(g_mesh_shader.id, "material.specular_texture");
-	unsigned int specular_multiplier_loc = glGetUniformLocation(g_mesh_shader.id, "material.specular_mult");
-	unsigned int material_shine_loc = glGetUniformLocation(g_mesh_shader.id, "material.shininess");
+void billboard_batch_add(BillboardBatch* batch, glm::vec3 position, BillboardLayer layer, f32 scale)
+{
+	BillboardInstance instance = {
+		.position = position,
+		.scale = scale,
+		.texture_layer = (f32)layer,
+	};
+	j_array_add(&batch->instances, (byte*)&instance);
+}
 
-	glUniformMatrix4fv(model_loc, 1, GL_FALSE, glm::value_ptr(model));
+int compare_billboards_back_to_front(const void* a, const void* b)
+{
+	f32 a_distance = glm::length(g_scene_camera.position - ((BillboardInstance*)a)->position);
+	f32 b_distance = glm::length(g_scene_camera.position - ((BillboardInstance*)b)->position);
+	return (a_distance < b_distance) - (b_distance < a_distance);
+}
 
-	glUniform1f(uv_loc, mesh->uv_multiplier);
-	glUniform1i(color_texture_loc, 0);
-	glUniform1i(use_texture_loc, true);
+void submit_billboard_batch(RenderQueue* queue, BillboardBatch* batch)
+{
+	s64 instances_count = batch->instances.items_count;
+	if (instances_count == 0) return;
+
+	// Alpha blended, so sorted on the CPU instead of by the render queue
+	qsort(batch->instances.data, instances_count, sizeof(BillboardInstance), compare_billboards_back_to_front);
+
+	s64 upload_size = instances_count * sizeof(BillboardInstance);
+	gl_bind_buffer(GL_ARRAY_BUFFER, batch->vbo);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(BillboardInstance) * BILLBOARDS_MAX_COUNT, NULL, GL_STREAM_DRAW);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, upload_size, batch->instances.data);
+	gl_bind_buffer(GL_ARRAY_BUFFER, 0);
+	g_frame_data.bytes_uploaded += upload_size;
+
+	DrawPacket packet = {
+		.type = DrawPacketType::Billboard,
+		.shader = &g_billboard_shader,
+		.material = nullptr,
+		.texture_ids = { batch->texture_array_id, 0 },
+		.is_texture_array = true,
+		.first_instance = 0,
+		.instances_count = instances_count,
+	};
 
-	glUniform3f(ambient_loc, g_user_settings.world_ambient[0], g_user_settings.world_ambient[1], g_user_settings.world_ambient[2]);
-	glUniform3f(camera_view_loc, g_scene_camera.position.x, g_scene_camera.position.y, g_scene_camera.position.z);
+	u64 sort_key = render_sort_key(RenderPass::Transparent, g_billboard_shader.id, -1, batch->texture_array_id, 0.0f);
+	render_queue_submit(queue, sort_key, &packet);
+	j_array_empty(&batch->instances);
+}
 
-	// Lights
+void init_primitive_geometry()
+{
+	// Plane is anchored to its corner, cube is centered to origin
+	float vertices[] =
 	{
-		char str_value[64] = { 0 };
+		// Coords				 // UV			 // Plane normal
+		// Plane
+		 1.0f,  0.0f,  0.0f,	 1.0f,  1.0f,	 0.0f,  1.0f,  0.0f, // right top
+		 0.0f,  0.0f,  0.0f,	 0.0f,  1.0f,	 0.0f,  1.0f,  0.0f, // left  top
+		 0.0f,  0.0f,  1.0f,	 0.0f,  0.0f,	 0.0f,  1.0f,  0.0f, // left  bot
+		 1.0f,  0.0f,  1.0f,	 1.0f,  0.0f,	 0.0f,  1.0f,  0.0f, // right bot
+
+		// Cube ceiling
+		 0.5f,  0.5f, -0.5f,	 1.0f,  1.0f,	 0.0f,  1.0f,  0.0f, // top right
+		-0.5f,  0.5f, -0.5f,	 0.0f,  1.0f,	 0.0f,  1.0f,  0.0f, // top left
+		-0.5f,  0.5f,  0.5f,	 0.0f,  0.0f,	 0.0f,  1.0f,  0.0f, // bot left
+		 0.5f,  0.5f,  0.5f,	 1.0f,  0.0f,	 0.0f,  1.0f,  0.0f, // bot right
+
+		// Cube floor
+		-0.5f, -0.5f,  0.5f,	 0.0f,  0.0f,	 0.0f, -1.0f,  0.0f, // bot left
+		 0.5f, -0.5f, -0.5f,	 1.0f,  1.0f,	 0.0f, -1.0f,  0.0f, // top right
+		 0.5f, -0.5f,  0.5f,	 1.0f,  0.0f,	 0.0f, -1.0f,  0.0f, // bot right
+		-0.5f, -0.5f, -0.5f,	 0.0f,  1.0f,	 0.0f, -1.0f,  0.0f, // top left
+
+		// Cube north
+		-0.5f, -0.5f, -0.5f,	 0.0f,  0.0f,	 0.0f,  0.0f, -1.0f, // bot left
+		 0.5f,  0.5f, -0.5f,	 1.0f,  1.0f,	 0.0f,  0.0f, -1.0f, // top right
+		 0.5f, -0.5f, -0.5f,	 1.0f,  0.0f,	 0.0f,  0.0f, -1.0f, // bot right
+		-0.5f,  0.5f, -0.5f,	 0.0f,  1.0f,	 0.0f,  0.0f, -1.0f, // top left
+
+		// Cube south
+		 0.5f,  0.5f,  0.5f,	 1.0f,  1.0f,	 0.0f,  0.0f,  1.0f, // top right
+		-0.5f, -0.5f,  0.5f,	 0.0f,  0.0f,	 0.0f,  0.0f,  1.0f, // bot left
+		 0.5f, -0.5f,  0.5f,	 1.0f,  0.0f,	 0.0f,  0.0f,  1.0f, // bot right
+		-0.5f,  0.5f,  0.5f,	 0.0f,  1.0f,	 0.0f,  0.0f,  1.0f, // top left
+
+		// Cube west
+		-0.5f, -0.5f,  0.5f,	 0.0f,  0.0f,	-1.0f,  0.0f,  0.0f, // bot left
+		-0.5f,  0.5f, -0.5f,	 1.0f,  1.0f,	-1.0f,  0.0f,  0.0f, // top right
+		-0.5f, -0.5f, -0.5f,	 1.0f,  0.0f,	-1.0f,  0.0f,  0.0f, // bot right
+		-0.5f,  0.5f,  0.5f,	 0.0f,  1.0f,	-1.0f,  0.0f,  0.0f, // top left
+
+		// Cube east
+		 0.5f,  0.5f, -0.5f,	 1.0f,  1.0f,	 1.0f,  0.0f,  0.0f, // top right
+		 0.5f, -0.5f,  0.5f,	 0.0f,  0.0f,	 1.0f,  0.0f,  0.0f, // bot left
+		 0.5f, -0.5f, -0.5f,	 1.0f,  0.0f,	 1.0f,  0.0f,  0.0f, // bot right
+		 0.5f,  0.5f,  0.5f,	 0.0f,  1.0f,	 1.0f,  0.0f,  0.0f, // top left
+	};
 
-		// Pointlights
-		unsigned int pointlights_count_loc = glGetUniformLocation(g_mesh_shader.id, "pointlights_count");
-		glUniform1i(pointlights_count_loc, g_scene.pointlights.items_count);
+	// Indicies are relative to the primitive's base vertex
+	u16 indicies[] =
+	{
+		// Plane
+		0, 1, 2,	0, 2, 3,
+
+		// Cube
+		0,  1,  2,	 0,  2,  3,  // Ceiling
+		4,  5,  6,	 4,  7,  5,  // Floor
+		8,  9,  10,	 8,  11, 9,  // North
+		12, 13, 14,	 15, 13, 12, // South
+		16, 17, 18,	 16, 19, 17, // West
+		20, 21, 22,	 23, 21, 20, // East
+	};
 
-		for (int i = 0; i < g_scene.pointlights.items_count; i++)
-		{
-			auto pointlight = *(Pointlight*)j_array_get(&g_scene.pointlights, i);
+	PrimitiveRange plane_range = {
+		.base_vertex = 0,
+		.first_index = 0,
+		.index_count = 6,
+	};
 
-			sprintf_s(str_value, "pointlights[%d].is_on", i);
-			unsigned int light_is_on_loc = glGetUniformLocation(g_mesh_shader.id, str_value);
+	PrimitiveRange cube_range = {
+		.base_vertex = 4,
+		.first_index = 6,
+		.index_count = 36,
+	};
 
-			sprintf_s(str_value, "pointlights[%d].position", i);
-			unsigned int light_pos_loc = glGetUniformLocation(g_mesh_shader.id, str_value);
+	g_primitive_geometry.ranges[(s64)MeshType::Plane] = plane_range;
+	g_primitive_geometry.ranges[(s64)MeshType::Cube] = cube_range;
 
-			sprintf_s(str_value, "pointlights[%d].diffuse", i);
-			unsigned int light_diff_loc = glGetUniformLocation(g_mesh_shader.id, str_value);
+	glGenBuffers(1, &g_primitive_geometry.vbo);
+	gl_bind_buffer(GL_ARRAY_BUFFER, g_primitive_geometry.vbo);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+	gl_bind_buffer(GL_ARRAY_BUFFER, 0);
 
-			sprintf_s(str_value, "pointlights[%d].specular", i);
-			unsigned int light_spec_loc = glGetUniformLocation(g_mesh_shader.id, str_value);
+	glGenBuffers(1, &g_primitive_geometry.ibo);
+	gl_bind_buffer(GL_ELEMENT_ARRAY_BUFFER, g_primitive_geometry.ibo);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indicies), indicies, GL_STATIC_DRAW);
+	gl_bind_buffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 
-			sprintf_s(str_value, "pointlights[%d].intensity", i);
-			unsigned int light_intens_loc = glGetUniformLocation(g_mesh_shader.id, str_value);
+	g_frame_data.bytes_uploaded += sizeof(vertices) + sizeof(indicies);
+}
 
-			sprintf_s(str_value, "pointlights[%d].range", i);
-			unsigned int light_range_loc = glGetUniformLocation(g_mesh_shader.id, str_value);
+void bind_primitive_geometry()
+{
+	// Expects the target VAO to be bound, the element buffer binding is stored into it
+	gl_bind_buffer(GL_ARRAY_BUFFER, g_primitive_geometry.vbo);
+	gl_bind_buffer(GL_ELEMENT_ARRAY_BUFFER, g_primitive_geometry.ibo);
+}
 
-			glUniform1i(light_is_on_loc, pointlight.is_on);
-			glUniform3f(light_pos_loc, pointlight.transforms.translation.x, pointlight.transforms.translation.y, pointlight.transforms.translation.z);
-			glUniform3f(light_diff_loc, pointlight.diffuse.x, pointlight.diffuse.y, pointlight.diffuse.z);
-			glUniform1f(light_spec_loc, pointlight.specular);
-			glUniform1f(light_intens_loc, pointlight.intensity);
-			glUniform1f(light_range_loc, pointlight.range);
-		}
+void draw_primitive(MeshType mesh_type)
+{
+	PrimitiveRange range = g_primitive_geometry.ranges[(s64)mesh_type];
+	void* indicies_offset = (void*)(range.first_index * sizeof(u16));
+	glDrawElementsBaseVertex(GL_TRIANGLES, range.index_count, GL_UNSIGNED_SHORT, indicies_offset, range.base_vertex);
+	g_frame_data.draw_calls++;
+}
+
+void draw_primitive_instanced(MeshType mesh_type, s64 instances_count)
+{
+	PrimitiveRange range = g_primitive_geometry.ranges[(s64)mesh_type];
+	void* indicies_offset = (void*)(range.first_index * sizeof(u16));
+	glDrawElementsInstancedBaseVertex(GL_TRIANGLES, range.index_count, GL_UNSIGNED_SHORT, indicies_offset, instances_count, range.base_vertex);
+	g_frame_data.draw_calls++;
+}
 
-		// Spotlights
-		unsigned int spotlights_count_loc = glGetUniformLocation(g_mesh_shader.id, "spotlights_count");
-		glUniform1i(spotlights_count_loc, g_scene.spotlights.items_count);
+void init_mesh_instances()
+{
+	glGenBuffers(1, &g_mesh_instances.vbo);
+	gl_bind_buffer(GL_ARRAY_BUFFER, g_mesh_instances.vbo);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(MeshInstance) * MESH_INSTANCES_MAX_COUNT, NULL, GL_STREAM_DRAW);
+
+	glGenBuffers(1, &g_shadow_casters.vbo);
+	gl_bind_buffer(GL_ARRAY_BUFFER, g_shadow_casters.vbo);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(MeshInstance) * MESH_INSTANCES_MAX_COUNT, NULL, GL_STREAM_DRAW);
+	gl_bind_buffer(GL_ARRAY_BUFFER, 0);
+}
 
-		int shadow_map_tex_id = GL_TEXTURE2;
-		int shadow_loc_i = 2;
+void bind_mesh_instance_attributes(u32 instances_vbo, s64 first_instance)
+{
+	// Expects the target VAO to be bound. There is no base instance in GL 3.3,
+	// so each batch points the attributes to its first instance instead.
+	gl_bind_buffer(GL_ARRAY_BUFFER, instances_vbo);
+	s64 stride = sizeof(MeshInstance);
+	s64 offset = first_instance * stride;
+
+	// Model matrix
+	for (int i = 0; i < 4; i++)
+	{
+		s64 column_offset = offset + offsetof(MeshInstance, model) + i * sizeof(glm::vec4);
+		glVertexAttribPointer(3 + i, 4, GL_FLOAT, GL_FALSE, stride, (void*)column_offset);
+		glVertexAttribDivisor(3 + i, 1);
+		glEnableVertexAttribArray(3 + i);
+	}
 
-		for (int i = 0; i < g_scene.spotlights.items_count; i++)
-		{
-			auto spotlight = *(Spotlight*)j_array_get(&g_scene.spotlights, i);
+	// Normal matrix
+	for (int i = 0; i < 3; i++)
+	{
+		s64 column_offset = offset + offsetof(MeshInstance, normal_matrix) + i * sizeof(glm::vec3);
+		glVertexAttribPointer(7 + i, 3, GL_FLOAT, GL_FALSE, stride, (void*)column_offset);
+		glVertexAttribDivisor(7 + i, 1);
+		glEnableVertexAttribArray(7 + i);
+	}
 
-			glm::vec3 spot_dir = get_spotlight_dir(spotlight);
-			glm::mat4 light_space_matrix = get_spotlight_light_space_matrix(spotlight);
+	// UV multiplier
+	glVertexAttribPointer(10, 1, GL_FLOAT, GL_FALSE, stride, (void*)(offset + offsetof(MeshInstance, uv_multiplier)));
+	glVertexAttribDivisor(10, 1);
+	glEnableVertexAttribArray(10);
 
-			sprintf_s(str_value, "spotlights[%d].is_on", i);
-			unsigned int sp_is_on_loc = glGetUniformLocation(g_mesh_shader.id, str_value);
+	gl_bind_buffer(GL_ARRAY_BUFFER, 0);
+}
 
-			sprintf_s(str_value, "spotlights[%d].diffuse", i);
-			unsigned int sp_diff_loc = glGetUniformLocation(g_mesh_shader.id, str_value);
+s64 get_mesh_batch_key(Mesh* mesh, bool is_visible)
+{
+	// Mesh type is the major key, so all instances of a type end up next to each other.
+	// Culled instances are still needed by the shadow pass, they sort after the visible ones.
+	s64 material_index = mesh->material - (Material*)g_materials.data;
+	ASSERT_TRUE(0 <= material_index && material_index < SCENE_TEXTURES_MAX_COUNT, "Mesh material is in g_materials");
+
+	s64 key = (s64)mesh->mesh_type * 2 * SCENE_TEXTURES_MAX_COUNT + material_index;
+	if (!is_visible) key += SCENE_TEXTURES_MAX_COUNT;
+	return key;
+}
 
-			sprintf_s(str_value, "spotlights[%d].position", i);
-			unsigned int sp_pos_loc = glGetUniformLocation(g_mesh_shader.id, str_value);
+void build_mesh_instances()
+{
+	PROFILE_ZONE("Build mesh instances");
+	JArray* scene_meshes[] = { &g_scene.planes, &g_scene.meshes };
+	bool* scene_meshes_visibility[] = {
+		&g_scene_visibility.is_visible[g_scene_visibility.planes_offset],
+		&g_scene_visibility.is_visible[g_scene_visibility.meshes_offset],
+	};
+	s64 batch_offsets[MESH_BATCHES_MAX_COUNT] = { 0 };
 
-			sprintf_s(str_value, "spotlights[%d].specular", i);
-			unsigned int sp_spec_loc = glGetUniformLocation(g_mesh_shader.id, str_value);
+	// Counting sort by batch key
+	for (int array_i = 0; array_i < 2; array_i++)
+	{
+		JArray* meshes = scene_meshes[array_i];
 
-			sprintf_s(str_value, "spotlights[%d].range", i);
-			unsigned int sp_rng_loc = glGetUniformLocation(g_mesh_shader.id, str_value);
+		for (int i = 0; i < meshes->items_count; i++)
+		{
+			Mesh* mesh = (Mesh*)j_array_get(meshes, i);
+			batch_offsets[get_mesh_batch_key(mesh, scene_meshes_visibility[array_i][i])]++;
+		}
+	}
 
-			sprintf_s(str_value, "spotlights[%d].direction", i);
-			unsigned int sp_dir_loc = glGetUniformLocation(g_mesh_shader.id, str_value);
+	j_array_empty(&g_mesh_instances.batches);
+	s64 instances_count = 0;
 
-			sprintf_s(str_value, "spotlights[%d].cutoff", i);
-			unsigned int sp_cutoff_loc = glGetUniformLocation(g_mesh_shader.id, str_value);
+	for (int i = 0; i < PRIMITIVE_MESH_TYPES_COUNT; i++)
+	{
+		g_mesh_instances.type_first_instance[i] = 0;
+		g_mesh_instances.type_instances_count[i] = 0;
+	}
 
-			sprintf_s(str_value, "spotlights[%d].outer_cutoff", i);
-			unsigned int sp_outer_cutoff_loc = glGetUniformLocation(g_mesh_shader.id, str_value);
+	for (s64 key = 0; key < MESH_BATCHES_MAX_COUNT; key++)
+	{
+		s64 batch_count = batch_offsets[key];
+		batch_offsets[key] = instances_count;
+		if (batch_count == 0) continue;
+
+		MeshBatch batch = {
+			.mesh_type = (MeshType)(key / (2 * SCENE_TEXTURES_MAX_COUNT)),
+			.material = (Material*)g_materials.data + key % SCENE_TEXTURES_MAX_COUNT,
+			.is_visible = key % (2 * SCENE_TEXTURES_MAX_COUNT) < SCENE_TEXTURES_MAX_COUNT,
+			.first_instance = instances_count,
+			.instances_count = batch_count,
+		};
+		j_array_add(&g_mesh_instances.batches, (byte*)&batch);
 
-			sprintf_s(str_value, "spotlights[%d].light_space_matrix", i);
-			unsigned int sp_light_matrix = glGetUniformLocation(g_mesh_shader.id, str_value);
+		s64 type_index = (s64)batch.mesh_type;
+		if (g_mesh_instances.type_instances_count[type_index] == 0) g_mesh_instances.type_first_instance[type_index] = instances_count;
+		g_mesh_instances.type_instances_count[type_index] += batch_count;
 
-			sprintf_s(str_value, "spotlights[%d].shadow_map", i);
-			unsigned int sp_shadow_map = glGetUniformLocation(g_mesh_shader.id, str_value);
+		instances_count += batch_count;
+	}
 
-			float cutoff = glm::cos(glm::radians(spotlight.fov / 2.0f));
-			float cos = glm::cos(glm::radians(spotlight.outer_cutoff_fov / 2.0f));
-			float outer_cutoff = cutoff - (cutoff - cos);
+	MeshInstance* instances = (MeshInstance*)g_mesh_instances.instances.data;
+	s32* scene_instance_slots = g_mesh_instances.scene_instance_slots;
+	s64 scene_index = 0;
 
-			glUniform1i(sp_is_on_loc, spotlight.is_on);
-			glUniform3f(sp_diff_loc, spotlight.diffuse.x, spotlight.diffuse.y, spotlight.diffuse.z);
-			glUniform3f(sp_pos_loc, spotlight.transforms.translation.x, spotlight.transforms.translation.y, spotlight.transforms.translation.z);
-			glUniform3f(sp_dir_loc, spot_dir.x, spot_dir.y, spot_dir.z);
-			glUniform1f(sp_spec_loc, spotlight.specular);
-			glUniform1f(sp_rng_loc, spotlight.range);
-			glUniform1f(sp_cutoff_loc, cutoff);
-			glUniform1f(sp_outer_cutoff_loc, outer_cutoff);
-			glUniformMatrix4fv(sp_light_matrix, 1, GL_FALSE, glm::value_ptr(light_space_matrix));
-			glUniform1i(sp_shadow_map, shadow_loc_i++);
+	for (int array_i = 0; array_i < 2; array_i++)
+	{
+		JArray* meshes = scene_meshes[array_i];
 
-			glActiveTexture(shadow_map_tex_id++);
-			glBindTexture(GL_TEXTURE_2D, spotlight.shadow_map.texture_gpu_id);
+		for (int i = 0; i < meshes->items_count; i++)
+		{
+			Mesh* mesh = (Mesh*)j_array_get(meshes, i);
+			s64 key = get_mesh_batch_key(mesh, scene_meshes_visibility[array_i][i]);
+			s64 slot = batch_offsets[key]++;
+			instances[slot] = mesh_instance_init(mesh);
+			scene_instance_slots[scene_index++] = (s32)slot;
 		}
 	}
 
-	Material* material = mesh->material;
-	glUniform1f(material_shine_loc, material->shininess);
-	glUniform1f(specular_multiplier_loc, material->specular_mult);
+	g_mesh_instances.instances.items_count = instances_count;
+
+	// Orphan the previous frame's storage before writing
+	s64 upload_size = instances_count * sizeof(MeshInstance);
+	gl_bind_buffer(GL_ARRAY_BUFFER, g_mesh_instances.vbo);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(MeshInstance) * MESH_INSTANCES_MAX_COUNT, NULL, GL_STREAM_DRAW);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, upload_size, instances);
+	gl_bind_buffer(GL_ARRAY_BUFFER, 0);
+	g_frame_data.bytes_uploaded += upload_size;
+}
+
+s64 build_shadow_casters(Spotlight* spotlight)
+{
+	ShadowCasters* casters = &g_shadow_casters;
+	s64 casters_count = cull_spotlight_shadow_casters(spotlight, casters->caster_indices);
 
-	s64 draw_indicies = 0;
+	MeshInstance* scene_instances = (MeshInstance*)g_mesh_instances.instances.data;
+	MeshInstance* caster_instances = (MeshInstance*)casters->instances.data;
+	s64 instances_count = 0;
 
-	if (mesh->mesh_type == MeshType::Plane)
+	// Scene instances are sorted by mesh type, so a slot's type is known from the type ranges
+	for (int type_i = 0; type_i < PRIMITIVE_MESH_TYPES_COUNT; type_i++)
 	{
-		float vertices[] =
+		s64 type_first = g_mesh_instances.type_first_instance[type_i];
+		s64 type_end = type_first + g_mesh_instances.type_instances_count[type_i];
+		casters->type_first_instance[type_i] = instances_count;
+
+		for (s64 i = 0; i < casters_count; i++)
 		{
-			// Coords			// UV		 // Plane normal
-			1.0f, 0.0f, 0.0f,	1.0f, 1.0f,	 0.0f,  1.0f, 0.0f, //  right top
-			0.0f, 0.0f, 0.0f,	0.0f, 1.0f,	 0.0f,  1.0f, 0.0f, //  left  top
-			0.0f, 0.0f, 1.0f,	0.0f, 0.0f,	 0.0f,  1.0f, 0.0f, //  left  bot
-
-			1.0f, 0.0f, 0.0f,	1.0f, 1.0f,	 0.0f,  1.0f, 0.0f, //  right top
-			0.0f, 0.0f, 1.0f,	0.0f, 0.0f,	 0.0f,  1.0f, 0.0f, //  left  bot
-			1.0f, 0.0f, 1.0f,	1.0f, 0.0f,	 0.0f,  1.0f, 0.0f, //  right bot
-		};
+			s64 slot = g_mesh_instances.scene_instance_slots[casters->caster_indices[i]];
+			if (slot < type_first || type_end <= slot) continue;
 
-		draw_indicies = 6;
-		glBindBuffer(GL_ARRAY_BUFFER, g_mesh_shader.vbo);
-		glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_DYNAMIC_DRAW);
+			caster_instances[instances_count++] = scene_instances[slot];
+		}
+
+		casters->type_instances_count[type_i] = instances_count - casters->type_first_instance[type_i];
 	}
-	else if (mesh->mesh_type == MeshType::Cube)
+
+	casters->instances.items_count = instances_count;
+	if (instances_count == 0) return 0;
+
+	// Each light appends after the previous one, the buffer is orphaned only when full
+	gl_bind_buffer(GL_ARRAY_BUFFER, casters->vbo);
+
+	if (MESH_INSTANCES_MAX_COUNT < casters->vbo_instances_used + instances_count)
 	{
-		float vertices[] =
-		{
-			// Coords				 // UV			 // Plane normal
-			// Ceiling
-			0.5f,  0.5f, -0.5f,	 1.0f, 1.0f,	 0.0f,  1.0f, 0.0f, // top right
-		   -0.5f,  0.5f, -0.5f,	 0.0f, 1.0f,	 0.0f,  1.0f, 0.0f, // top left
-		   -0.5f,  0.5f,  0.5f,	 0.0f, 0.0f,	 0.0f,  1.0f, 0.0f, // bot left
-
-			0.5f,  0.5f, -0.5f,	 1.0f, 1.0f,	 0.0f,  1.0f, 0.0f, // top right
-		   -0.5f,  0.5f,  0.5f,	 0.0f, 0.0f,	 0.0f,  1.0f, 0.0f, // bot left 
-			0.5f,  0.5f,  0.5f,	 1.0f, 0.0f,	 0.0f,  1.0f, 0.0f, // bot right
-
-			// Floor
-		   -0.5f, -0.5f,  0.5f,	 0.0f, 0.0f,	 0.0f, -1.0f, 0.0f, // bot left 
-			0.5f, -0.5f, -0.5f,	 1.0f, 1.0f,	 0.0f, -1.0f, 0.0f, // top right
-			0.5f, -0.5f,  0.5f,	 1.0f, 0.0f,	 0.0f, -1.0f, 0.0f, // bot right
-
-		   -0.5f, -0.5f,  0.5f,	 0.0f, 0.0f,	 0.0f, -1.0f, 0.0f, // bot left
-		   -0.5f, -0.5f, -0.5f,	 0.0f, 1.0f,	 0.0f, -1.0f, 0.0f, // top left
-			0.5f, -0.5f, -0.5f,	 1.0f, 1.0f,	 0.0f, -1.0f, 0.0f, // top right
-
-			// North
-		   -0.5f, -0.5f, -0.5f,	 0.0f, 0.0f,	 0.0f,  0.0f, -1.0f, // bot left 
-			0.5f,  0.5f, -0.5f,	 1.0f, 1.0f,	 0.0f,  0.0f, -1.0f, // top right
-			0.5f, -0.5f, -0.5f,	 1.0f, 0.0f,	 0.0f,  0.0f, -1.0f, // bot right
-
-		   -0.5f, -0.5f, -0.5f,	 0.0f, 0.0f,	 0.0f,  0.0f, -1.0f, // bot left
-		   -0.5f,  0.5f, -0.5f,	 0.0f, 1.0f,	 0.0f,  0.0f, -1.0f, // top left
-			0.5f,  0.5f, -0.5f,	 1.0f, 1.0f,	 0.0f,  0.0f, -1.0f, // top right
-
-			// South
-			0.5f,  0.5f,  0.5f,	 1.0f, 1.0f,	 0.0f,  0.0f,  1.0f, // top right
-		   -0.5f, -0.5f,  0.5f,	 0.0f, 0.0f,	 0.0f,  0.0f,  1.0f, // bot left 
-			0.5f, -0.5f,  0.5f,	 1.0f, 0.0f,	 0.0f,  0.0f,  1.0f, // bot right
-
-		   -0.5f,  0.5f,  0.5f,	 0.0f, 1.0f,	 0.0f,  0.0f,  1.0f, // top left
-		   -0.5f, -0.5f,  0.5f,	 0.0f, 0.0f,	 0.0f,  0.0f,  1.0f, // bot left
-			0.5f,  0.5f,  0.5f,	 1.0f, 1.0f,	 0.0f,  0.0f,  1.0f, // top right
-
-			// West
-		   -0.5f, -0.5f,  0.5f,	 0.0f, 0.0f,	-1.0f,  0.0f,  0.0f, // bot left 
-		   -0.5f,  0.5f, -0.5f,	 1.0f, 1.0f,	-1.0f,  0.0f,  0.0f, // top right
-		   -0.5f, -0.5f, -0.5f,	 1.0f, 0.0f,	-1.0f,  0.0f,  0.0f, // bot right
-
-		   -0.5f, -0.5f,  0.5f,	 0.0f, 0.0f,	-1.0f,  0.0f,  0.0f, // bot left
-		   -0.5f,  0.5f,  0.5f,	 0.0f, 1.0f,	-1.0f,  0.0f,  0.0f, // top left
-		   -0.5f,  0.5f, -0.5f,	 1.0f, 1.0f,	-1.0f,  0.0f,  0.0f, // top right
-
-		   // East
-		   0.5f,  0.5f, -0.5f,	 1.0f, 1.0f,	 1.0f,  0.0f,  0.0f, // top right
-		   0.5f, -0.5f,  0.5f,	 0.0f, 0.0f,	 1.0f,  0.0f,  0.0f, // bot left 
-		   0.5f, -0.5f, -0.5f,	 1.0f, 0.0f,	 1.0f,  0.0f,  0.0f, // bot right
-
-		   0.5f,  0.5f,  0.5f,	 0.0f, 1.0f,	 1.0f,  0.0f,  0.0f, // top left
-		   0.5f, -0.5f,  0.5f,	 0.0f, 0.0f,	 1.0f,  0.0f,  0.0f, // bot left
-		   0.5f,  0.5f, -0.5f,	 1.0f, 1.0f,	 1.0f,  0.0f,  0.0f, // top right
-		};
+		glBufferData(GL_ARRAY_BUFFER, sizeof(MeshInstance) * MESH_INSTANCES_MAX_COUNT, NULL, GL_STREAM_DRAW);
+		casters->vbo_instances_used = 0;
+	}
+
+	s64 upload_size = instances_count * sizeof(MeshInstance);
+	glBufferSubData(GL_ARRAY_BUFFER, casters->vbo_instances_used * sizeof(MeshInstance), upload_size, caster_instances);
+	gl_bind_buffer(GL_ARRAY_BUFFER, 0);
+	g_frame_data.bytes_uploaded += upload_size;
 
-		draw_indicies = 36;
-		glBindBuffer(GL_ARRAY_BUFFER, g_mesh_shader.vbo);
-		glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_DYNAMIC_DRAW);
+	for (int type_i = 0; type_i < PRIMITIVE_MESH_TYPES_COUNT; type_i++)
+	{
+		casters->type_first_instance[type_i] += casters->vbo_instances_used;
 	}
 
-	bool use_specular_texture = mesh->material->specular_texture != nullptr;
-	glUniform1i(use_gloss_texture_loc, use_specular_texture);
+	casters->vbo_instances_used += instances_count;
+	return instances_count;
+}
+
+void draw_mesh_instances_shadow_map(Spotlight* spotlight)
+{
+	SimpleShader* shader = &g_shdow_map_shader;
+	spotlight->shadow_casters_count = build_shadow_casters(spotlight);
+	g_frame_data.shadow_casters_drawn += spotlight->shadow_casters_count;
+	if (spotlight->shadow_casters_count == 0) return;
+
+	glm::vec3 light_position = spotlight->transforms.translation;
+	glm::vec3 light_direction = get_spotlight_dir(*spotlight);
 
-	if (use_specular_texture)
+	glUniform3f(get_uniform_location(shader, uniform_id("light_position")), light_position.x, light_position.y, light_position.z);
+	glUniform3f(get_uniform_location(shader, uniform_id("light_direction")), light_direction.x, light_direction.y, light_direction.z);
+
+	for (int i = 0; i < PRIMITIVE_MESH_TYPES_COUNT; i++)
 	{
-		glUniform1i(specular_texture_loc, 1);
-		glActiveTexture(GL_TEXTURE1);
-		glBindTexture(GL_TEXTURE_2D, mesh->material->specular_texture->gpu_id);
+		s64 instances_count = g_shadow_casters.type_instances_count[i];
+		if (instances_count == 0) continue;
+
+		// Planes are biased away from the light instead of front face culled
+		bool is_plane = (MeshType)i == MeshType::Plane;
+		glUniform1i(get_uniform_location(shader, uniform_id("use_plane_bias")), is_plane);
+		gl_cull_face(is_plane ? GL_BACK : GL_FRONT);
+
+		bind_mesh_instance_attributes(g_shadow_casters.vbo, g_shadow_casters.type_first_instance[i]);
+		draw_primitive_instanced((MeshType)i, instances_count);
 	}
+}
 
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, mesh->material->color_texture->gpu_id);
+// Packed lights of the current frame, uploaded once in update_ubos()
+LightsBlock lights_block;
 
-	glDrawArrays(GL_TRIANGLES, 0, draw_indicies);
-	g_frame_data.draw_calls++;
+void update_lights_ubo()
+{
+	s64 pointlights_count = 0;
+	s64 spotlights_count = 0;
+
+	for (int i = 0; i < g_scene.pointlights.items_count && pointlights_count < LIGHTS_UBO_POINTLIGHTS_MAX_COUNT; i++)
+	{
+		auto pointlight = (Pointlight*)j_array_get(&g_scene.pointlights, i);
+		if (!pointlight->is_on) continue;
+
+		PointlightStd140* dest = &lights_block.pointlights[pointlights_count++];
+		dest->position = pointlight->transforms.translation;
+		dest->range = pointlight->range;
+		dest->diffuse = pointlight->diffuse;
+		dest->specular = pointlight->specular;
+		dest->intensity = pointlight->intensity;
+	}
+
+	for (int i = 0; i < g_scene.spotlights.items_count && spotlights_count < LIGHTS_UBO_SPOTLIGHTS_MAX_COUNT; i++)
+	{
+		auto spotlight = (Spotlight*)j_array_get(&g_scene.spotlights, i);
+		if (!spotlight->is_on) continue;
+
+		float cutoff = glm::cos(glm::radians(spotlight->fov / 2.0f));
+		float cos = glm::cos(glm::radians(spotlight->outer_cutoff_fov / 2.0f));
+		float outer_cutoff = cutoff - (cutoff - cos);
+
+		SpotlightStd140* dest = &lights_block.spotlights[spotlights_count++];
+		dest->light_space_matrix = get_spotlight_light_space_matrix(*spotlight);
+		dest->shadow_rect = get_shadow_tile_uv_rect(&g_shadow_atlas, spotlight->shadow_tile);
+		dest->position = spotlight->transforms.translation;
+		dest->range = spotlight->range;
+		dest->direction = get_spotlight_dir(*spotlight);
+		dest->cutoff = cutoff;
+		dest->diffuse = spotlight->diffuse;
+		dest->specular = spotlight->specular;
+		dest->outer_cutoff = outer_cutoff;
+	}
 
-	glUseProgram(0);
-	glBindVertexArray(0);
+	lights_block.view_coords = glm::vec4(g_scene_camera.position, 1.0f);
+	lights_block.global_ambient_light = glm::vec4(g_user_settings.world_ambient, 1.0f);
+	lights_block.pointlights_count = pointlights_count;
+	lights_block.spotlights_count = spotlights_count;
+
+	LightClusters* clusters = &g_light_clusters;
+	light_clusters_set_projection(clusters, glm::radians(g_scene_camera.fov), g_scene_camera.aspect_ratio_horizontal, g_scene_camera.near_clip, g_scene_camera.far_clip);
+	lights_block.cluster_scale = glm::vec4(
+		(f32)LIGHT_CLUSTERS_X / g_game_metrics.scene_width_px,
+		(f32)LIGHT_CLUSTERS_Y / g_game_metrics.scene_height_px,
+		clusters->slice_scale,
+		clusters->slice_bias);
+
+	// Only the header and the used part of each light array are uploaded
+	s64 header_size = offsetof(LightsBlock, pointlights);
+	s64 pointlights_size = pointlights_count * sizeof(PointlightStd140);
+	s64 spotlights_size = spotlights_count * sizeof(SpotlightStd140);
+
+	gl_bind_buffer(GL_UNIFORM_BUFFER, g_lights_ubo);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, header_size, &lights_block);
+	glBufferSubData(GL_UNIFORM_BUFFER, offsetof(LightsBlock, pointlights), pointlights_size, lights_block.pointlights);
+	glBufferSubData(GL_UNIFORM_BUFFER, offsetof(LightsBlock, spotlights), spotlights_size, lights_block.spotlights);
+	gl_bind_buffer(GL_UNIFORM_BUFFER, 0);
+
+	g_frame_data.bytes_uploaded += header_size + pointlights_size + spotlights_size;
 }
 
-void draw_mesh_wireframe(Mesh* mesh, glm::vec3 color)
+void init_light_cluster_buffers()
 {
-	glUseProgram(g_wireframe_shader.id);
-	glBindVertexArray(g_wireframe_shader.vao);
+	LightClusterBuffers* buffers = &g_light_cluster_buffers;
 
-	glm::mat4 model = get_model_matrix(mesh);
+	glGenBuffers(1, &buffers->grid_buffer);
+	gl_bind_buffer(GL_TEXTURE_BUFFER, buffers->grid_buffer);
+	glBufferData(GL_TEXTURE_BUFFER, 2 * sizeof(u32) * LIGHT_CLUSTERS_COUNT, NULL, GL_STREAM_DRAW);
 
-	unsigned int model_loc = glGetUniformLocation(g_wireframe_shader.id, "model");
-	unsigned int color_loc = glGetUniformLocation(g_wireframe_shader.id, "color");
+	glGenBuffers(1, &buffers->indices_buffer);
+	gl_bind_buffer(GL_TEXTURE_BUFFER, buffers->indices_buffer);
+	glBufferData(GL_TEXTURE_BUFFER, sizeof(u16) * LIGHT_CLUSTER_INDICES_MAX_COUNT, NULL, GL_STREAM_DRAW);
+	gl_bind_buffer(GL_TEXTURE_BUFFER, 0);
 
-	glUniformMatrix4fv(model_loc, 1, GL_FALSE, glm::value_ptr(model));
-	glUniform3f(color_loc, color.r, color.g, color.b);
+	glGenTextures(1, &buffers->grid_texture);
+	gl_bind_texture(GL_TEXTURE_BUFFER, buffers->grid_texture);
+	glTexBuffer(GL_TEXTURE_BUFFER, GL_RG32UI, buffers->grid_buffer);
+
+	glGenTextures(1, &buffers->indices_texture);
+	gl_bind_texture(GL_TEXTURE_BUFFER, buffers->indices_texture);
+	glTexBuffer(GL_TEXTURE_BUFFER, GL_R16UI, buffers->indices_buffer);
+	gl_bind_texture(GL_TEXTURE_BUFFER, 0);
+}
 
-	s64 draw_indicies = 0;
+// Packed lights in view space, indices match the Lights UBO arrays
+LightSphere cluster_pointlights[LIGHTS_UBO_POINTLIGHTS_MAX_COUNT];
+LightSphere cluster_spotlights[LIGHTS_UBO_SPOTLIGHTS_MAX_COUNT];
 
-	if (mesh->mesh_type == MeshType::Plane)
+void update_light_clusters()
+{
+	LightClusters* clusters = &g_light_clusters;
+	glm::mat4 view = get_view_matrix();
+
+	// Brightness is the most a light adds to a channel, taking albedo and specular maps times specular_mult up to one
+	for (int i = 0; i < lights_block.pointlights_count; i++)
 	{
-		float vertices[] =
-		{
-			// Coords		
-			1.0f, 0.0f, 0.0f, // top right
-			0.0f, 0.0f, 0.0f, // top left
-			0.0f, 0.0f, 1.0f, // bot left
-
-			1.0f, 0.0f, 0.0f, // top right
-			0.0f, 0.0f, 1.0f, // bot left 
-			1.0f, 0.0f, 1.0f, // bot right
-
-			0.0f, 0.0f, 0.0f, // top left
-			1.0f, 0.0f, 0.0f, // top right
-			0.0f, 0.0f, 1.0f, // bot left
-
-			0.0f, 0.0f, 1.0f, // bot left 
-			1.0f, 0.0f, 0.0f, // top right
-			1.0f, 0.0f, 1.0f, // bot right
-		};
+		PointlightStd140* light = &lights_block.pointlights[i];
+		f32 brightness = light->intensity * glm::max(glm::max(light->diffuse.r, light->diffuse.g), light->diffuse.b) * (1.0f + light->specular);
+		cluster_pointlights[i] = { glm::vec3(view * glm::vec4(light->position, 1.0f)), get_light_cluster_radius(light->range, brightness) };
+	}
 
-		draw_indicies = 12;
-		glBindBuffer(GL_ARRAY_BUFFER, g_wireframe_shader.vbo);
-		glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_DYNAMIC_DRAW);
+	// Spotlights are binned by their whole cutoff sphere, the cone is tested per fragment
+	for (int i = 0; i < lights_block.spotlights_count; i++)
+	{
+		SpotlightStd140* light = &lights_block.spotlights[i];
+		f32 brightness = glm::max(glm::max(light->diffuse.r, light->diffuse.g), light->diffuse.b) * (1.0f + light->specular);
+		cluster_spotlights[i] = { glm::vec3(view * glm::vec4(light->position, 1.0f)), get_light_cluster_radius(light->range, brightness) };
 	}
-	else if (mesh->mesh_type == MeshType::Cube)
+
+	light_clusters_bin(clusters, cluster_pointlights, lights_block.pointlights_count, cluster_spotlights, lights_block.spotlights_count);
+
+	s64 grid_size = 2 * sizeof(u32) * LIGHT_CLUSTERS_COUNT;
+	s64 indices_size = sizeof(u16) * clusters->light_indices_count;
+
+	gl_bind_buffer(GL_TEXTURE_BUFFER, g_light_cluster_buffers.grid_buffer);
+	glBufferData(GL_TEXTURE_BUFFER, grid_size, clusters->cluster_data, GL_STREAM_DRAW);
+	gl_bind_buffer(GL_TEXTURE_BUFFER, g_light_cluster_buffers.indices_buffer);
+	glBufferData(GL_TEXTURE_BUFFER, sizeof(u16) * LIGHT_CLUSTER_INDICES_MAX_COUNT, NULL, GL_STREAM_DRAW);
+	glBufferSubData(GL_TEXTURE_BUFFER, 0, indices_size, clusters->light_indices);
+	gl_bind_buffer(GL_TEXTURE_BUFFER, 0);
+
+	g_frame_data.bytes_uploaded += grid_size + indices_size;
+	g_frame_data.light_cluster_indices = clusters->light_indices_count;
+}
+
+void bind_light_clusters()
+{
+	gl_active_texture(GL_TEXTURE3);
+	gl_bind_texture(GL_TEXTURE_BUFFER, g_light_cluster_buffers.grid_texture);
+	gl_active_texture(GL_TEXTURE4);
+	gl_bind_texture(GL_TEXTURE_BUFFER, g_light_cluster_buffers.indices_texture);
+	gl_active_texture(GL_TEXTURE0);
+}
+
+void bind_shadow_atlas()
+{
+	gl_active_texture(GL_TEXTURE2);
+	gl_bind_texture(GL_TEXTURE_2D, g_shadow_atlas.texture_id);
+	gl_active_texture(GL_TEXTURE0);
+}
+
+void submit_mesh_batches(RenderQueue* queue, SimpleShader* shader)
+{
+	for (int i = 0; i < g_mesh_instances.batches.items_count; i++)
 	{
-		float vertices[] =
-		{
-			// Coords		
-			// Ceiling
-			0.5f,  0.5f, -0.5f, // top right
-		   -0.5f,  0.5f, -0.5f, // top left
-		   -0.5f,  0.5f,  0.5f, // bot left
-
-			0.5f,  0.5f, -0.5f, // top right
-		   -0.5f,  0.5f,  0.5f, // bot left 
-			0.5f,  0.5f,  0.5f, // bot right
-
-			// Floor		    
-		   -0.5f, -0.5f,  0.5f, // bot left 
-			0.5f, -0.5f, -0.5f, // top right
-			0.5f, -0.5f,  0.5f, // bot right
-
-		   -0.5f, -0.5f,  0.5f, // bot left
-		   -0.5f, -0.5f, -0.5f, // top left
-			0.5f, -0.5f, -0.5f, // top right
-
-			// North
-		   -0.5f, -0.5f, -0.5f, // bot left 
-			0.5f,  0.5f, -0.5f, // top right
-			0.5f, -0.5f, -0.5f, // bot right
-
-		   -0.5f, -0.5f, -0.5f, // bot left
-		   -0.5f,  0.5f, -0.5f, // top left
-			0.5f,  0.5f, -0.5f, // top right
-
-			// South
-			0.5f,  0.5f,  0.5f, // top right
-		   -0.5f, -0.5f,  0.5f, // bot left 
-			0.5f, -0.5f,  0.5f, // bot right
-
-		   -0.5f,  0.5f,  0.5f, // top left
-		   -0.5f, -0.5f,  0.5f, // bot left
-			0.5f,  0.5f,  0.5f, // top right
-
-			// West
-		   -0.5f, -0.5f,  0.5f, // bot left 
-		   -0.5f,  0.5f, -0.5f, // top right
-		   -0.5f, -0.5f, -0.5f, // bot right
-
-		   -0.5f, -0.5f,  0.5f, // bot left
-		   -0.5f,  0.5f,  0.5f, // top left
-		   -0.5f,  0.5f, -0.5f, // top right
-
-		   // East
-		   0.5f,  0.5f, -0.5f, // top right
-		   0.5f, -0.5f,  0.5f, // bot left 
-		   0.5f, -0.5f, -0.5f, // bot right
-
-		   0.5f,  0.5f,  0.5f, // top left
-		   0.5f, -0.5f,  0.5f, // bot left
-		   0.5f,  0.5f, -0.5f  // top right
+		MeshBatch* batch = (MeshBatch*)j_array_get(&g_mesh_instances.batches, i);
+		if (!batch->is_visible) continue;
+
+		Material* material = batch->material;
+		u32 color_id = (u32)material->color_texture->gpu_id;
+		u32 specular_id = material->specular_texture != nullptr ? (u32)material->specular_texture->gpu_id : 0;
+
+		DrawPacket packet = {
+			.type = DrawPacketType::MeshBatch,
+			.shader = shader,
+			.material = material,
+			.texture_ids = { color_id, specular_id },
+			.mesh_type = batch->mesh_type,
+			.first_instance = batch->first_instance,
+			.instances_count = batch->instances_count,
 		};
 
-		draw_indicies = 40;
-		glBindBuffer(GL_ARRAY_BUFFER, g_wireframe_shader.vbo);
-		glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_DYNAMIC_DRAW);
+		// Batches span many instances, so they are ordered by state only
+		s64 material_index = material - (Material*)g_materials.data;
+		u64 sort_key = render_sort_key(RenderPass::Opaque, shader->id, material_index, color_id, 0.0f);
+		render_queue_submit(queue, sort_key, &packet);
 	}
+}
+
+void draw_mesh_wireframe(Mesh* mesh, glm::vec3 color)
+{
+	gl_use_program(g_wireframe_shader.id);
+	gl_bind_vertex_array(g_wireframe_shader.vao);
+
+	MeshInstance instance = mesh_instance_init(mesh);
+	gl_bind_buffer(GL_ARRAY_BUFFER, g_wireframe_shader.vbo);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(MeshInstance), &instance);
+	gl_bind_buffer(GL_ARRAY_BUFFER, 0);
+	g_frame_data.bytes_uploaded += sizeof(MeshInstance);
+
+	s32 color_loc = get_uniform_location(&g_wireframe_shader, uniform_id("color"));
+	glUniform3f(color_loc, color.r, color.g, color.b);
 
+	// Planes are single sided, show the wireframe from both sides
+	gl_disable(GL_CULL_FACE);
 	glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
 	glLineWidth(1.5f);
-	glDrawArrays(GL_TRIANGLES, 0, draw_indicies);
+	draw_primitive_instanced(mesh->mesh_type, 1);
 	glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-	g_frame_data.draw_calls++;
+	gl_enable(GL_CULL_FACE);
 
-	glUseProgram(0);
-	glBindVertexArray(0);
+	gl_use_program(0);
+	gl_bind_vertex_array(0);
 }
 
 void append_line(glm::vec3 start, glm::vec3 end, glm::vec3 color)
@@ -593,50 +816,61 @@ void append_line(glm::vec3 start, glm::vec3 end, glm::vec3 color)
 		end.x,   end.y,   end.z,   color.r, color.g, color.b,
 	};
 
-	s64 bytes_offset = g_lines_buffered * LINE_VERICIES * sizeof(float);
-	glBindBuffer(GL_ARRAY_BUFFER, g_line_shader.vbo);
-	glBufferSubData(GL_ARRAY_BUFFER, bytes_offset, sizeof(vertices), vertices);
-	g_lines_buffered++;
+	transient_vertices_push(&g_line_vertices, vertices, 2);
 }
 
 void draw_lines(float thickness)
 {
-	glUseProgram(g_line_shader.id);
-	glBindVertexArray(g_line_shader.vao);
+	gl_use_program(g_line_shader.id);
+	gl_bind_vertex_array(g_line_shader.vao);
 
 	glm::mat4 model = glm::mat4(1.0f);
-	unsigned int model_loc = glGetUniformLocation(g_line_shader.id, "model");
+	s32 model_loc = get_uniform_location(&g_line_shader, uniform_id("model"));
 	glUniformMatrix4fv(model_loc, 1, GL_FALSE, glm::value_ptr(model));
 
-	s64 indicies = g_lines_buffered * 2;
+	s64 first_vertex = stream_buffer_upload(&g_stream_buffer, &g_line_vertices);
 	glLineWidth(thickness);
-	glDrawArrays(GL_LINES, 0, indicies);
+	glDrawArrays(GL_LINES, first_vertex, g_line_vertices.vertices_count);
 
-	g_lines_buffered = 0;
+	transient_vertices_clear(&g_line_vertices);
 	g_frame_data.draw_calls++;
 
-	glUseProgram(0);
-	glBindVertexArray(0);
+	gl_use_program(0);
+	gl_bind_vertex_array(0);
 }
 
 void draw_lines_ontop(float thickness)
 {
-	glDisable(GL_DEPTH_TEST);
+	gl_disable(GL_DEPTH_TEST);
 	draw_lines(thickness);
-	glEnable(GL_DEPTH_TEST);
+	gl_enable(GL_DEPTH_TEST);
 }
 
 void init_all_shaders()
 {
+	PROFILE_ZONE("Compile shaders");
 	// View & Projection UBO
 	{
 		glGenBuffers(1, &g_view_proj_ubo);
-		glBindBuffer(GL_UNIFORM_BUFFER, g_view_proj_ubo);
+		gl_bind_buffer(GL_UNIFORM_BUFFER, g_view_proj_ubo);
 		glBufferData(GL_UNIFORM_BUFFER, SIZEOF_VIEW_MATRICES, NULL, GL_STATIC_DRAW);
-		glBindBufferRange(GL_UNIFORM_BUFFER, 0, g_view_proj_ubo, 0, SIZEOF_VIEW_MATRICES);
-		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+		gl_bind_buffer_range(GL_UNIFORM_BUFFER, VIEW_MATRICES_UBO_BINDING, g_view_proj_ubo, 0, SIZEOF_VIEW_MATRICES);
+		gl_bind_buffer(GL_UNIFORM_BUFFER, 0);
+	}
+
+	// Lights UBO
+	{
+		glGenBuffers(1, &g_lights_ubo);
+		gl_bind_buffer(GL_UNIFORM_BUFFER, g_lights_ubo);
+		glBufferData(GL_UNIFORM_BUFFER, sizeof(LightsBlock), NULL, GL_DYNAMIC_DRAW);
+		gl_bind_buffer_range(GL_UNIFORM_BUFFER, LIGHTS_UBO_BINDING, g_lights_ubo, 0, sizeof(LightsBlock));
+		gl_bind_buffer(GL_UNIFORM_BUFFER, 0);
 	}
 
+	init_primitive_geometry();
+	init_mesh_instances();
+	init_light_cluster_buffers();
+
 	// Skybox
 	{
 		const char* vertex_shader_path = "G:/projects/game/Engine3D/resources/shaders/skybox_vs.glsl";
@@ -644,13 +878,13 @@ void init_all_shaders()
 
 		g_skybox_shader = simple_shader_init();
 
-		g_skybox_shader.id = compile_shader(vertex_shader_path, fragment_shader_path, &TEMP_MEMORY);
+		compile_shader(&g_skybox_shader, vertex_shader_path, fragment_shader_path, &TEMP_MEMORY);
 		{
 			glGenVertexArrays(1, &g_skybox_shader.vao);
 			glGenBuffers(1, &g_skybox_shader.vbo);
 
-			glBindVertexArray(g_skybox_shader.vao);
-			glBindBuffer(GL_ARRAY_BUFFER, g_skybox_shader.vbo);
+			gl_bind_vertex_array(g_skybox_shader.vao);
+			gl_bind_buffer(GL_ARRAY_BUFFER, g_skybox_shader.vbo);
 
 			float skybox_verticies[] = {
 				// Coords          
@@ -712,13 +946,13 @@ void init_all_shaders()
 
 		g_billboard_shader = simple_shader_init();
 
-		g_billboard_shader.id = compile_shader(vertex_shader_path, fragment_shader_path, &TEMP_MEMORY);
+		compile_shader(&g_billboard_shader, vertex_shader_path, fragment_shader_path, &TEMP_MEMORY);
 		{
 			glGenVertexArrays(1, &g_billboard_shader.vao);
 			glGenBuffers(1, &g_billboard_shader.vbo);
 
-			glBindVertexArray(g_billboard_shader.vao);
-			glBindBuffer(GL_ARRAY_BUFFER, g_billboard_shader.vbo);
+			gl_bind_vertex_array(g_billboard_shader.vao);
+			gl_bind_buffer(GL_ARRAY_BUFFER, g_billboard_shader.vbo);
 
 			float vertices[] =
 			{
@@ -742,8 +976,22 @@ void init_all_shaders()
 			glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
 			glEnableVertexAttribArray(1);
 
-			unsigned int view_matrices_loc = glGetUniformBlockIndex(g_billboard_shader.id, "ViewMatrices");
-			glUniformBlockBinding(g_billboard_shader.id, view_matrices_loc, 0);
+			// Per billboard position and scale, then texture layer
+			glGenBuffers(1, &g_billboard_batch.vbo);
+			gl_bind_buffer(GL_ARRAY_BUFFER, g_billboard_batch.vbo);
+			glBufferData(GL_ARRAY_BUFFER, sizeof(BillboardInstance) * BILLBOARDS_MAX_COUNT, NULL, GL_STREAM_DRAW);
+
+			glVertexAttribPointer(2, 4, GL_FLOAT, GL_FALSE, sizeof(BillboardInstance), (void*)offsetof(BillboardInstance, position));
+			glVertexAttribDivisor(2, 1);
+			glEnableVertexAttribArray(2);
+
+			glVertexAttribPointer(3, 1, GL_FLOAT, GL_FALSE, sizeof(BillboardInstance), (void*)offsetof(BillboardInstance, texture_layer));
+			glVertexAttribDivisor(3, 1);
+			glEnableVertexAttribArray(3);
+			gl_bind_buffer(GL_ARRAY_BUFFER, 0);
+
+			u32 view_matrices_loc = get_uniform_block_index(&g_billboard_shader, uniform_id("ViewMatrices"));
+			glUniformBlockBinding(g_billboard_shader.id, view_matrices_loc, VIEW_MATRICES_UBO_BINDING);
 		}
 	}
 
@@ -752,54 +1000,70 @@ void init_all_shaders()
 		const char* vertex_shader_path = "G:/projects/game/Engine3D/resources/shaders/ui_text_vs.glsl";
 		const char* fragment_shader_path = "G:/projects/game/Engine3D/resources/shaders/ui_text_fs.glsl";
 
-		g_ui_text_shader.id = compile_shader(vertex_shader_path, fragment_shader_path, &TEMP_MEMORY);
-
-		glGenVertexArrays(1, &g_ui_text_shader.vao);
-		glGenBuffers(1, &g_ui_text_shader.vbo);
+		compile_shader(&g_ui_text_shader, vertex_shader_path, fragment_shader_path, &TEMP_MEMORY);
 
-		glBindVertexArray(g_ui_text_shader.vao);
-		glBindBuffer(GL_ARRAY_BUFFER, g_ui_text_shader.vbo);
+		// Lines and UI text are both drawn from the shared stream buffer
+		stream_buffer_init(&g_stream_buffer, STREAM_BUFFER_SEGMENT_SIZE);
+		g_ui_text_shader.vbo = g_stream_buffer.vbo;
 
-		s64 max_size_bytes = MAX_UI_CHARS_BUFFERED * sizeof(float) * UI_CHAR_VERTICIES;
-		glBufferData(GL_ARRAY_BUFFER, max_size_bytes, nullptr, GL_DYNAMIC_DRAW);
+		glGenVertexArrays(1, &g_ui_text_shader.vao);
+		gl_bind_vertex_array(g_ui_text_shader.vao);
+		gl_bind_buffer(GL_ARRAY_BUFFER, g_ui_text_shader.vbo);
 
 		// Coord attribute
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)0);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(UiTextVertex), (void*)offsetof(UiTextVertex, position));
 		glEnableVertexAttribArray(0);
 
 		// UV attribute
-		glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
+		glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(UiTextVertex), (void*)offsetof(UiTextVertex, uv));
 		glEnableVertexAttribArray(1);
 
+		// Color attribute
+		glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(UiTextVertex), (void*)offsetof(UiTextVertex, color));
+		glEnableVertexAttribArray(2);
 	}
 
 	// Init mesh shader
 	{
 		const char* vertex_shader_path = "G:/projects/game/Engine3D/resources/shaders/mesh_vs.glsl";
+		const char* lighting_include_path = "G:/projects/game/Engine3D/resources/shaders/lighting_common_fs.glsl";
 		const char* fragment_shader_path = "G:/projects/game/Engine3D/resources/shaders/mesh_fs.glsl";
 
-		g_mesh_shader.id = compile_shader(vertex_shader_path, fragment_shader_path, &TEMP_MEMORY);
+		compile_shader_with_include(&g_mesh_shader, vertex_shader_path, lighting_include_path, fragment_shader_path, &TEMP_MEMORY);
 		{
 			glGenVertexArrays(1, &g_mesh_shader.vao);
-			glBindVertexArray(g_mesh_shader.vao);
-
-			glGenBuffers(1, &g_mesh_shader.vbo);
-			glBindBuffer(GL_ARRAY_BUFFER, g_mesh_shader.vbo);
+			gl_bind_vertex_array(g_mesh_shader.vao);
+			bind_primitive_geometry();
 
 			// Coord attribute
-			glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
+			glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, PRIMITIVE_VERTEX_FLOATS * sizeof(float), (void*)0);
 			glEnableVertexAttribArray(0);
 
 			// UV attribute
-			glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
+			glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, PRIMITIVE_VERTEX_FLOATS * sizeof(float), (void*)(3 * sizeof(float)));
 			glEnableVertexAttribArray(1);
 
 			// Normal attribute
-			glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(5 * sizeof(float)));
+			glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, PRIMITIVE_VERTEX_FLOATS * sizeof(float), (void*)(5 * sizeof(float)));
 			glEnableVertexAttribArray(2);
 
-			unsigned int view_matrices_loc = glGetUniformBlockIndex(g_mesh_shader.id, "ViewMatrices");
-			glUniformBlockBinding(g_mesh_shader.id, view_matrices_loc, 0);
+			bind_mesh_instance_attributes(g_mesh_instances.vbo, 0);
+
+			u32 view_matrices_loc = get_uniform_block_index(&g_mesh_shader, uniform_id("ViewMatrices"));
+			glUniformBlockBinding(g_mesh_shader.id, view_matrices_loc, VIEW_MATRICES_UBO_BINDING);
+
+			u32 lights_loc = get_uniform_block_index(&g_mesh_shader, uniform_id("Lights"));
+			glUniformBlockBinding(g_mesh_shader.id, lights_loc, LIGHTS_UBO_BINDING);
+
+			// Sampler units stay fixed, draws only bind textures
+			gl_use_program(g_mesh_shader.id);
+			glUniform1i(get_uniform_location(&g_mesh_shader, uniform_id("material.color_texture")), 0);
+			glUniform1i(get_uniform_location(&g_mesh_shader, uniform_id("material.specular_texture")), 1);
+			glUniform1i(get_uniform_location(&g_mesh_shader, uniform_id("use_texture")), true);
+			glUniform1i(get_uniform_location(&g_mesh_shader, uniform_id("shadow_atlas")), 2);
+			glUniform1i(get_uniform_location(&g_mesh_shader, uniform_id("cluster_grid")), 3);
+			glUniform1i(get_uniform_location(&g_mesh_shader, uniform_id("cluster_light_indices")), 4);
+			gl_use_program(0);
 		}
 	}
 
@@ -808,20 +1072,24 @@ void init_all_shaders()
 		const char* vertex_shader_path = "G:/projects/game/Engine3D/resources/shaders/wireframe_vs.glsl";
 		const char* fragment_shader_path = "G:/projects/game/Engine3D/resources/shaders/wireframe_fs.glsl";
 
-		g_wireframe_shader.id = compile_shader(vertex_shader_path, fragment_shader_path, &TEMP_MEMORY);
+		compile_shader(&g_wireframe_shader, vertex_shader_path, fragment_shader_path, &TEMP_MEMORY);
 
 		glGenVertexArrays(1, &g_wireframe_shader.vao);
-		glBindVertexArray(g_wireframe_shader.vao);
-
-		glGenBuffers(1, &g_wireframe_shader.vbo);
-		glBindBuffer(GL_ARRAY_BUFFER, g_wireframe_shader.vbo);
+		gl_bind_vertex_array(g_wireframe_shader.vao);
+		bind_primitive_geometry();
 
 		// Coord attribute
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, PRIMITIVE_VERTEX_FLOATS * sizeof(float), (void*)0);
 		glEnableVertexAttribArray(0);
 
-		unsigned int view_matrices_loc = glGetUniformBlockIndex(g_wireframe_shader.id, "ViewMatrices");
-		glUniformBlockBinding(g_wireframe_shader.id, view_matrices_loc, 0);
+		// Selection outline is a single instance
+		glGenBuffers(1, &g_wireframe_shader.vbo);
+		gl_bind_buffer(GL_ARRAY_BUFFER, g_wireframe_shader.vbo);
+		glBufferData(GL_ARRAY_BUFFER, sizeof(MeshInstance), NULL, GL_DYNAMIC_DRAW);
+		bind_mesh_instance_attributes(g_wireframe_shader.vbo, 0);
+
+		u32 view_matrices_loc = get_uniform_block_index(&g_wireframe_shader, uniform_id("ViewMatrices"));
+		glUniformBlockBinding(g_wireframe_shader.id, view_matrices_loc, VIEW_MATRICES_UBO_BINDING);
 	}
 
 	// Init line shader
@@ -829,15 +1097,13 @@ void init_all_shaders()
 		const char* vertex_shader_path = "G:/projects/game/Engine3D/resources/shaders/line_vs.glsl";
 		const char* fragment_shader_path = "G:/projects/game/Engine3D/resources/shaders/line_fs.glsl";
 
-		g_line_shader.id = compile_shader(vertex_shader_path, fragment_shader_path, &TEMP_MEMORY);
+		compile_shader(&g_line_shader, vertex_shader_path, fragment_shader_path, &TEMP_MEMORY);
 
-		glGenVertexArrays(1, &g_line_shader.vao);
-		glBindVertexArray(g_line_shader.vao);
-		glGenBuffers(1, &g_line_shader.vbo);
-		glBindBuffer(GL_ARRAY_BUFFER, g_line_shader.vbo);
+		g_line_shader.vbo = g_stream_buffer.vbo;
 
-		s64 max_size_bytes = MAX_LINES_BUFFERED * sizeof(float) * LINE_VERICIES;
-		glBufferData(GL_ARRAY_BUFFER, max_size_bytes, nullptr, GL_DYNAMIC_DRAW);
+		glGenVertexArrays(1, &g_line_shader.vao);
+		gl_bind_vertex_array(g_line_shader.vao);
+		gl_bind_buffer(GL_ARRAY_BUFFER, g_line_shader.vbo);
 
 		// Coord attribute
 		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)0);
@@ -847,8 +1113,8 @@ void init_all_shaders()
 		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 6 * sizeof(float), (void*)(3 * sizeof(float)));
 		glEnableVertexAttribArray(1);
 
-		unsigned int view_matrices_loc = glGetUniformBlockIndex(g_line_shader.id, "ViewMatrices");
-		glUniformBlockBinding(g_line_shader.id, view_matrices_loc, 0);
+		u32 view_matrices_loc = get_uniform_block_index(&g_line_shader, uniform_id("ViewMatrices"));
+		glUniformBlockBinding(g_line_shader.id, view_matrices_loc, VIEW_MATRICES_UBO_BINDING);
 	}
 
 	// Init framebuffer shaders
@@ -856,11 +1122,11 @@ void init_all_shaders()
 		const char* vertex_shader_path = "G:/projects/game/Engine3D/resources/shaders/framebuffer_vs.glsl";
 		const char* fragment_shader_path = "G:/projects/game/Engine3D/resources/shaders/framebuffer_fs.glsl";
 
-		g_scene_framebuffer_shader.id = compile_shader(vertex_shader_path, fragment_shader_path, &TEMP_MEMORY);
+		compile_shader(&g_scene_framebuffer_shader, vertex_shader_path, fragment_shader_path, &TEMP_MEMORY);
 
 		glGenVertexArrays(1, &g_scene_framebuffer_shader.vao);
 		glGenBuffers(1, &g_scene_framebuffer_shader.vbo);
-		glBindVertexArray(g_scene_framebuffer_shader.vao);
+		gl_bind_vertex_array(g_scene_framebuffer_shader.vao);
 
 		float quadVertices[] = {
 			// Coords	   // Uv
@@ -873,7 +1139,7 @@ void init_all_shaders()
 			 1.0f,  1.0f,  1.0f, 1.0f
 		};
 
-		glBindBuffer(GL_ARRAY_BUFFER, g_scene_framebuffer_shader.vbo);
+		gl_bind_buffer(GL_ARRAY_BUFFER, g_scene_framebuffer_shader.vbo);
 		glBufferData(GL_ARRAY_BUFFER, sizeof(quadVertices), &quadVertices, GL_STATIC_DRAW);
 		glEnableVertexAttribArray(0);
 		glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void*)0);
@@ -881,21 +1147,91 @@ void init_all_shaders()
 		glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void*)(2 * sizeof(float)));
 	}
 
+	// Init post-processing shaders, drawn with the framebuffer quad
+	{
+		const char* vertex_shader_path = "G:/projects/game/Engine3D/resources/shaders/framebuffer_vs.glsl";
+		const char* downsample_shader_path = "G:/projects/game/Engine3D/resources/shaders/downsample_fs.glsl";
+		const char* blur_shader_path = "G:/projects/game/Engine3D/resources/shaders/blur_fs.glsl";
+
+		compile_shader(&g_downsample_shader, vertex_shader_path, downsample_shader_path, &TEMP_MEMORY);
+		g_downsample_shader.vao = g_scene_framebuffer_shader.vao;
+
+		compile_shader(&g_blur_shader, vertex_shader_path, blur_shader_path, &TEMP_MEMORY);
+		g_blur_shader.vao = g_scene_framebuffer_shader.vao;
+	}
+
+	// Init depth pre-pass shader, depth only with the mesh vertex shader
+	{
+		const char* vertex_shader_path = "G:/projects/game/Engine3D/resources/shaders/mesh_vs.glsl";
+		const char* fragment_shader_path = "G:/projects/game/Engine3D/resources/shaders/shadow_map_fs.glsl";
+
+		compile_shader(&g_depth_prepass_shader, vertex_shader_path, fragment_shader_path, &TEMP_MEMORY);
+		g_depth_prepass_shader.vao = g_mesh_shader.vao;
+
+		u32 view_matrices_loc = get_uniform_block_index(&g_depth_prepass_shader, uniform_id("ViewMatrices"));
+		glUniformBlockBinding(g_depth_prepass_shader.id, view_matrices_loc, VIEW_MATRICES_UBO_BINDING);
+	}
+
+	// Init deferred shading shaders
+	{
+		const char* vertex_shader_path = "G:/projects/game/Engine3D/resources/shaders/mesh_vs.glsl";
+		const char* fragment_shader_path = "G:/projects/game/Engine3D/resources/shaders/mesh_gbuffer_fs.glsl";
+
+		compile_shader(&g_mesh_gbuffer_shader, vertex_shader_path, fragment_shader_path, &TEMP_MEMORY);
+
+		// Same vertex inputs as the forward mesh shader
+		g_mesh_gbuffer_shader.vao = g_mesh_shader.vao;
+
+		u32 view_matrices_loc = get_uniform_block_index(&g_mesh_gbuffer_shader, uniform_id("ViewMatrices"));
+		glUniformBlockBinding(g_mesh_gbuffer_shader.id, view_matrices_loc, VIEW_MATRICES_UBO_BINDING);
+
+		gl_use_program(g_mesh_gbuffer_shader.id);
+		glUniform1i(get_uniform_location(&g_mesh_gbuffer_shader, uniform_id("material.color_texture")), 0);
+		glUniform1i(get_uniform_location(&g_mesh_gbuffer_shader, uniform_id("material.specular_texture")), 1);
+		gl_use_program(0);
+	}
+	{
+		const char* vertex_shader_path = "G:/projects/game/Engine3D/resources/shaders/framebuffer_vs.glsl";
+		const char* lighting_include_path = "G:/projects/game/Engine3D/resources/shaders/lighting_common_fs.glsl";
+		const char* fragment_shader_path = "G:/projects/game/Engine3D/resources/shaders/deferred_lighting_fs.glsl";
+
+		compile_shader_with_include(&g_deferred_lighting_shader, vertex_shader_path, lighting_include_path, fragment_shader_path, &TEMP_MEMORY);
+
+		// Fullscreen quad of the scene framebuffer shader
+		g_deferred_lighting_shader.vao = g_scene_framebuffer_shader.vao;
+
+		SimpleShader* shader = &g_deferred_lighting_shader;
+		glUniformBlockBinding(shader->id, get_uniform_block_index(shader, uniform_id("ViewMatrices")), VIEW_MATRICES_UBO_BINDING);
+		glUniformBlockBinding(shader->id, get_uniform_block_index(shader, uniform_id("Lights")), LIGHTS_UBO_BINDING);
+
+		// Units 2 to 4 are shared with the forward mesh shader
+		gl_use_program(shader->id);
+		glUniform1i(get_uniform_location(shader, uniform_id("gbuffer_albedo")), 0);
+		glUniform1i(get_uniform_location(shader, uniform_id("gbuffer_normal_shininess")), 1);
+		glUniform1i(get_uniform_location(shader, uniform_id("shadow_atlas")), 2);
+		glUniform1i(get_uniform_location(shader, uniform_id("cluster_grid")), 3);
+		glUniform1i(get_uniform_location(shader, uniform_id("cluster_light_indices")), 4);
+		glUniform1i(get_uniform_location(shader, uniform_id("gbuffer_specular")), 5);
+		glUniform1i(get_uniform_location(shader, uniform_id("gbuffer_depth")), 6);
+		gl_use_program(0);
+	}
+
 	// Init shadow map shader
 	{
 		const char* vertex_shader_path = "G:/projects/game/Engine3D/resources/shaders/shadow_map_vs.glsl";
 		const char* fragment_shader_path = "G:/projects/game/Engine3D/resources/shaders/shadow_map_fs.glsl";
 
-		g_shdow_map_shader.id = compile_shader(vertex_shader_path, fragment_shader_path, &TEMP_MEMORY);
+		compile_shader(&g_shdow_map_shader, vertex_shader_path, fragment_shader_path, &TEMP_MEMORY);
 
 		glGenVertexArrays(1, &g_shdow_map_shader.vao);
-		glGenBuffers(1, &g_shdow_map_shader.vbo);
-		glBindVertexArray(g_shdow_map_shader.vao);
-		glBindBuffer(GL_ARRAY_BUFFER, g_shdow_map_shader.vbo);
+		gl_bind_vertex_array(g_shdow_map_shader.vao);
+		bind_primitive_geometry();
 
 		// Position attribute
 		glEnableVertexAttribArray(0);
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, PRIMITIVE_VERTEX_FLOATS * sizeof(float), (void*)0);
+
+		bind_mesh_instance_attributes(g_mesh_instances.vbo, 0);
 	}
 
 	// Init shadow map debug shader
@@ -903,12 +1239,12 @@ void init_all_shaders()
 		const char* vertex_shader_path = "G:/projects/game/Engine3D/resources/shaders/shadow_map_debug_vs.glsl";
 		const char* fragment_shader_path = "G:/projects/game/Engine3D/resources/shaders/shadow_map_debug_fs.glsl";
 
-		g_shdow_map_debug_shader.id = compile_shader(vertex_shader_path, fragment_shader_path, &TEMP_MEMORY);
+		compile_shader(&g_shdow_map_debug_shader, vertex_shader_path, fragment_shader_path, &TEMP_MEMORY);
 
 		unsigned int vbo;
 		glGenVertexArrays(1, &g_shdow_map_debug_shader.vao);
 		glGenBuffers(1, &vbo);
-		glBindVertexArray(g_shdow_map_debug_shader.vao);
+		gl_bind_vertex_array(g_shdow_map_debug_shader.vao);
 
 		float quadVertices[] = {
 			// Coords	   // Uv
@@ -921,7 +1257,7 @@ void init_all_shaders()
 			 1.0f,  1.0f,  1.0f, 1.0f
 		};
 
-		glBindBuffer(GL_ARRAY_BUFFER, vbo);
+		gl_bind_buffer(GL_ARRAY_BUFFER, vbo);
 		glBufferData(GL_ARRAY_BUFFER, sizeof(quadVertices), &quadVertices, GL_STATIC_DRAW);
 
 		glEnableVertexAttribArray(0);
@@ -934,120 +1270,195 @@ void init_all_shaders()
 
 void draw_shadow_map_debug_screen(s64 spotlight_index)
 {
-	glEnable(GL_DEPTH_TEST);
-	glViewport(0, 0, 500, 500);
-	glUseProgram(g_shdow_map_debug_shader.id);
-	glBindVertexArray(g_shdow_map_debug_shader.vao);
+	gl_enable(GL_DEPTH_TEST);
+	gl_viewport(0, 0, 500, 500);
+	gl_use_program(g_shdow_map_debug_shader.id);
+	gl_bind_vertex_array(g_shdow_map_debug_shader.vao);
 
 	float near_plane = 0.25f, far_plane = 15.0f;
-	unsigned int near_loc = glGetUniformLocation(g_shdow_map_debug_shader.id, "near_plane");
+	s32 near_loc = get_uniform_location(&g_shdow_map_debug_shader, uniform_id("near_plane"));
 	glUniform1f(near_loc, near_plane);
-	unsigned int far_loc = glGetUniformLocation(g_shdow_map_debug_shader.id, "far_plane");
+	s32 far_loc = get_uniform_location(&g_shdow_map_debug_shader, uniform_id("far_plane"));
 	glUniform1f(far_loc, far_plane);
 
 	Spotlight* sp = (Spotlight*)j_array_get(&g_scene.spotlights, spotlight_index);
 
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, sp->shadow_map.texture_gpu_id);
+	s32 tile_rect_loc = get_uniform_location(&g_shdow_map_debug_shader, uniform_id("tile_rect"));
+	glUniform4fv(tile_rect_loc, 1, glm::value_ptr(get_shadow_tile_uv_rect(&g_shadow_atlas, sp->shadow_tile)));
+
+	gl_active_texture(GL_TEXTURE0);
+	gl_bind_texture(GL_TEXTURE_2D, g_shadow_atlas.texture_id);
 
 	glDrawArrays(GL_TRIANGLES, 0, 6);
 	g_frame_data.draw_calls++;
 
-	glViewport(0, 0, g_game_metrics.scene_width_px, g_game_metrics.scene_height_px);
-	glUseProgram(0);
-	glBindVertexArray(0);
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	gl_viewport(0, 0, g_game_metrics.scene_width_px, g_game_metrics.scene_height_px);
+	gl_use_program(0);
+	gl_bind_vertex_array(0);
+	gl_bind_framebuffer(GL_FRAMEBUFFER, 0);
 }
 
-void append_ui_text(FontData* font_data, char* text, float pos_x_vw, float pos_y_vh)
+u32 pack_color_rgba8(glm::vec4 color)
+{
+	glm::vec4 clamped = glm::clamp(color, 0.0f, 1.0f) * 255.0f + 0.5f;
+	return (u32)clamped.r | ((u32)clamped.g << 8) | ((u32)clamped.b << 16) | ((u32)clamped.a << 24);
+}
+
+s64 layout_ui_text(TransientVertices* vertices, FontData* font_data, char* text, float pos_x_vw, float pos_y_vh, u32 color, s32* glyph_entries)
 {
-	auto chars = font_data->char_data.data();
 	char* text_string = text;
-	int length = strlen(text);
+	s64 glyphs_count = 0;
 
-	int text_offset_x_px = 0;
-	int text_offset_y_px = 0;
-	int line_height_px = font_data->font_height_px;
+	// Glyph metrics are in atlas pixels, scaled to the drawn font height
+	f32 scale = font_data->font_scale;
+	f32 text_offset_x_px = 0.0f;
+	f32 text_offset_y_px = 0.0f;
+	f32 line_height_px = font_data->font_height_px * scale;
 
-	glBindBuffer(GL_ARRAY_BUFFER, g_ui_text_shader.vbo);
+	f32 start_x_px = vw_into_screen_px(pos_x_vw, g_game_metrics.scene_width_px);
+	f32 start_y_px = vh_into_screen_px(pos_y_vh, g_game_metrics.scene_height_px);
+	f32 screen_width_px = static_cast<f32>(g_game_metrics.scene_width_px);
+	f32 screen_height_px = static_cast<f32>(g_game_metrics.scene_height_px);
 
-	for (int i = 0; i < length; i++)
+	while (*text_string != '\0')
 	{
-		char current_char = *text_string++;
+		u32 codepoint = utf8_next_codepoint(&text_string);
 
-		if (current_char == '\n')
+		if (codepoint == '\n')
 		{
 			text_offset_y_px -= line_height_px;
-			text_offset_x_px = 0;
+			text_offset_x_px = 0.0f;
 			continue;
 		}
 
-		int char_index = static_cast<int>(current_char) - 32;
-		CharData current = chars[char_index];
+		s32 entry_index = get_font_glyph_entry(font_data, codepoint);
+		if (entry_index < 0) continue;
 
-		// Assume font start position is top left corner
-		int char_height_px = current.height;
-		int char_width_px = current.width;
+		CharData current = font_data->glyphs[entry_index].char_data;
+
+		if (current.width == 0)
+		{
+			text_offset_x_px += current.advance * scale;
+			continue;
+		}
 
-		int x_start = vw_into_screen_px(pos_x_vw, g_game_metrics.scene_width_px) + current.x_offset + text_offset_x_px;
-		int char_y_offset = current.y_offset;
-		int y_start = vh_into_screen_px(pos_y_vh, g_game_metrics.scene_height_px) + text_offset_y_px - line_height_px + char_y_offset;
+		// Assume font start position is top left corner
+		f32 x_start = start_x_px + current.x_offset * scale + text_offset_x_px;
+		f32 y_start = start_y_px + text_offset_y_px - line_height_px + current.y_offset * scale;
 
-		float x0 = normalize_screen_px_to_ndc(x_start, g_game_metrics.scene_width_px);
-		float y0 = normalize_screen_px_to_ndc(y_start, g_game_metrics.scene_height_px);
+		float x0 = x_start / screen_width_px * 2.0f - 1.0f;
+		float y0 = y_start / screen_height_px * 2.0f - 1.0f;
 
-		float x1 = normalize_screen_px_to_ndc(x_start + char_width_px, g_game_metrics.scene_width_px);
-		float y1 = normalize_screen_px_to_ndc(y_start + char_height_px, g_game_metrics.scene_height_px);
+		float x1 = (x_start + current.width * scale) / screen_width_px * 2.0f - 1.0f;
+		float y1 = (y_start + current.height * scale) / screen_height_px * 2.0f - 1.0f;
 
-		float vertices[UI_CHAR_VERTICIES] =
+		UiTextVertex char_vertices[UI_CHAR_VERTICIES] =
 		{
-			// Coords			// UV
-			x0, y1, 0.0f,		current.UV_x0, current.UV_y1, // top left
-			x0, y0, 0.0f,		current.UV_x0, current.UV_y0, // bottom left
-			x1, y0, 0.0f,		current.UV_x1, current.UV_y0, // bottom right
-
-			x1, y1, 0.0f,		current.UV_x1, current.UV_y1, // top right
-			x0, y1, 0.0f,		current.UV_x0, current.UV_y1, // top left 
-			x1, y0, 0.0f,		current.UV_x1, current.UV_y0  // bottom right
+			// Coords				 // UV
+			{ { x0, y1, 0.0f },	{ current.UV_x0, current.UV_y1 }, color }, // top left
+			{ { x0, y0, 0.0f },	{ current.UV_x0, current.UV_y0 }, color }, // bottom left
+			{ { x1, y0, 0.0f },	{ current.UV_x1, current.UV_y0 }, color }, // bottom right
+
+			{ { x1, y1, 0.0f },	{ current.UV_x1, current.UV_y1 }, color }, // top right
+			{ { x0, y1, 0.0f },	{ current.UV_x0, current.UV_y1 }, color }, // top left
+			{ { x1, y0, 0.0f },	{ current.UV_x1, current.UV_y0 }, color }  // bottom right
 		};
 
-		s64 bytes_offset = g_ui_chars_buffered * UI_CHAR_VERTICIES * sizeof(float);
-		glBufferSubData(GL_ARRAY_BUFFER, bytes_offset, sizeof(vertices), vertices);
-
-		g_ui_chars_buffered++;
-		text_offset_x_px += current.advance;
-		text++;
+		transient_vertices_push(vertices, char_vertices, UI_CHAR_VERTICIES);
+		if (glyph_entries != nullptr) glyph_entries[glyphs_count] = entry_index;
+		text_offset_x_px += current.advance * scale;
+		glyphs_count++;
 	}
 
-	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	return glyphs_count;
+}
+
+void append_ui_text(FontData* font_data, char* text, float pos_x_vw, float pos_y_vh, glm::vec4 color)
+{
+	u32 packed_color = pack_color_rgba8(color);
+	u64 key = text_layout_key(font_data, text, pos_x_vw, pos_y_vh, packed_color);
+
+	if (text_layout_cache_get(&g_text_layout_cache, font_data, key, &g_ui_text_vertices)) return;
+
+	// Text with more glyphs than the cache holds is laid out without recording them
+	s32* glyph_entries = (s64)strlen(text) <= g_text_layout_cache.glyphs_capacity ? g_text_layout_cache.layout_glyph_entries : nullptr;
+	s64 first_vertex = g_ui_text_vertices.vertices_count;
+	layout_ui_text(&g_ui_text_vertices, font_data, text, pos_x_vw, pos_y_vh, packed_color, glyph_entries);
+
+	if (glyph_entries == nullptr) return;
+
+	UiTextVertex* run_vertices = (UiTextVertex*)g_ui_text_vertices.memory.memory + first_vertex;
+	s64 run_vertices_count = g_ui_text_vertices.vertices_count - first_vertex;
+	text_layout_cache_put(&g_text_layout_cache, font_data, key, run_vertices, glyph_entries, run_vertices_count);
 }
 
-void draw_ui_text(FontData* font_data, float red, float green, float blue)
+void draw_ui_text(FontData* font_data)
 {
-	glUseProgram(g_ui_text_shader.id);
-	glBindVertexArray(g_ui_text_shader.vao);
+	if (g_ui_text_vertices.vertices_count == 0) return;
 
-	int color_uniform = glGetUniformLocation(g_ui_text_shader.id, "textColor");
-	glUniform3f(color_uniform, red, green, blue);
+	gl_use_program(g_ui_text_shader.id);
+	gl_bind_vertex_array(g_ui_text_shader.vao);
 
-	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-	glBindTexture(GL_TEXTURE_2D, font_data->texture_id);
+	// Glyph quads are padded by the distance field spread and overlap their neighbours
+	gl_disable(GL_DEPTH_TEST);
+	gl_blend_func(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	gl_bind_texture(GL_TEXTURE_2D, font_data->texture_id);
 
-	s64 indicies = g_ui_chars_buffered * 6;
-	glDrawArrays(GL_TRIANGLES, 0, indicies);
+	s64 first_vertex = stream_buffer_upload(&g_stream_buffer, &g_ui_text_vertices);
+	glDrawArrays(GL_TRIANGLES, first_vertex, g_ui_text_vertices.vertices_count);
 
-	g_ui_chars_buffered = 0;
+	transient_vertices_clear(&g_ui_text_vertices);
 	g_frame_data.draw_calls++;
 
-	glUseProgram(0);
-	glBindVertexArray(0);
+	gl_enable(GL_DEPTH_TEST);
+	gl_use_program(0);
+	gl_bind_vertex_array(0);
+}
+
+void run_ui_text_benchmark()
+{
+	constexpr const s64 bench_lines = 1000;
+	constexpr const s64 bench_iterations = 20;
+	const char* bench_line = "Shadow maps cached 12, redrawn 3, casters 456 - The quick brown fox 0123456789\n";
+
+	s64 line_length = strlen(bench_line);
+	s64 text_length = line_length * bench_lines;
+
+	MemoryBuffer bench_memory = {};
+	memory_buffer_mallocate(&bench_memory, text_length + 1, const_cast<char*>("UI text benchmark"));
+	char* bench_text = (char*)bench_memory.memory;
+
+	for (s64 i = 0; i < bench_lines; i++)
+	{
+		memcpy(bench_text + i * line_length, bench_line, line_length);
+	}
+
+	TransientVertices bench_vertices = {};
+	transient_vertices_init(&bench_vertices, sizeof(UiTextVertex), text_length * UI_CHAR_VERTICIES, const_cast<char*>("UI text benchmark vertices"));
+
+	u32 color = pack_color_rgba8(glm::vec4(0.9f, 0.9f, 0.9f, 1.0f));
+	s64 glyphs_count = 0;
+	f64 start_time = glfwGetTime();
+
+	for (s64 i = 0; i < bench_iterations; i++)
+	{
+		transient_vertices_clear(&bench_vertices);
+		glyphs_count = layout_ui_text(&bench_vertices, &g_debug_font, bench_text, 0.5f, 100.0f, color, nullptr);
+	}
+
+	f64 layout_ms = (glfwGetTime() - start_time) * 1000.0 / bench_iterations;
+
+	printf("UI text layout %lld glyphs: %.3f ms, %.1f glyphs/ms.\n", glyphs_count, layout_ms, (f64)glyphs_count / layout_ms);
+
+	memory_buffer_free(&bench_vertices.memory);
+	memory_buffer_free(&bench_memory);
 }
 
 unsigned int load_cubemap()
 {
 	unsigned int texture_id;
 	glGenTextures(1, &texture_id);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, texture_id);
+	gl_bind_texture(GL_TEXTURE_CUBE_MAP, texture_id);
 
 	const s64 cube_faces = 6;
 	const char* cubemaps[cube_faces] = {
@@ -1079,24 +1490,24 @@ unsigned int load_cubemap()
 
 void draw_skybox()
 {
-	glDepthMask(GL_FALSE);
-	glUseProgram(g_skybox_shader.id);
+	gl_depth_mask(GL_FALSE);
+	gl_use_program(g_skybox_shader.id);
 
 	glm::mat4 projection = get_projection_matrix();
 	glm::mat4 view = get_view_matrix();
 	glm::mat4 view_matrix = glm::mat3(view);
 
-	unsigned int view_loc = glGetUniformLocation(g_skybox_shader.id, "view");
-	unsigned int projection_loc = glGetUniformLocation(g_skybox_shader.id, "projection");
+	s32 view_loc = get_uniform_location(&g_skybox_shader, uniform_id("view"));
+	s32 projection_loc = get_uniform_location(&g_skybox_shader, uniform_id("projection"));
 
 	glUniformMatrix4fv(view_loc, 1, GL_FALSE, glm::value_ptr(view_matrix));
 	glUniformMatrix4fv(projection_loc, 1, GL_FALSE, glm::value_ptr(projection));
 
-	glBindVertexArray(g_skybox_shader.vao);
+	gl_bind_vertex_array(g_skybox_shader.vao);
 
-	glBindTexture(GL_TEXTURE_CUBE_MAP, g_skybox_cubemap);
+	gl_bind_texture(GL_TEXTURE_CUBE_MAP, g_skybox_cubemap);
 	glDrawArrays(GL_TRIANGLES, 0, 36);
-	glDepthMask(GL_TRUE);
+	gl_depth_mask(GL_TRUE);
 }
 
 int load_image_into_texture_id(char* image_path)
@@ -1108,7 +1519,7 @@ int load_image_into_texture_id(char* image_path)
 	ASSERT_TRUE(im_data.channels == 3 || im_data.channels == 4, "Image format is RGB or RGBA");
 
 	glGenTextures(1, &texture);
-	glBindTexture(GL_TEXTURE_2D, texture);
+	gl_bind_texture(GL_TEXTURE_2D, texture);
 
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
@@ -1136,68 +1547,258 @@ int load_image_into_texture_id(char* image_path)
 	return texture;
 }
 
+u32 load_images_into_texture_array(const char** image_paths, s64 images_count)
+{
+	// Every layer has the size of the first image
+	u32 texture;
+	glGenTextures(1, &texture);
+	gl_bind_texture(GL_TEXTURE_2D_ARRAY, texture);
+	flip_vertical_image_load(true);
+	ImageData first_image = {};
+
+	for (s64 i = 0; i < images_count; i++)
+	{
+		char path_str[FILE_PATH_LEN] = { 0 };
+		strcpy_s(path_str, image_paths[i]);
+		ImageData im_data = load_image_data(path_str);
+
+		ASSERT_TRUE(im_data.channels == 3 || im_data.channels == 4, "Image format is RGB or RGBA");
+
+		if (i == 0)
+		{
+			first_image = im_data;
+			glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA, im_data.width_px, im_data.height_px, images_count, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+		}
+
+		ASSERT_TRUE(im_data.width_px == first_image.width_px && im_data.height_px == first_image.height_px, "Texture array layer has the size of the first image");
+		ASSERT_TRUE(im_data.channels == first_image.channels, "Texture array layer has the channels of the first image");
+
+		GLint use_format = im_data.channels == 3 ? GL_RGB : GL_RGBA;
+		glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, i, im_data.width_px, im_data.height_px, 1, use_format, GL_UNSIGNED_BYTE, im_data.image_data);
+		free_loaded_image(im_data);
+	}
+
+	GLint filtering_mode = g_use_linear_texture_filtering ? GL_LINEAR : GL_NEAREST;
+
+	GLint mipmap_filtering_mode = g_use_linear_texture_filtering
+		? GL_LINEAR_MIPMAP_LINEAR
+		: GL_NEAREST_MIPMAP_NEAREST;
+
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, filtering_mode);
+
+	if (g_generate_texture_mipmaps)
+	{
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, mipmap_filtering_mode);
+		glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+	}
+	else glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, filtering_mode);
+
+	return texture;
+}
+
 void update_ubos()
 {
-	glBindBuffer(GL_UNIFORM_BUFFER, g_view_proj_ubo);
+	PROFILE_ZONE("Update UBOs");
+	gl_bind_buffer(GL_UNIFORM_BUFFER, g_view_proj_ubo);
 	auto projection = get_projection_matrix();
 	auto view = get_view_matrix();
 	glBufferSubData(GL_UNIFORM_BUFFER, 0,				  sizeof(glm::mat4), glm::value_ptr(projection));
 	glBufferSubData(GL_UNIFORM_BUFFER, sizeof(glm::mat4), sizeof(glm::mat4), glm::value_ptr(view));
-	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	g_frame_data.bytes_uploaded += SIZEOF_VIEW_MATRICES;
+	gl_bind_buffer(GL_UNIFORM_BUFFER, 0);
+
+	update_lights_ubo();
+	update_light_clusters();
+}
+
+void mark_shadows_dirty_in_bounds(Aabb bounds)
+{
+	for (int i = 0; i < g_scene.spotlights.items_count; i++)
+	{
+		Spotlight* spotlight = (Spotlight*)j_array_get(&g_scene.spotlights, i);
+		if (spotlight->shadow_dirty) continue;
+
+		Frustum light_frustum = frustum_from_matrix(get_spotlight_light_space_matrix(*spotlight));
+		if (aabb_in_frustum(bounds, &light_frustum)) spotlight->shadow_dirty = true;
+	}
+}
+
+void mark_mesh_shadows_dirty(Mesh* mesh)
+{
+	// The cached bounds still describe where the mesh was before the edit
+	if (transforms_equal(&mesh->transforms, &mesh->bounds_transforms)) return;
+
+	Aabb old_bounds = mesh->bounds;
+	Aabb new_bounds = get_mesh_world_bounds(mesh);
+	mark_shadows_dirty_in_bounds(old_bounds);
+	mark_shadows_dirty_in_bounds(new_bounds);
 }
 
 void draw_shadow_map_framebuffers()
 {
-	glUseProgram(g_shdow_map_shader.id);
-	glViewport(0, 0, SHADOW_MAP_WIDTH, SHADOW_MAP_HEIGHT);
+	gl_use_program(g_shdow_map_shader.id);
+	gl_bind_framebuffer(GL_FRAMEBUFFER, g_shadow_atlas.framebuffer_id);
+
+	// Depth clears are limited to the tile by the scissor
+	gl_enable(GL_SCISSOR_TEST);
 
 	for (int i = 0; i < g_scene.spotlights.items_count; i++)
 	{
 		Spotlight* spotlight = (Spotlight*)j_array_get(&g_scene.spotlights, i);
+
+		if (!spotlight->shadow_dirty || spotlight->shadow_tile.size_px == 0)
+		{
+			g_frame_data.shadow_cache_hits++;
+			continue;
+		}
+
+		spotlight->shadow_dirty = false;
+		g_frame_data.shadow_cache_misses++;
+
 		glm::mat4 light_space_matrix = get_spotlight_light_space_matrix(*spotlight);
 
-		unsigned int light_matrix_loc = glGetUniformLocation(g_shdow_map_shader.id, "lightSpaceMatrix");
+		s32 light_matrix_loc = get_uniform_location(&g_shdow_map_shader, uniform_id("lightSpaceMatrix"));
 		glUniformMatrix4fv(light_matrix_loc, 1, GL_FALSE, glm::value_ptr(light_space_matrix));
 
-		glBindFramebuffer(GL_FRAMEBUFFER, spotlight->shadow_map.id);
+		ShadowAtlasTile tile = spotlight->shadow_tile;
+		gl_viewport(tile.x_px, tile.y_px, tile.size_px, tile.size_px);
+		glScissor(tile.x_px, tile.y_px, tile.size_px, tile.size_px);
 		glClear(GL_DEPTH_BUFFER_BIT);
 
-		glUseProgram(g_shdow_map_shader.id);
-		glBindVertexArray(g_shdow_map_shader.vao);
-		glCullFace(GL_BACK);
+		gl_use_program(g_shdow_map_shader.id);
+		gl_bind_vertex_array(g_shdow_map_shader.vao);
+		draw_mesh_instances_shadow_map(spotlight);
+	}
 
-		// Disable for planes
-		for (int i = 0; i < g_scene.planes.items_count; i++)
-		{
-			Mesh plane = *(Mesh*)j_array_get(&g_scene.planes, i);
-			draw_mesh_shadow_map(&plane, spotlight);
-		}
+	gl_disable(GL_SCISSOR_TEST);
+	gl_use_program(0);
+	gl_bind_vertex_array(0);
+	gl_bind_framebuffer(GL_FRAMEBUFFER, 0);
+	gl_viewport(0, 0, g_game_metrics.scene_width_px, g_game_metrics.scene_height_px);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	gl_cull_face(GL_BACK);
+}
 
-		glCullFace(GL_FRONT);
+void draw_depth_prepass()
+{
+	SimpleShader* shader = &g_depth_prepass_shader;
+	gl_use_program(shader->id);
+	gl_bind_vertex_array(shader->vao);
+	glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
 
-		for (int i = 0; i < g_scene.meshes.items_count; i++)
-		{
-			Mesh mesh = *(Mesh*)j_array_get(&g_scene.meshes, i);
-			draw_mesh_shadow_map(&mesh, spotlight);
-		}
+	// Visible batches of a type are contiguous (see get_mesh_batch_key()), so one draw covers each type
+	s64 first_instance[PRIMITIVE_MESH_TYPES_COUNT];
+	s64 end_instance[PRIMITIVE_MESH_TYPES_COUNT] = { 0 };
+
+	for (int i = 0; i < g_mesh_instances.batches.items_count; i++)
+	{
+		MeshBatch* batch = (MeshBatch*)j_array_get(&g_mesh_instances.batches, i);
+		if (!batch->is_visible) continue;
+
+		s64 type_index = (s64)batch->mesh_type;
+		if (end_instance[type_index] == 0) first_instance[type_index] = batch->first_instance;
+		end_instance[type_index] = batch->first_instance + batch->instances_count;
 	}
 
-	glUseProgram(0);
-	glBindVertexArray(0);
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
-	glViewport(0, 0, g_game_metrics.scene_width_px, g_game_metrics.scene_height_px);
-	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-	glCullFace(GL_BACK);
+	for (int i = 0; i < PRIMITIVE_MESH_TYPES_COUNT; i++)
+	{
+		if (end_instance[i] == 0) continue;
+
+		bind_mesh_instance_attributes(g_mesh_instances.vbo, first_instance[i]);
+		draw_primitive_instanced((MeshType)i, end_instance[i] - first_instance[i]);
+	}
+
+	glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+	gl_use_program(0);
+	gl_bind_vertex_array(0);
+}
+
+void draw_forward_meshes()
+{
+	bool use_depth_prepass = g_user_settings.use_depth_prepass;
+
+	if (use_depth_prepass)
+	{
+		// Zone inside the scene pass, not sampled while the pre-pass is off
+		gpu_profiler_begin_pass(&g_gpu_profiler, "Depth pre-pass");
+		draw_depth_prepass();
+		gpu_profiler_end_pass(&g_gpu_profiler);
+
+		// Only the front-most fragment of each pixel passes and runs the lighting
+		gl_depth_func(GL_EQUAL);
+		gl_depth_mask(GL_FALSE);
+	}
+
+	gpu_profiler_begin_pass(&g_gpu_profiler, "Forward lit");
+	render_queue_clear(&g_scene_render_queue);
+	submit_mesh_batches(&g_scene_render_queue, &g_mesh_shader);
+	render_queue_sort(&g_scene_render_queue);
+	render_queue_execute(&g_scene_render_queue);
+	gpu_profiler_end_pass(&g_gpu_profiler);
+
+	gl_depth_func(GL_LESS);
+	gl_depth_mask(GL_TRUE);
+}
+
+void draw_gbuffer()
+{
+	gl_enable(GL_DEPTH_TEST);
+
+	render_queue_clear(&g_scene_render_queue);
+	submit_mesh_batches(&g_scene_render_queue, &g_mesh_gbuffer_shader);
+	render_queue_sort(&g_scene_render_queue);
+	render_queue_execute(&g_scene_render_queue);
+}
+
+void draw_deferred_lighting()
+{
+	SimpleShader* shader = &g_deferred_lighting_shader;
+	glm::mat4 inverse_view_projection = glm::inverse(get_projection_matrix() * get_view_matrix());
+
+	// Every covered pixel is shaded once, by the lights of its cluster
+	gl_disable(GL_DEPTH_TEST);
+	gl_use_program(shader->id);
+	gl_bind_vertex_array(shader->vao);
+	glUniformMatrix4fv(get_uniform_location(shader, uniform_id("inverse_view_projection")), 1, GL_FALSE, glm::value_ptr(inverse_view_projection));
+
+	gl_active_texture(GL_TEXTURE0);
+	gl_bind_texture(GL_TEXTURE_2D, g_gbuffer_target->color_textures[0]);
+	gl_active_texture(GL_TEXTURE1);
+	gl_bind_texture(GL_TEXTURE_2D, g_gbuffer_target->color_textures[1]);
+	gl_active_texture(GL_TEXTURE5);
+	gl_bind_texture(GL_TEXTURE_2D, g_gbuffer_target->color_textures[2]);
+	gl_active_texture(GL_TEXTURE6);
+	gl_bind_texture(GL_TEXTURE_2D, g_gbuffer_target->depth_texture);
+	gl_active_texture(GL_TEXTURE0);
+
+	glDrawArrays(GL_TRIANGLES, 0, 6);
+	g_frame_data.draw_calls++;
+
+	gl_use_program(0);
+	gl_bind_vertex_array(0);
+	gl_enable(GL_DEPTH_TEST);
+
+	// Lines and billboards are depth tested against the G-buffer geometry
+	s32 width = g_game_metrics.scene_width_px;
+	s32 height = g_game_metrics.scene_height_px;
+	gl_bind_framebuffer(GL_READ_FRAMEBUFFER, g_gbuffer_target->id);
+	gl_bind_framebuffer(GL_DRAW_FRAMEBUFFER, g_scene_target->id);
+	glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+	gl_bind_framebuffer(GL_FRAMEBUFFER, g_scene_target->id);
 }
 
 void draw_scene_framebuffer()
 {
-	glBindFramebuffer(GL_FRAMEBUFFER, g_scene_framebuffer.id);
-	glEnable(GL_DEPTH_TEST);
-	glClearColor(0.2f, 0.31f, 0.3f, 1.0f);
-	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	bool use_deferred_shading = g_user_settings.use_deferred_shading;
+
+	bind_shadow_atlas();
+	bind_light_clusters();
+	gl_enable(GL_DEPTH_TEST);
 
 	if (g_user_settings.use_skybox) draw_skybox();
+	if (use_deferred_shading) draw_deferred_lighting();
 
 	// Coordinate lines
 	append_line(glm::vec3(-1000.0f, 0.0f, 0.0f), glm::vec3(1000.0f, 0.0f, 0.0f), glm::vec3(1.0f, 0.0f, 0.0f));
@@ -1205,44 +1806,41 @@ void draw_scene_framebuffer()
 	append_line(glm::vec3(0.0f, 0.0f, -1000.0f), glm::vec3(0.0f, 0.0f, 1000.0f), glm::vec3(0.0f, 0.0f, 1.0f));
 	draw_lines(1.0f);
 
-	for (int i = 0; i < g_scene.planes.items_count; i++)
-	{
-		Mesh plane = *(Mesh*)j_array_get(&g_scene.planes, i);
-		draw_mesh(&plane);
-	}
+	if (!use_deferred_shading) draw_forward_meshes();
 
-	for (int i = 0; i < g_scene.meshes.items_count; i++)
-	{
-		Mesh mesh = *(Mesh*)j_array_get(&g_scene.meshes, i);
-		draw_mesh(&mesh);
-	}
+	render_queue_clear(&g_scene_render_queue);
 
 	// Pointlights
 	for (int i = 0; i < g_scene.pointlights.items_count; i++)
 	{
+		if (!g_scene_visibility.is_visible[g_scene_visibility.pointlights_offset + i]) continue;
+
 		auto light = *(Pointlight*)j_array_get(&g_scene.pointlights, i);
-		draw_billboard(light.transforms.translation, pointlight_texture, 0.5f);
+		billboard_batch_add(&g_billboard_batch, light.transforms.translation, BillboardLayer::Pointlight, 0.5f);
 	}
 
 	// Spotlights
 	for (int i = 0; i < g_scene.spotlights.items_count; i++)
 	{
+		if (!g_scene_visibility.is_visible[g_scene_visibility.spotlights_offset + i]) continue;
+
 		auto spotlight = *(Spotlight*)j_array_get(&g_scene.spotlights, i);
-		draw_billboard(spotlight.transforms.translation, spotlight_texture, 0.5f);
+		billboard_batch_add(&g_billboard_batch, spotlight.transforms.translation, BillboardLayer::Spotlight, 0.5f);
 		glm::vec3 sp_dir = get_spotlight_dir(spotlight);
 		append_line(spotlight.transforms.translation, spotlight.transforms.translation + sp_dir, spotlight.diffuse);
 	}
 
+	submit_billboard_batch(&g_scene_render_queue, &g_billboard_batch);
+	render_queue_sort(&g_scene_render_queue);
+	render_queue_execute(&g_scene_render_queue);
+
 	draw_lines(2.0f);
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	gl_bind_framebuffer(GL_FRAMEBUFFER, 0);
 }
 
 void draw_editor_framebuffer()
 {
-	glBindFramebuffer(GL_FRAMEBUFFER, editor_framebuffer.id);
-	glEnable(GL_DEPTH_TEST);
-	glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
-	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	gl_enable(GL_DEPTH_TEST);
 
 	// Transformation mode debug lines
 	if (has_object_selection() && g_transform_mode.is_active)
@@ -1303,34 +1901,110 @@ void draw_editor_framebuffer()
 		}
 	}
 
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	gl_bind_framebuffer(GL_FRAMEBUFFER, 0);
 }
 
 void draw_main_framebuffer()
 {
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
-	glDisable(GL_DEPTH_TEST);
-	glClear(GL_COLOR_BUFFER_BIT);
+	u32 scene_texture_id = g_scene_target->color_textures[0];
+	RenderTarget* blurred_target = nullptr;
+
+	if (g_pp_settings.blur_effect)
+	{
+		// Blur amount is in thousandths of the scene width
+		f32 blur_radius_px = g_pp_settings.blur_effect_amount * 0.001f * g_game_metrics.scene_width_px;
+		blurred_target = blur_texture(&g_render_target_pool, scene_texture_id, g_game_metrics.scene_width_px, g_game_metrics.scene_height_px, blur_radius_px);
+		scene_texture_id = blurred_target->color_textures[0];
+	}
+
+	// Blurring binds its own targets
+	gl_bind_framebuffer(GL_FRAMEBUFFER, 0);
+	gl_disable(GL_DEPTH_TEST);
 
-	glUseProgram(g_scene_framebuffer_shader.id);
-	glBindVertexArray(g_scene_framebuffer_shader.vao);
+	gl_use_program(g_scene_framebuffer_shader.id);
+	gl_bind_vertex_array(g_scene_framebuffer_shader.vao);
 
-	unsigned int inversion_loc = glGetUniformLocation(g_scene_framebuffer_shader.id, "use_inversion");
-	unsigned int blur_loc = glGetUniformLocation(g_scene_framebuffer_shader.id, "use_blur");
-	unsigned int blur_amount_loc = glGetUniformLocation(g_scene_framebuffer_shader.id, "blur_amount");
-	unsigned int gamma_amount_loc = glGetUniformLocation(g_scene_framebuffer_shader.id, "gamma_amount");
+	SimpleShader* shader = &g_scene_framebuffer_shader;
+	s32 inversion_loc = get_uniform_location(shader, uniform_id("use_inversion"));
+	s32 gamma_amount_loc = get_uniform_location(shader, uniform_id("gamma_amount"));
 
 	glUniform1i(inversion_loc, g_pp_settings.inverse_color);
-	glUniform1i(blur_loc, g_pp_settings.blur_effect);
-	glUniform1f(blur_amount_loc, g_pp_settings.blur_effect_amount);
 	glUniform1f(gamma_amount_loc, g_pp_settings.gamma_amount);
 
-	glBindTexture(GL_TEXTURE_2D, g_scene_framebuffer.texture_gpu_id);
+	gl_bind_texture(GL_TEXTURE_2D, scene_texture_id);
 	glDrawArrays(GL_TRIANGLES, 0, 6);
 
-	glUniform1i(inversion_loc, false);
-	glUniform1i(blur_loc, false);
-	glBindTexture(GL_TEXTURE_2D, editor_framebuffer.texture_gpu_id);
-	glDrawArrays(GL_TRIANGLES, 0, 6);
-	glEnable(GL_DEPTH_TEST);
+	// Culled from the graph when there is nothing to overlay
+	if (g_editor_target != nullptr)
+	{
+		glUniform1i(inversion_loc, false);
+		gl_bind_texture(GL_TEXTURE_2D, g_editor_target->color_textures[0]);
+		glDrawArrays(GL_TRIANGLES, 0, 6);
+	}
+
+	gl_enable(GL_DEPTH_TEST);
+
+	if (blurred_target != nullptr) render_target_release(&g_render_target_pool, blurred_target);
+}
+
+void build_frame_graph(FrameGraph* graph)
+{
+	s32 width_px = g_game_metrics.scene_width_px;
+	s32 height_px = g_game_metrics.scene_height_px;
+	bool use_deferred_shading = g_user_settings.use_deferred_shading;
+	bool has_editor_overlay = has_object_selection();
+	glm::vec4 no_color = glm::vec4(0.0f);
+
+	RenderTargetDesc scene_desc = {
+		.width_px = width_px,
+		.height_px = height_px,
+		.color_formats = { GL_RGBA8 },
+		.depth_format = GL_DEPTH24_STENCIL8
+	};
+
+	// Albedo, world normal with shininess in alpha, specular texture times specular_mult.
+	// Depth has the scene format, so it can be blitted over after lighting.
+	RenderTargetDesc gbuffer_desc = {
+		.width_px = width_px,
+		.height_px = height_px,
+		.color_formats = { GL_RGBA8, GL_RGBA16F, GL_RGBA16F },
+		.depth_format = GL_DEPTH24_STENCIL8
+	};
+
+	s64 backbuffer = frame_graph_import(graph, "Backbuffer", FrameGraphResourceType::Backbuffer);
+	s64 shadow_atlas = frame_graph_import(graph, "Shadow atlas", FrameGraphResourceType::External);
+	s64 scene = frame_graph_create_target(graph, "Scene", scene_desc, &g_scene_target);
+	s64 editor = frame_graph_create_target(graph, "Editor", scene_desc, &g_editor_target);
+	s64 gbuffer = frame_graph_create_target(graph, "G-buffer", gbuffer_desc, &g_gbuffer_target);
+
+	// Tiles are cached between frames, so the shadow pass always runs
+	s64 shadow_pass = frame_graph_add_pass(graph, "Shadow maps", draw_shadow_map_framebuffers);
+	frame_graph_write(graph, shadow_pass, shadow_atlas, no_color);
+	frame_graph_set_side_effects(graph, shadow_pass);
+
+	if (use_deferred_shading)
+	{
+		s64 gbuffer_pass = frame_graph_add_pass(graph, "G-buffer", draw_gbuffer);
+		frame_graph_write(graph, gbuffer_pass, gbuffer, no_color);
+	}
+
+	s64 scene_pass = frame_graph_add_pass(graph, "Scene", draw_scene_framebuffer);
+	frame_graph_read(graph, scene_pass, shadow_atlas);
+	if (use_deferred_shading) frame_graph_read(graph, scene_pass, gbuffer);
+	frame_graph_write(graph, scene_pass, scene, glm::vec4(0.2f, 0.31f, 0.3f, 1.0f));
+
+	s64 editor_pass = frame_graph_add_pass(graph, "Editor", draw_editor_framebuffer);
+	frame_graph_write(graph, editor_pass, editor, no_color);
+
+	s64 main_pass = frame_graph_add_pass(graph, "Main", draw_main_framebuffer);
+	frame_graph_read(graph, main_pass, scene);
+	if (has_editor_overlay) frame_graph_read(graph, main_pass, editor);
+	frame_graph_write(graph, main_pass, backbuffer, no_color);
+
+	if (DEBUG_SHADOWMAP && g_selected_object.type == ObjectType::Spotlight)
+	{
+		s64 debug_pass = frame_graph_add_pass(graph, "Shadow map debug", draw_selected_shadow_map);
+		frame_graph_read(graph, debug_pass, shadow_atlas);
+		frame_graph_write(graph, debug_pass, backbuffer, no_color);
+	}
 }
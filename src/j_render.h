@@ -3,19 +3,53 @@
 #include <glad/glad.h>
 
 #include "j_buffers.h"
+#include "j_strings.h"
 #include "structs.h"
+#include "j_render_queue.h"
+#include "j_stream_buffer.h"
+#include "j_frame_graph.h"
+
+// Uniform names hashed at compile time
+consteval u32 uniform_id(const char* name)
+{
+	return str_hash(name);
+}
 
 bool check_shader_compile_error(GLuint shader);
 
 bool check_shader_link_error(GLuint shader);
 
-int compile_shader(const char* vertex_shader_path, const char* fragment_shader_path, MemoryBuffer* buffer);
+void compile_shader(SimpleShader* shader, const char* vertex_shader_path, const char* fragment_shader_path, MemoryBuffer* buffer);
+
+void compile_shader_with_include(SimpleShader* shader, const char* vertex_shader_path, const char* fragment_include_path, const char* fragment_shader_path, MemoryBuffer* buffer);
+
+void reflect_shader_uniforms(SimpleShader* shader);
+
+s32 get_uniform_location(SimpleShader* shader, u32 name_hash);
+
+u32 get_uniform_block_index(SimpleShader* shader, u32 name_hash);
+
+void init_primitive_geometry();
+
+void bind_primitive_geometry();
+
+void draw_primitive(MeshType mesh_type);
+
+void draw_primitive_instanced(MeshType mesh_type, s64 instances_count);
+
+void init_mesh_instances();
 
-void draw_billboard(glm::vec3 position, Texture texture, float scale);
+void bind_mesh_instance_attributes(u32 instances_vbo, s64 first_instance);
 
-void draw_mesh_shadow_map(Mesh* mesh, Spotlight* spotlight);
+void build_mesh_instances();
 
-void draw_mesh(Mesh* mesh);
+void billboard_batch_add(BillboardBatch* batch, glm::vec3 position, BillboardLayer layer, f32 scale);
+
+void submit_billboard_batch(RenderQueue* queue, BillboardBatch* batch);
+
+void draw_mesh_instances_shadow_map(Spotlight* spotlight);
+
+void submit_mesh_batches(RenderQueue* queue, SimpleShader* shader);
 
 void draw_mesh_wireframe(Mesh* mesh, glm::vec3 color);
 
@@ -29,9 +63,16 @@ void init_all_shaders();
 
 void draw_shadow_map_debug_screen(s64 spotlight_index);
 
-void append_ui_text(FontData* font_data, char* text, float pos_x_vw, float pos_y_vh);
+u32 pack_color_rgba8(glm::vec4 color);
+
+// Records the glyph cache entry of every laid out quad into glyph_entries unless it is null
+s64 layout_ui_text(TransientVertices* vertices, FontData* font_data, char* text, float pos_x_vw, float pos_y_vh, u32 color, s32* glyph_entries);
+
+void append_ui_text(FontData* font_data, char* text, float pos_x_vw, float pos_y_vh, glm::vec4 color);
 
-void draw_ui_text(FontData* font_data, float red, float green, float blue);
+void draw_ui_text(FontData* font_data);
+
+void run_ui_text_benchmark();
 
 unsigned int load_cubemap();
 
@@ -43,8 +84,14 @@ void draw_simple_rects();
 
 int load_image_into_texture_id(char* image_path);
 
+u32 load_images_into_texture_array(const char** image_paths, s64 images_count);
+
 void update_ubos();
 
+void mark_shadows_dirty_in_bounds(Aabb bounds);
+
+void mark_mesh_shadows_dirty(Mesh* mesh);
+
 void draw_shadow_map_framebuffers();
 
 void draw_scene_framebuffer();
@@ -52,3 +99,5 @@ void draw_scene_framebuffer();
 void draw_editor_framebuffer();
 
 void draw_main_framebuffer();
+
+void build_frame_graph(FrameGraph* graph);
@@ -0,0 +1,180 @@
+#include "j_render_queue.h"
+
+#include <glad/glad.h>
+#include <glm/gtc/type_ptr.hpp>
+
+#include "j_assert.h"
+#include "j_render.h"
+#include "globals.h"
+
+RenderQueue render_queue_init(MemoryBuffer* memory, s64 max_packets)
+{
+	MemoryBuffer packets_memory = memory_buffer_suballocate(memory, sizeof(DrawPacket) * max_packets);
+	MemoryBuffer entries_memory = memory_buffer_suballocate(memory, sizeof(RenderQueueEntry) * max_packets);
+	MemoryBuffer scratch_memory = memory_buffer_suballocate(memory, sizeof(RenderQueueEntry) * max_packets);
+
+	RenderQueue queue = {
+		.packets = j_array_init(max_packets, sizeof(DrawPacket), packets_memory.memory),
+		.entries = (RenderQueueEntry*)entries_memory.memory,
+		.sort_scratch = (RenderQueueEntry*)scratch_memory.memory,
+	};
+	return queue;
+}
+
+u64 render_sort_key(RenderPass pass, u32 shader_id, s64 material_index, u32 texture_id, f32 depth)
+{
+	// Opaque draws go front to back, transparent ones back to front
+	constexpr const u64 depth_max = (1ull << SORT_KEY_DEPTH_BITS) - 1;
+	f32 depth_normalized = glm::clamp(depth / g_scene_camera.far_clip, 0.0f, 1.0f);
+	u64 depth_bits = (u64)(depth_normalized * depth_max);
+
+	// Material index 0 is reserved for packets without a material
+	u64 state_bits = ((u64)shader_id & 0xFF) << SORT_KEY_SHADER_SHIFT;
+	state_bits |= ((u64)(material_index + 1) & 0xFFF) << SORT_KEY_MATERIAL_SHIFT;
+	state_bits |= ((u64)texture_id & 0xFFFF) << SORT_KEY_TEXTURE_SHIFT;
+
+	u64 key = ((u64)pass & 0xF) << SORT_KEY_PASS_SHIFT;
+
+	// Blending is only right in depth order, state changes only group draws at equal depth
+	if (pass == RenderPass::Transparent)
+	{
+		key |= (depth_max - depth_bits) << SORT_KEY_TRANSPARENT_DEPTH_SHIFT;
+		key |= state_bits >> SORT_KEY_DEPTH_BITS;
+		return key;
+	}
+
+	key |= state_bits;
+	key |= depth_bits;
+	return key;
+}
+
+void render_queue_submit(RenderQueue* queue, u64 sort_key, DrawPacket* packet)
+{
+	ASSERT_TRUE(queue->packets.items_count < queue->packets.max_items, "Render queue has space for packet");
+
+	s64 packet_index = queue->packets.items_count;
+	j_array_add(&queue->packets, (byte*)packet);
+
+	queue->entries[packet_index] = {
+		.sort_key = sort_key,
+		.packet_index = packet_index,
+	};
+}
+
+void render_queue_sort(RenderQueue* queue)
+{
+	s64 entries_count = queue->packets.items_count;
+	if (entries_count < 2) return;
+
+	RenderQueueEntry* src = queue->entries;
+	RenderQueueEntry* dst = queue->sort_scratch;
+
+	// LSD radix sort, one byte per pass
+	for (u64 shift = 0; shift < 64; shift += 8)
+	{
+		s64 offsets[256] = { 0 };
+
+		for (s64 i = 0; i < entries_count; i++)
+		{
+			offsets[(src[i].sort_key >> shift) & 0xFF]++;
+		}
+
+		// Every key has the same byte here, nothing to reorder
+		if (offsets[(src[0].sort_key >> shift) & 0xFF] == entries_count) continue;
+
+		s64 offset = 0;
+
+		for (int i = 0; i < 256; i++)
+		{
+			s64 digit_count = offsets[i];
+			offsets[i] = offset;
+			offset += digit_count;
+		}
+
+		for (s64 i = 0; i < entries_count; i++)
+		{
+			dst[offsets[(src[i].sort_key >> shift) & 0xFF]++] = src[i];
+		}
+
+		RenderQueueEntry* temp = src;
+		src = dst;
+		dst = temp;
+	}
+
+	if (src != queue->entries)
+	{
+		memcpy(queue->entries, src, entries_count * sizeof(RenderQueueEntry));
+	}
+}
+
+void render_queue_execute(RenderQueue* queue)
+{
+	u32 bound_program = 0;
+	u32 bound_vao = 0;
+	u32 bound_textures[2] = { 0 };
+	Material* bound_material = nullptr;
+
+	for (s64 i = 0; i < queue->packets.items_count; i++)
+	{
+		DrawPacket* packet = (DrawPacket*)j_array_get(&queue->packets, queue->entries[i].packet_index);
+		SimpleShader* shader = packet->shader;
+
+		if (shader->id != bound_program)
+		{
+			gl_use_program(shader->id);
+			bound_program = shader->id;
+			bound_material = nullptr;
+			g_frame_data.state_changes++;
+		}
+
+		if (shader->vao != bound_vao)
+		{
+			gl_bind_vertex_array(shader->vao);
+			bound_vao = shader->vao;
+			g_frame_data.state_changes++;
+		}
+
+		for (int unit = 0; unit < 2; unit++)
+		{
+			u32 texture_id = packet->texture_ids[unit];
+			if (texture_id == 0 || texture_id == bound_textures[unit]) continue;
+
+			gl_active_texture(GL_TEXTURE0 + unit);
+			gl_bind_texture(packet->is_texture_array ? GL_TEXTURE_2D_ARRAY : GL_TEXTURE_2D, texture_id);
+			bound_textures[unit] = texture_id;
+			g_frame_data.state_changes++;
+		}
+
+		if (packet->type == DrawPacketType::MeshBatch)
+		{
+			Material* material = packet->material;
+
+			if (material != bound_material)
+			{
+				glUniform1f(get_uniform_location(shader, uniform_id("material.shininess")), material->shininess);
+				glUniform1f(get_uniform_location(shader, uniform_id("material.specular_mult")), material->specular_mult);
+				glUniform1i(get_uniform_location(shader, uniform_id("use_specular_texture")), material->specular_texture != nullptr);
+				bound_material = material;
+				g_frame_data.state_changes++;
+			}
+
+			bind_mesh_instance_attributes(g_mesh_instances.vbo, packet->first_instance);
+			draw_primitive_instanced(packet->mesh_type, packet->instances_count);
+		}
+		else if (packet->type == DrawPacketType::Billboard)
+		{
+			// Instance attributes of the billboard VAO always point to the start of the batch buffer
+			glDrawArraysInstanced(GL_TRIANGLES, 0, 6, packet->instances_count);
+			g_frame_data.draw_calls++;
+		}
+	}
+
+	gl_active_texture(GL_TEXTURE0);
+	gl_use_program(0);
+	gl_bind_vertex_array(0);
+}
+
+void render_queue_clear(RenderQueue* queue)
+{
+	j_array_empty(&queue->packets);
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "types.h"
+#include "structs.h"
+#include "j_buffers.h"
+
+// Sort key bits, most significant first:
+// opaque:      pass (4) | shader (8) | material (12) | texture (16) | depth (24)
+// transparent: pass (4) | inverted depth (24) | shader (8) | material (12) | texture (16)
+constexpr const u64 SORT_KEY_PASS_SHIFT = 60;
+constexpr const u64 SORT_KEY_SHADER_SHIFT = 52;
+constexpr const u64 SORT_KEY_MATERIAL_SHIFT = 40;
+constexpr const u64 SORT_KEY_TEXTURE_SHIFT = 24;
+constexpr const u64 SORT_KEY_DEPTH_BITS = 24;
+constexpr const u64 SORT_KEY_STATE_BITS = 36; // Shader, material and texture
+constexpr const u64 SORT_KEY_TRANSPARENT_DEPTH_SHIFT = SORT_KEY_STATE_BITS;
+
+enum class RenderPass {
+	Opaque,
+	Transparent
+};
+
+enum class DrawPacketType {
+	MeshBatch,
+	Billboard
+};
+
+typedef struct DrawPacket {
+	DrawPacketType type;
+	SimpleShader* shader;
+	Material* material;
+	u32 texture_ids[2];
+	bool is_texture_array;
+	MeshType mesh_type;
+	s64 first_instance;
+	s64 instances_count;
+} DrawPacket;
+
+typedef struct RenderQueueEntry {
+	u64 sort_key;
+	s64 packet_index;
+} RenderQueueEntry;
+
+typedef struct RenderQueue {
+	JArray packets;
+	RenderQueueEntry* entries;
+	RenderQueueEntry* sort_scratch;
+} RenderQueue;
+
+RenderQueue render_queue_init(MemoryBuffer* memory, s64 max_packets);
+
+u64 render_sort_key(RenderPass pass, u32 shader_id, s64 material_index, u32 texture_id, f32 depth);
+
+void render_queue_submit(RenderQueue* queue, u64 sort_key, DrawPacket* packet);
+
+void render_queue_sort(RenderQueue* queue);
+
+void render_queue_execute(RenderQueue* queue);
+
+void render_queue_clear(RenderQueue* queue);
@@ -0,0 +1,250 @@
+#include "j_render_targets.h"
+
+#include <cstring>
+#include <glad/glad.h>
+
+#include "j_assert.h"
+#include "globals.h"
+
+typedef struct TextureFormat {
+	GLenum format;
+	GLenum type;
+	s64 bytes_per_pixel;
+} TextureFormat;
+
+TextureFormat get_texture_format(u32 internal_format)
+{
+	switch (internal_format)
+	{
+		case GL_RGBA8: return { GL_RGBA, GL_UNSIGNED_BYTE, 4 };
+		case GL_RGBA16F: return { GL_RGBA, GL_HALF_FLOAT, 8 };
+		case GL_DEPTH24_STENCIL8: return { GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8, 4 };
+	}
+
+	ASSERT_TRUE(false, "Render target format is known");
+	return {};
+}
+
+u32 create_render_target_texture(u32 internal_format, s32 width_px, s32 height_px, GLenum attachment)
+{
+	TextureFormat format = get_texture_format(internal_format);
+	GLint filter = attachment == GL_DEPTH_STENCIL_ATTACHMENT ? GL_NEAREST : GL_LINEAR;
+
+	u32 texture_id;
+	glGenTextures(1, &texture_id);
+	gl_bind_texture(GL_TEXTURE_2D, texture_id);
+	glTexImage2D(GL_TEXTURE_2D, 0, internal_format, width_px, height_px, 0, format.format, format.type, NULL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, attachment, GL_TEXTURE_2D, texture_id, 0);
+	return texture_id;
+}
+
+void create_render_target(RenderTarget* target, RenderTargetDesc desc)
+{
+	*target = {};
+	target->desc = desc;
+
+	glGenFramebuffers(1, &target->id);
+	gl_bind_framebuffer(GL_FRAMEBUFFER, target->id);
+
+	s64 pixels_count = (s64)desc.width_px * desc.height_px;
+	GLenum draw_buffers[RENDER_TARGET_MAX_COLORS] = {};
+	s32 colors_count = 0;
+
+	for (s64 i = 0; i < RENDER_TARGET_MAX_COLORS; i++)
+	{
+		if (desc.color_formats[i] == 0) break;
+
+		GLenum attachment = GL_COLOR_ATTACHMENT0 + (GLenum)i;
+		target->color_textures[i] = create_render_target_texture(desc.color_formats[i], desc.width_px, desc.height_px, attachment);
+		target->size_bytes += pixels_count * get_texture_format(desc.color_formats[i]).bytes_per_pixel;
+		draw_buffers[colors_count++] = attachment;
+	}
+
+	if (desc.depth_format != 0)
+	{
+		target->depth_texture = create_render_target_texture(desc.depth_format, desc.width_px, desc.height_px, GL_DEPTH_STENCIL_ATTACHMENT);
+		target->size_bytes += pixels_count * get_texture_format(desc.depth_format).bytes_per_pixel;
+	}
+
+	glDrawBuffers(colors_count, draw_buffers);
+	target->draw_buffers_count = colors_count;
+
+	ASSERT_TRUE(glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE, "Render target successfull");
+	gl_bind_framebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void destroy_render_target(RenderTarget* target)
+{
+	gl_delete_textures(RENDER_TARGET_MAX_COLORS, target->color_textures);
+	gl_delete_textures(1, &target->depth_texture);
+	gl_delete_framebuffers(1, &target->id);
+	*target = {};
+}
+
+void render_target_pool_destroy(RenderTargetPool* pool, RenderTarget* target)
+{
+	pool->bytes_allocated -= target->size_bytes;
+	pool->destroyed_count++;
+	destroy_render_target(target);
+}
+
+// Frees a slot of a full pool in place, so targets acquired earlier this frame do not move.
+// Free targets of another size, usually left from before a resize, go first, then the one unused the longest.
+RenderTarget* render_target_pool_evict(RenderTargetPool* pool, RenderTargetDesc desc)
+{
+	RenderTarget* evicted = nullptr;
+	bool evicted_is_other_size = false;
+
+	for (s64 i = 0; i < pool->targets_count; i++)
+	{
+		RenderTarget* pooled = &pool->targets[i];
+		if (pooled->in_use) continue;
+
+		bool is_other_size = pooled->desc.width_px != desc.width_px || pooled->desc.height_px != desc.height_px;
+		bool is_better = evicted == nullptr
+			|| (is_other_size && !evicted_is_other_size)
+			|| (is_other_size == evicted_is_other_size && pooled->last_used_frame < evicted->last_used_frame);
+
+		if (!is_better) continue;
+
+		evicted = pooled;
+		evicted_is_other_size = is_other_size;
+	}
+
+	if (evicted != nullptr) render_target_pool_destroy(pool, evicted);
+	return evicted;
+}
+
+s32 render_target_colors_count(RenderTargetDesc* desc)
+{
+	s32 colors_count = 0;
+	while (colors_count < RENDER_TARGET_MAX_COLORS && desc->color_formats[colors_count] != 0) colors_count++;
+	return colors_count;
+}
+
+// Target framebuffer has to be bound
+void render_target_set_draw_buffers(RenderTarget* target, s32 colors_count)
+{
+	if (target->draw_buffers_count == colors_count) return;
+
+	GLenum draw_buffers[RENDER_TARGET_MAX_COLORS] = {};
+
+	for (s32 i = 0; i < colors_count; i++)
+	{
+		draw_buffers[i] = GL_COLOR_ATTACHMENT0 + (GLenum)i;
+	}
+
+	glDrawBuffers(colors_count, draw_buffers);
+	target->draw_buffers_count = colors_count;
+}
+
+// Same size and depth, and the color attachments of desc are the first ones of the target
+bool render_target_can_alias(RenderTargetDesc* target_desc, RenderTargetDesc* desc)
+{
+	if (target_desc->width_px != desc->width_px || target_desc->height_px != desc->height_px) return false;
+	if (target_desc->depth_format != desc->depth_format) return false;
+
+	for (s64 i = 0; i < RENDER_TARGET_MAX_COLORS; i++)
+	{
+		if (desc->color_formats[i] == 0) return true;
+		if (target_desc->color_formats[i] != desc->color_formats[i]) return false;
+	}
+
+	return true;
+}
+
+RenderTarget* render_target_acquire_matching(RenderTargetPool* pool, RenderTargetDesc desc, bool allow_alias)
+{
+	desc.width_px = glm::max(desc.width_px, 1);
+	desc.height_px = glm::max(desc.height_px, 1);
+
+	RenderTarget* target = nullptr;
+
+	for (s64 i = 0; i < pool->targets_count; i++)
+	{
+		RenderTarget* pooled = &pool->targets[i];
+		if (pooled->in_use || memcmp(&pooled->desc, &desc, sizeof(RenderTargetDesc)) != 0) continue;
+
+		target = pooled;
+		break;
+	}
+
+	// Draws into every attachment again after having aliased a smaller desc
+	if (target != nullptr && target->draw_buffers_count != render_target_colors_count(&desc))
+	{
+		gl_bind_framebuffer(GL_FRAMEBUFFER, target->id);
+		render_target_set_draw_buffers(target, render_target_colors_count(&desc));
+	}
+
+	for (s64 i = 0; i < pool->targets_count && target == nullptr && allow_alias; i++)
+	{
+		RenderTarget* pooled = &pool->targets[i];
+		if (pooled->in_use || !render_target_can_alias(&pooled->desc, &desc)) continue;
+
+		target = pooled;
+		g_frame_data.render_targets_aliased++;
+	}
+
+	if (target == nullptr)
+	{
+		if (pool->targets_count < RENDER_TARGET_POOL_MAX_COUNT) target = &pool->targets[pool->targets_count++];
+		else target = render_target_pool_evict(pool, desc);
+
+		ASSERT_TRUE(target != nullptr, "Render target pool has space");
+		create_render_target(target, desc);
+
+		pool->bytes_allocated += target->size_bytes;
+		pool->created_count++;
+	}
+
+	target->in_use = true;
+	target->last_used_frame = g_game_metrics.frames;
+	pool->targets_in_use++;
+	return target;
+}
+
+// Free target with the same size, formats and attachments, or a new one
+RenderTarget* render_target_acquire(RenderTargetPool* pool, RenderTargetDesc desc)
+{
+	return render_target_acquire_matching(pool, desc, false);
+}
+
+// Like render_target_acquire, but a free target with extra color attachments may be handed out instead.
+// The caller draws only into the attachments of desc, see render_target_set_draw_buffers.
+RenderTarget* render_target_acquire_alias(RenderTargetPool* pool, RenderTargetDesc desc)
+{
+	return render_target_acquire_matching(pool, desc, true);
+}
+
+// The target goes back to the pool, later passes of the same frame may draw into it
+void render_target_release(RenderTargetPool* pool, RenderTarget* target)
+{
+	ASSERT_TRUE(target->in_use, "Released render target is in use");
+	target->in_use = false;
+	pool->targets_in_use--;
+}
+
+void render_target_pool_end_frame(RenderTargetPool* pool)
+{
+	s64 frame = g_game_metrics.frames;
+
+	// Targets of an old window size or of a disabled pass are deleted once they have idled long enough
+	for (s64 i = 0; i < pool->targets_count; )
+	{
+		RenderTarget* target = &pool->targets[i];
+
+		if (target->in_use || frame - target->last_used_frame < RENDER_TARGET_IDLE_FRAMES)
+		{
+			i++;
+			continue;
+		}
+
+		render_target_pool_destroy(pool, target);
+		pool->targets[i] = pool->targets[pool->targets_count - 1];
+		pool->targets_count--;
+	}
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include "types.h"
+#include "structs.h"
+
+RenderTarget* render_target_acquire(RenderTargetPool* pool, RenderTargetDesc desc);
+
+RenderTarget* render_target_acquire_alias(RenderTargetPool* pool, RenderTargetDesc desc);
+
+s32 render_target_colors_count(RenderTargetDesc* desc);
+
+void render_target_set_draw_buffers(RenderTarget* target, s32 colors_count);
+
+void render_target_release(RenderTargetPool* pool, RenderTarget* target);
+
+void render_target_pool_end_frame(RenderTargetPool* pool);
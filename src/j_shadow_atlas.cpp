@@ -0,0 +1,297 @@
+#include "j_shadow_atlas.h"
+
+#include <cstring>
+#include <glad/glad.h>
+
+#include "j_assert.h"
+#include "globals.h"
+
+void set_shadow_atlas_size(ShadowAtlas* atlas, s64 size_px)
+{
+	atlas->size_px = size_px;
+	gl_bind_texture(GL_TEXTURE_2D, atlas->texture_id);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, (s32)size_px, (s32)size_px, 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, NULL);
+}
+
+void init_shadow_atlas(ShadowAtlas* atlas)
+{
+	glGenTextures(1, &atlas->texture_id);
+	set_shadow_atlas_size(atlas, SHADOW_ATLAS_MIN_SIZE_PX);
+
+	// Tiles are clamped in the shader, so sampling never leaves the texture
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+	glGenFramebuffers(1, &atlas->framebuffer_id);
+	gl_bind_framebuffer(GL_FRAMEBUFFER, atlas->framebuffer_id);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, atlas->texture_id, 0);
+	glDrawBuffer(GL_NONE);
+	glReadBuffer(GL_NONE);
+
+	ASSERT_TRUE(glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE, "Shadow atlas framebuffer complete");
+	gl_bind_framebuffer(GL_FRAMEBUFFER, 0);
+
+	memset(atlas->cells_used, 0, sizeof(atlas->cells_used));
+	atlas->cells_used_count = 0;
+}
+
+void shadow_atlas_set_cells(ShadowAtlas* atlas, ShadowAtlasTile* tile, bool is_used)
+{
+	s64 first_x = tile->x_px / SHADOW_ATLAS_CELL_SIZE_PX;
+	s64 first_y = tile->y_px / SHADOW_ATLAS_CELL_SIZE_PX;
+	s64 cells = tile->size_px / SHADOW_ATLAS_CELL_SIZE_PX;
+
+	for (s64 y = first_y; y < first_y + cells; y++)
+	{
+		for (s64 x = first_x; x < first_x + cells; x++)
+		{
+			atlas->cells_used[y * SHADOW_ATLAS_CELLS_PER_ROW + x] = is_used;
+		}
+	}
+}
+
+bool shadow_atlas_cells_free(ShadowAtlas* atlas, s64 first_x, s64 first_y, s64 cells)
+{
+	for (s64 y = first_y; y < first_y + cells; y++)
+	{
+		for (s64 x = first_x; x < first_x + cells; x++)
+		{
+			if (atlas->cells_used[y * SHADOW_ATLAS_CELLS_PER_ROW + x]) return false;
+		}
+	}
+
+	return true;
+}
+
+bool shadow_atlas_allocate(ShadowAtlas* atlas, s64 size_px, ShadowAtlasTile* tile)
+{
+	// Tiles are aligned to their own size, like a quadtree. Allocating largest first always packs tightly.
+	s64 cells = size_px / SHADOW_ATLAS_CELL_SIZE_PX;
+	s64 cells_per_row = atlas->size_px / SHADOW_ATLAS_CELL_SIZE_PX;
+	ASSERT_TRUE(0 < cells && cells <= cells_per_row, "Shadow tile size fits the atlas");
+
+	for (s64 y = 0; y < cells_per_row; y += cells)
+	{
+		for (s64 x = 0; x < cells_per_row; x += cells)
+		{
+			if (!shadow_atlas_cells_free(atlas, x, y, cells)) continue;
+
+			tile->x_px = x * SHADOW_ATLAS_CELL_SIZE_PX;
+			tile->y_px = y * SHADOW_ATLAS_CELL_SIZE_PX;
+			tile->size_px = size_px;
+			shadow_atlas_set_cells(atlas, tile, true);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void shadow_atlas_free(ShadowAtlas* atlas, ShadowAtlasTile* tile)
+{
+	if (tile->size_px == 0) return;
+
+	shadow_atlas_set_cells(atlas, tile, false);
+	*tile = {};
+}
+
+glm::vec4 get_shadow_tile_uv_rect(ShadowAtlas* atlas, ShadowAtlasTile tile)
+{
+	f32 atlas_size = (f32)atlas->size_px;
+	return glm::vec4(tile.x_px / atlas_size, tile.y_px / atlas_size, tile.size_px / atlas_size, tile.size_px / atlas_size);
+}
+
+s64 get_spotlight_shadow_tile_size(Spotlight* spotlight)
+{
+	if (!spotlight->is_on) return 0;
+
+	// Lights far away relative to their range cover little of the screen
+	f32 distance = glm::length(g_scene_camera.position - spotlight->transforms.translation);
+	f32 coverage = spotlight->range / glm::max(distance, 0.001f);
+
+	// Thresholds move away from the current size, so a camera resting on one does not flip the tile every frame
+	s64 current_size = spotlight->shadow_tile.requested_px;
+	f32 large_threshold = 0.5f * (current_size == SHADOW_TILE_SIZE_LARGE_PX ? 1.0f - SHADOW_TILE_SIZE_HYSTERESIS : 1.0f + SHADOW_TILE_SIZE_HYSTERESIS);
+	f32 medium_threshold = 0.2f * (SHADOW_TILE_SIZE_MEDIUM_PX <= current_size ? 1.0f - SHADOW_TILE_SIZE_HYSTERESIS : 1.0f + SHADOW_TILE_SIZE_HYSTERESIS);
+
+	if (large_threshold <= coverage) return SHADOW_TILE_SIZE_LARGE_PX;
+	if (medium_threshold <= coverage) return SHADOW_TILE_SIZE_MEDIUM_PX;
+	return SHADOW_TILE_SIZE_SMALL_PX;
+}
+
+void shadow_atlas_allocate_or_smaller(ShadowAtlas* atlas, s64 size_px, ShadowAtlasTile* tile)
+{
+	for (s64 used_size = size_px; SHADOW_TILE_SIZE_SMALL_PX <= used_size; used_size /= 2)
+	{
+		if (shadow_atlas_allocate(atlas, used_size, tile)) break;
+	}
+
+	tile->requested_px = size_px;
+}
+
+s64 count_shadow_atlas_cells_used(ShadowAtlas* atlas)
+{
+	s64 count = 0;
+
+	for (s64 i = 0; i < SHADOW_ATLAS_CELLS_PER_ROW * SHADOW_ATLAS_CELLS_PER_ROW; i++)
+	{
+		if (atlas->cells_used[i]) count++;
+	}
+
+	return count;
+}
+
+void repack_shadow_atlas(ShadowAtlas* atlas, s64* wanted_sizes)
+{
+	s64 spotlights_count = g_scene.spotlights.items_count;
+	ASSERT_TRUE(spotlights_count <= SCENE_SPOTLIGHTS_MAX_COUNT, "Spotlights fit the repack tiles");
+
+	ShadowAtlasTile packed_tiles[SCENE_SPOTLIGHTS_MAX_COUNT] = {};
+	memset(atlas->cells_used, 0, sizeof(atlas->cells_used));
+
+	// Largest tiles first, lights that do not fit fall back to smaller tiles or no shadow
+	for (s64 size_px = SHADOW_TILE_SIZE_LARGE_PX; SHADOW_TILE_SIZE_SMALL_PX <= size_px; size_px /= 2)
+	{
+		for (int i = 0; i < spotlights_count; i++)
+		{
+			if (wanted_sizes[i] != size_px) continue;
+
+			shadow_atlas_allocate_or_smaller(atlas, size_px, &packed_tiles[i]);
+		}
+	}
+
+	// Only lights whose tile actually moved have to redraw their shadow
+	for (int i = 0; i < spotlights_count; i++)
+	{
+		Spotlight* spotlight = (Spotlight*)j_array_get(&g_scene.spotlights, i);
+		ShadowAtlasTile* tile = &spotlight->shadow_tile;
+		ShadowAtlasTile* packed = &packed_tiles[i];
+
+		if (tile->x_px != packed->x_px || tile->y_px != packed->y_px || tile->size_px != packed->size_px)
+		{
+			spotlight->shadow_dirty = true;
+		}
+
+		*tile = *packed;
+	}
+}
+
+// Smallest atlas the wanted tiles fit. Tiles are powers of two placed largest first,
+// so they pack without gaps whenever their total area fits.
+s64 get_shadow_atlas_wanted_size(s64* wanted_sizes, s64 spotlights_count)
+{
+	s64 wanted_area = 0;
+
+	for (s64 i = 0; i < spotlights_count; i++)
+	{
+		wanted_area += wanted_sizes[i] * wanted_sizes[i];
+	}
+
+	s64 size_px = SHADOW_ATLAS_MIN_SIZE_PX;
+	while (size_px * size_px < wanted_area && size_px < SHADOW_ATLAS_MAX_SIZE_PX) size_px *= 2;
+	return size_px;
+}
+
+void update_shadow_atlas_tiles()
+{
+	PROFILE_ZONE("Shadow atlas tiles");
+	ShadowAtlas* atlas = &g_shadow_atlas;
+	s64 spotlights_count = g_scene.spotlights.items_count;
+	ASSERT_TRUE(spotlights_count <= SCENE_SPOTLIGHTS_MAX_COUNT, "Spotlights fit the wanted tile sizes");
+
+	// Occupancy is rebuilt from the lights, so deleted lights release their tiles.
+	// Duplicated lights copy their tile, the overlapping copy is dropped here.
+	memset(atlas->cells_used, 0, sizeof(atlas->cells_used));
+
+	for (int i = 0; i < spotlights_count; i++)
+	{
+		ShadowAtlasTile* tile = &((Spotlight*)j_array_get(&g_scene.spotlights, i))->shadow_tile;
+		if (tile->size_px == 0) continue;
+
+		s64 cells = tile->size_px / SHADOW_ATLAS_CELL_SIZE_PX;
+
+		if (shadow_atlas_cells_free(atlas, tile->x_px / SHADOW_ATLAS_CELL_SIZE_PX, tile->y_px / SHADOW_ATLAS_CELL_SIZE_PX, cells))
+		{
+			shadow_atlas_set_cells(atlas, tile, true);
+		}
+		else *tile = {};
+	}
+
+	s64 wanted_sizes[SCENE_SPOTLIGHTS_MAX_COUNT];
+
+	for (int i = 0; i < spotlights_count; i++)
+	{
+		wanted_sizes[i] = get_spotlight_shadow_tile_size((Spotlight*)j_array_get(&g_scene.spotlights, i));
+	}
+
+	// Resizing loses the texture contents, every tile is placed and drawn again
+	s64 atlas_size_px = get_shadow_atlas_wanted_size(wanted_sizes, spotlights_count);
+
+	if (atlas_size_px != atlas->size_px)
+	{
+		set_shadow_atlas_size(atlas, atlas_size_px);
+		repack_shadow_atlas(atlas, wanted_sizes);
+
+		for (int i = 0; i < spotlights_count; i++)
+		{
+			((Spotlight*)j_array_get(&g_scene.spotlights, i))->shadow_dirty = true;
+		}
+
+		atlas->cells_used_count = count_shadow_atlas_cells_used(atlas);
+		return;
+	}
+
+	bool has_released_cells = count_shadow_atlas_cells_used(atlas) < atlas->cells_used_count;
+	bool needs_repack = false;
+
+	for (int i = 0; i < spotlights_count; i++)
+	{
+		Spotlight* spotlight = (Spotlight*)j_array_get(&g_scene.spotlights, i);
+		ShadowAtlasTile* tile = &spotlight->shadow_tile;
+
+		// Compared against the size asked for, so tiles shrunk to fit a full atlas are kept
+		if (needs_repack || tile->requested_px == wanted_sizes[i]) continue;
+
+		if (tile->size_px != 0) has_released_cells = true;
+		shadow_atlas_free(atlas, tile);
+		spotlight->shadow_dirty = true;
+
+		if (wanted_sizes[i] == 0) continue;
+
+		if (shadow_atlas_allocate(atlas, wanted_sizes[i], tile)) tile->requested_px = wanted_sizes[i];
+		else needs_repack = true;
+	}
+
+	if (needs_repack)
+	{
+		repack_shadow_atlas(atlas, wanted_sizes);
+	}
+	else if (has_released_cells)
+	{
+		// Shrunk tiles grow back once other tiles have given up space
+		for (int i = 0; i < spotlights_count; i++)
+		{
+			Spotlight* spotlight = (Spotlight*)j_array_get(&g_scene.spotlights, i);
+			ShadowAtlasTile* tile = &spotlight->shadow_tile;
+			if (tile->size_px == tile->requested_px) continue;
+
+			ShadowAtlasTile grown_tile = {};
+
+			for (s64 size_px = tile->requested_px; tile->size_px < size_px && SHADOW_TILE_SIZE_SMALL_PX <= size_px; size_px /= 2)
+			{
+				if (shadow_atlas_allocate(atlas, size_px, &grown_tile)) break;
+			}
+
+			if (grown_tile.size_px == 0) continue;
+
+			grown_tile.requested_px = tile->requested_px;
+			shadow_atlas_free(atlas, tile);
+			*tile = grown_tile;
+			spotlight->shadow_dirty = true;
+		}
+	}
+
+	atlas->cells_used_count = count_shadow_atlas_cells_used(atlas);
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include "types.h"
+#include "structs.h"
+
+void init_shadow_atlas(ShadowAtlas* atlas);
+
+bool shadow_atlas_allocate(ShadowAtlas* atlas, s64 size_px, ShadowAtlasTile* tile);
+
+void shadow_atlas_free(ShadowAtlas* atlas, ShadowAtlasTile* tile);
+
+glm::vec4 get_shadow_tile_uv_rect(ShadowAtlas* atlas, ShadowAtlasTile tile);
+
+s64 get_spotlight_shadow_tile_size(Spotlight* spotlight);
+
+void update_shadow_atlas_tiles();
@@ -0,0 +1,131 @@
+#include "j_stream_buffer.h"
+
+#include <cstring>
+
+#include "j_assert.h"
+#include "globals.h"
+
+void transient_vertices_init(TransientVertices* vertices, s64 vertex_size, s64 initial_count, char* name)
+{
+	memory_buffer_mallocate(&vertices->memory, vertex_size * initial_count, name);
+	vertices->vertex_size = vertex_size;
+	vertices->vertices_count = 0;
+}
+
+void transient_vertices_push(TransientVertices* vertices, void* vertex_data, s64 count)
+{
+	s64 used_size = vertices->vertices_count * vertices->vertex_size;
+	s64 push_size = count * vertices->vertex_size;
+
+	if (vertices->memory.size < used_size + push_size)
+	{
+		MemoryBuffer old_memory = vertices->memory;
+		s64 new_size = old_memory.size * 2;
+		while (new_size < used_size + push_size) new_size *= 2;
+
+		vertices->memory = {};
+		memory_buffer_mallocate(&vertices->memory, new_size, old_memory.name);
+		memcpy(vertices->memory.memory, old_memory.memory, used_size);
+		memory_buffer_free(&old_memory);
+	}
+
+	memcpy(vertices->memory.memory + used_size, vertex_data, push_size);
+	vertices->vertices_count += count;
+}
+
+void transient_vertices_clear(TransientVertices* vertices)
+{
+	vertices->vertices_count = 0;
+}
+
+void stream_buffer_init(StreamBuffer* stream, s64 segment_size)
+{
+	glGenBuffers(1, &stream->vbo);
+	gl_bind_buffer(GL_ARRAY_BUFFER, stream->vbo);
+	glBufferData(GL_ARRAY_BUFFER, segment_size * STREAM_BUFFER_FRAMES, NULL, GL_STREAM_DRAW);
+	gl_bind_buffer(GL_ARRAY_BUFFER, 0);
+
+	stream->segment_size = segment_size;
+	stream->segment_index = 0;
+	stream->segment_used = 0;
+	memset(stream->fences, 0, sizeof(stream->fences));
+}
+
+void stream_buffer_begin_frame(StreamBuffer* stream)
+{
+	stream->segment_index = (stream->segment_index + 1) % STREAM_BUFFER_FRAMES;
+	stream->segment_used = 0;
+
+	GLsync fence = stream->fences[stream->segment_index];
+	if (fence == 0) return;
+
+	// Only blocks when the CPU is more than STREAM_BUFFER_FRAMES frames ahead
+	GLenum wait_result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+
+	while (wait_result == GL_TIMEOUT_EXPIRED)
+	{
+		wait_result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+	}
+
+	ASSERT_TRUE(wait_result != GL_WAIT_FAILED, "Stream buffer fence wait");
+	glDeleteSync(fence);
+	stream->fences[stream->segment_index] = 0;
+}
+
+void stream_buffer_grow(StreamBuffer* stream, s64 needed_size)
+{
+	s64 new_segment_size = stream->segment_size * 2;
+	while (new_segment_size < needed_size) new_segment_size *= 2;
+
+	// Orphaning gives new storage, so the fences of the old storage are no longer needed
+	for (int i = 0; i < STREAM_BUFFER_FRAMES; i++)
+	{
+		if (stream->fences[i] != 0) glDeleteSync(stream->fences[i]);
+		stream->fences[i] = 0;
+	}
+
+	glBufferData(GL_ARRAY_BUFFER, new_segment_size * STREAM_BUFFER_FRAMES, NULL, GL_STREAM_DRAW);
+	stream->segment_size = new_segment_size;
+	stream->segment_used = 0;
+}
+
+s64 stream_buffer_upload(StreamBuffer* stream, TransientVertices* vertices)
+{
+	// Returns the first vertex to draw, so uploads are aligned to the vertex size
+	s64 vertex_size = vertices->vertex_size;
+	s64 upload_size = vertices->vertices_count * vertex_size;
+	s64 segment_start = stream->segment_index * stream->segment_size;
+
+	gl_bind_buffer(GL_ARRAY_BUFFER, stream->vbo);
+
+	s64 offset = (segment_start + stream->segment_used + vertex_size - 1) / vertex_size * vertex_size;
+
+	if (segment_start + stream->segment_size < offset + upload_size)
+	{
+		stream_buffer_grow(stream, upload_size + vertex_size);
+		segment_start = stream->segment_index * stream->segment_size;
+		offset = (segment_start + vertex_size - 1) / vertex_size * vertex_size;
+	}
+
+	if (0 < upload_size)
+	{
+		GLbitfield access = GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT;
+		void* mapped = glMapBufferRange(GL_ARRAY_BUFFER, offset, upload_size, access);
+		ASSERT_TRUE(mapped != nullptr, "Stream buffer map");
+		memcpy(mapped, vertices->memory.memory, upload_size);
+		glUnmapBuffer(GL_ARRAY_BUFFER);
+	}
+
+	gl_bind_buffer(GL_ARRAY_BUFFER, 0);
+
+	stream->segment_used = offset + upload_size - segment_start;
+	g_frame_data.bytes_uploaded += upload_size;
+	g_frame_data.bytes_streamed += upload_size;
+
+	return offset / vertex_size;
+}
+
+void stream_buffer_end_frame(StreamBuffer* stream)
+{
+	stream->fences[stream->segment_index] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include "types.h"
+#include "constants.h"
+#include "j_buffers.h"
+
+// Vertices appended on the CPU during the frame, doubles in size when full
+typedef struct TransientVertices {
+	MemoryBuffer memory;
+	s64 vertex_size;
+	s64 vertices_count;
+} TransientVertices;
+
+// One GL buffer split into a segment per frame in flight. A segment is written with
+// unsynchronized maps and fenced at the end of the frame, so it is only reused once the GPU is done with it.
+typedef struct StreamBuffer {
+	u32 vbo;
+	s64 segment_size;
+	s64 segment_index;
+	s64 segment_used;
+	GLsync fences[STREAM_BUFFER_FRAMES];
+} StreamBuffer;
+
+void transient_vertices_init(TransientVertices* vertices, s64 vertex_size, s64 initial_count, char* name);
+
+void transient_vertices_push(TransientVertices* vertices, void* vertex_data, s64 count);
+
+void transient_vertices_clear(TransientVertices* vertices);
+
+void stream_buffer_init(StreamBuffer* stream, s64 segment_size);
+
+void stream_buffer_begin_frame(StreamBuffer* stream);
+
+s64 stream_buffer_upload(StreamBuffer* stream, TransientVertices* vertices);
+
+void stream_buffer_end_frame(StreamBuffer* stream);
@@ -19,3 +19,17 @@ bool str_trim_from_char(char* str, char c);
 char* str_get_file_ext(char* str);
 
 bool str_is_empty_newline(char* str);
+
+// FNV-1a, usable in constant expressions
+constexpr u32 str_hash(const char* str)
+{
+	u32 hash = 2166136261u;
+
+	while (*str)
+	{
+		hash ^= (u32)(byte)*str++;
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
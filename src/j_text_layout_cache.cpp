@@ -0,0 +1,193 @@
+#include "j_text_layout_cache.h"
+
+#include <cstring>
+
+#include "j_assert.h"
+#include "globals.h"
+#include "jfont.h"
+
+s64 text_layout_cache_memory_size(s64 runs_capacity, s64 vertices_capacity)
+{
+	s64 glyphs_capacity = vertices_capacity / UI_CHAR_VERTICIES;
+	return 2 * (sizeof(TextLayoutRun) * runs_capacity + sizeof(UiTextVertex) * vertices_capacity + sizeof(s32) * glyphs_capacity)
+		+ sizeof(s32) * glyphs_capacity;
+}
+
+TextLayoutCache text_layout_cache_init(MemoryBuffer* memory, s64 runs_capacity, s64 vertices_capacity)
+{
+	ASSERT_TRUE((runs_capacity & (runs_capacity - 1)) == 0, "Text layout runs capacity is a power of two");
+
+	TextLayoutCache cache = {
+		.current = 0,
+		.runs_capacity = runs_capacity,
+		.vertices_capacity = vertices_capacity,
+		.glyphs_capacity = vertices_capacity / UI_CHAR_VERTICIES
+	};
+
+	for (s64 i = 0; i < 2; i++)
+	{
+		TextLayoutGeneration* generation = &cache.generations[i];
+		generation->runs = (TextLayoutRun*)memory_buffer_suballocate(memory, sizeof(TextLayoutRun) * runs_capacity).memory;
+		generation->vertices = (UiTextVertex*)memory_buffer_suballocate(memory, sizeof(UiTextVertex) * vertices_capacity).memory;
+		generation->glyph_entries = (s32*)memory_buffer_suballocate(memory, sizeof(s32) * cache.glyphs_capacity).memory;
+		memset(generation->runs, 0, sizeof(TextLayoutRun) * runs_capacity);
+		generation->runs_count = 0;
+		generation->vertices_used = 0;
+	}
+
+	cache.layout_glyph_entries = (s32*)memory_buffer_suballocate(memory, sizeof(s32) * cache.glyphs_capacity).memory;
+	return cache;
+}
+
+u64 hash_combine_u64(u64 hash, u64 value)
+{
+	// FNV-1a over the bytes of value
+	for (s64 i = 0; i < 8; i++)
+	{
+		hash ^= (value >> (i * 8)) & 0xFF;
+		hash *= 0x100000001B3ull;
+	}
+
+	return hash;
+}
+
+u64 text_layout_key(FontData* font_data, char* text, float pos_x_vw, float pos_y_vh, u32 color)
+{
+	u64 hash = 0xCBF29CE484222325ull;
+
+	for (byte* c = (byte*)text; *c != '\0'; c++)
+	{
+		hash ^= *c;
+		hash *= 0x100000001B3ull;
+	}
+
+	u32 pos_x_bits;
+	u32 pos_y_bits;
+	u32 scale_bits;
+	memcpy(&pos_x_bits, &pos_x_vw, sizeof(u32));
+	memcpy(&pos_y_bits, &pos_y_vh, sizeof(u32));
+	memcpy(&scale_bits, &font_data->font_scale, sizeof(u32));
+
+	hash = hash_combine_u64(hash, (u64)font_data);
+	hash = hash_combine_u64(hash, ((u64)pos_x_bits << 32) | pos_y_bits);
+	hash = hash_combine_u64(hash, ((u64)scale_bits << 32) | color);
+	hash = hash_combine_u64(hash, ((u64)g_game_metrics.scene_width_px << 32) | (u64)g_game_metrics.scene_height_px);
+
+	return hash == 0 ? 1 : hash;
+}
+
+TextLayoutRun* text_layout_find_run(TextLayoutCache* cache, TextLayoutGeneration* generation, u64 key)
+{
+	u64 mask = cache->runs_capacity - 1;
+
+	for (u64 i = key & mask; ; i = (i + 1) & mask)
+	{
+		TextLayoutRun* run = &generation->runs[i];
+		if (run->key == key || run->key == 0) return run;
+	}
+}
+
+TextLayoutRun* text_layout_add_run(TextLayoutCache* cache, FontData* font_data, u64 key, UiTextVertex* run_vertices, s32* glyph_entries, s64 vertices_count)
+{
+	TextLayoutGeneration* current = &cache->generations[cache->current];
+
+	// Kept at most half full so probes stay short, full caches just stop caching for the frame
+	bool has_room = current->runs_count < cache->runs_capacity / 2
+		&& current->vertices_used + vertices_count <= cache->vertices_capacity;
+
+	if (!has_room) return nullptr;
+
+	TextLayoutRun* run = text_layout_find_run(cache, current, key);
+	if (run->key == key) return run;
+
+	s64 first_glyph = current->vertices_used / UI_CHAR_VERTICIES;
+	s64 glyphs_count = vertices_count / UI_CHAR_VERTICIES;
+	memcpy(&current->vertices[current->vertices_used], run_vertices, sizeof(UiTextVertex) * vertices_count);
+	memcpy(&current->glyph_entries[first_glyph], glyph_entries, sizeof(s32) * glyphs_count);
+
+	for (s64 i = 0; i < glyphs_count; i++)
+	{
+		font_data->glyphs[glyph_entries[i]].run_references++;
+	}
+
+	*run = {
+		.key = key,
+		.font_data = font_data,
+		.first_vertex = current->vertices_used,
+		.vertices_count = vertices_count
+	};
+
+	current->vertices_used += vertices_count;
+	current->runs_count++;
+	return run;
+}
+
+bool text_layout_cache_get(TextLayoutCache* cache, FontData* font_data, u64 key, TransientVertices* vertices)
+{
+	TextLayoutGeneration* generation = &cache->generations[cache->current];
+	TextLayoutRun* run = text_layout_find_run(cache, generation, key);
+
+	if (run->key == 0)
+	{
+		// Carry runs that were drawn last frame over to this frame
+		TextLayoutGeneration* previous = &cache->generations[cache->current ^ 1];
+		TextLayoutRun* previous_run = text_layout_find_run(cache, previous, key);
+
+		if (previous_run->key == key)
+		{
+			s32* previous_glyph_entries = &previous->glyph_entries[previous_run->first_vertex / UI_CHAR_VERTICIES];
+			text_layout_add_run(cache, font_data, key, &previous->vertices[previous_run->first_vertex], previous_glyph_entries, previous_run->vertices_count);
+		}
+
+		generation = previous;
+		run = previous_run;
+	}
+
+	if (run->key != key)
+	{
+		g_frame_data.text_layout_misses++;
+		return false;
+	}
+
+	// Drawn glyphs are used this frame, even though they are not looked up again
+	s32* glyph_entries = &generation->glyph_entries[run->first_vertex / UI_CHAR_VERTICIES];
+
+	for (s64 i = 0; i < run->vertices_count / UI_CHAR_VERTICIES; i++)
+	{
+		touch_font_glyph(font_data, glyph_entries[i]);
+	}
+
+	transient_vertices_push(vertices, &generation->vertices[run->first_vertex], run->vertices_count);
+	g_frame_data.text_layout_hits++;
+	return true;
+}
+
+void text_layout_cache_put(TextLayoutCache* cache, FontData* font_data, u64 key, UiTextVertex* run_vertices, s32* glyph_entries, s64 vertices_count)
+{
+	text_layout_add_run(cache, font_data, key, run_vertices, glyph_entries, vertices_count);
+}
+
+void text_layout_cache_end_frame(TextLayoutCache* cache)
+{
+	cache->current ^= 1;
+
+	// Runs of two frames ago release their glyphs
+	TextLayoutGeneration* current = &cache->generations[cache->current];
+
+	for (s64 i = 0; i < cache->runs_capacity; i++)
+	{
+		TextLayoutRun* run = &current->runs[i];
+		if (run->key == 0) continue;
+
+		s32* glyph_entries = &current->glyph_entries[run->first_vertex / UI_CHAR_VERTICIES];
+
+		for (s64 glyph = 0; glyph < run->vertices_count / UI_CHAR_VERTICIES; glyph++)
+		{
+			run->font_data->glyphs[glyph_entries[glyph]].run_references--;
+		}
+	}
+
+	memset(current->runs, 0, sizeof(TextLayoutRun) * cache->runs_capacity);
+	current->runs_count = 0;
+	current->vertices_used = 0;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "types.h"
+#include "constants.h"
+#include "structs.h"
+#include "j_buffers.h"
+#include "j_stream_buffer.h"
+
+typedef struct TextLayoutRun {
+	u64 key; // 0 when empty
+	FontData* font_data;
+	s64 first_vertex; // Its glyph entries start at first_vertex / UI_CHAR_VERTICIES
+	s64 vertices_count;
+} TextLayoutRun;
+
+typedef struct TextLayoutGeneration {
+	TextLayoutRun* runs;
+	UiTextVertex* vertices;
+	s32* glyph_entries; // Glyph cache entry drawn by each quad
+	s64 runs_count;
+	s64 vertices_used;
+} TextLayoutGeneration;
+
+// Laid out text vertices from this and the previous frame. A run that is not drawn
+// for a whole frame is dropped, so text that changes every frame does not pile up.
+// Runs hold a reference on each of their glyphs, so the font never evicts a glyph a run still samples.
+typedef struct TextLayoutCache {
+	TextLayoutGeneration generations[2];
+	s32* layout_glyph_entries; // Filled while laying out a missed run
+	s64 current;
+	s64 runs_capacity; // Power of two
+	s64 vertices_capacity;
+	s64 glyphs_capacity;
+} TextLayoutCache;
+
+s64 text_layout_cache_memory_size(s64 runs_capacity, s64 vertices_capacity);
+
+TextLayoutCache text_layout_cache_init(MemoryBuffer* memory, s64 runs_capacity, s64 vertices_capacity);
+
+u64 text_layout_key(FontData* font_data, char* text, float pos_x_vw, float pos_y_vh, u32 color);
+
+bool text_layout_cache_get(TextLayoutCache* cache, FontData* font_data, u64 key, TransientVertices* vertices);
+
+void text_layout_cache_put(TextLayoutCache* cache, FontData* font_data, u64 key, UiTextVertex* run_vertices, s32* glyph_entries, s64 vertices_count);
+
+void text_layout_cache_end_frame(TextLayoutCache* cache);
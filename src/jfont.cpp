@@ -4,132 +4,371 @@
 #include "globals.h"
 #include "utils.h"
 
+#include <climits>
 #include <glad/glad.h>
 #include <ft2build.h>
 #include FT_FREETYPE_H  
 
-void load_font(FontData* font_data, int font_height_px, const char* font_path)
+// Distance to the nearest texel of the other side, searched within the spread.
+// 0.5 is the glyph edge, above is inside.
+void write_glyph_distance_field(FT_Bitmap* glyph_bitmap, s32 spread, s32 field_width, s32 field_height, byte* field_memory)
 {
-	FT_Library ft_lib;
-	FT_Face ft_face;
+	s32 glyph_width = glyph_bitmap->width;
+	s32 glyph_height = glyph_bitmap->rows;
 
-	FT_Error init_ft_err = FT_Init_FreeType(&ft_lib);
-	assert(init_ft_err == 0);
+	auto is_inside = [&](s32 x, s32 y) -> bool
+	{
+		if (x < 0 || y < 0 || glyph_width <= x || glyph_height <= y) return false;
+		return 127 < glyph_bitmap->buffer[y * glyph_bitmap->pitch + x];
+	};
 
-	FT_Error new_face_err = FT_New_Face(ft_lib, font_path, 0, &ft_face);
-	assert(new_face_err == 0);
+	f32 max_distance = static_cast<f32>(spread);
+
+	for (s32 y = 0; y < field_height; y++)
+	{
+		for (s32 x = 0; x < field_width; x++)
+		{
+			s32 glyph_x = x - spread;
+			s32 glyph_y = y - spread;
+			bool inside = is_inside(glyph_x, glyph_y);
+			f32 distance_sq = max_distance * max_distance;
+
+			for (s32 dy = -spread; dy <= spread; dy++)
+			{
+				for (s32 dx = -spread; dx <= spread; dx++)
+				{
+					if (is_inside(glyph_x + dx, glyph_y + dy) == inside) continue;
+					f32 sample_distance_sq = static_cast<f32>(dx * dx + dy * dy);
+					if (sample_distance_sq < distance_sq) distance_sq = sample_distance_sq;
+				}
+			}
+
+			f32 distance = sqrtf(distance_sq) / max_distance;
+			f32 value = inside ? 0.5f + distance * 0.5f : 0.5f - distance * 0.5f;
+
+			// Flipped so that row 0 is the bottom of the glyph
+			s32 dest_index = (field_height - 1 - y) * field_width + x;
+			field_memory[dest_index] = static_cast<byte>(value * 255.0f + 0.5f);
+		}
+	}
+}
+
+u64 glyph_slot_hash(u32 codepoint)
+{
+	return (codepoint * 2654435761u) & (FONT_GLYPH_SLOTS_COUNT - 1);
+}
+
+s32 glyph_cache_find(FontData* font_data, u32 codepoint)
+{
+	u64 slot_index = glyph_slot_hash(codepoint);
 
-	FT_Set_Pixel_Sizes(ft_face, 0, font_height_px);
-	font_data->font_height_px = font_height_px;
+	for (;;)
+	{
+		GlyphCacheSlot* slot = &font_data->glyph_slots[slot_index];
+		if (slot->entry_index < 0) return -1;
+		if (slot->codepoint == codepoint) return slot->entry_index;
+		slot_index = (slot_index + 1) & (FONT_GLYPH_SLOTS_COUNT - 1);
+	}
+}
 
-	unsigned int bitmap_width = 0;
-	unsigned int bitmap_height = 0;
+void glyph_cache_insert_slot(FontData* font_data, u32 codepoint, s32 entry_index)
+{
+	u64 slot_index = glyph_slot_hash(codepoint);
 
-	constexpr int starting_char = 33; // ('!')
-	constexpr int last_char = 128;
+	while (0 <= font_data->glyph_slots[slot_index].entry_index)
+	{
+		slot_index = (slot_index + 1) & (FONT_GLYPH_SLOTS_COUNT - 1);
+	}
 
-	int spacebar_width = font_height_px / 4;
+	font_data->glyph_slots[slot_index] = { .codepoint = codepoint, .entry_index = entry_index };
+}
 
-	// Add spacebar
-	bitmap_width += spacebar_width;
+// Backward shift deletion keeps the linear probe chains intact without tombstones
+void glyph_cache_remove_slot(FontData* font_data, u32 codepoint)
+{
+	u64 mask = FONT_GLYPH_SLOTS_COUNT - 1;
+	u64 slot_index = glyph_slot_hash(codepoint);
 
-	for (int c = starting_char; c < last_char; c++)
+	while (font_data->glyph_slots[slot_index].codepoint != codepoint)
 	{
-		char character = static_cast<char>(c);
+		slot_index = (slot_index + 1) & mask;
+	}
 
-		FT_Error load_char_err = FT_Load_Char(ft_face, character, FT_LOAD_RENDER);
-		assert(load_char_err == 0);
+	u64 empty_index = slot_index;
 
-		unsigned int glyph_width = ft_face->glyph->bitmap.width;
-		unsigned int glyph_height = ft_face->glyph->bitmap.rows;
+	for (u64 i = (empty_index + 1) & mask; 0 <= font_data->glyph_slots[i].entry_index; i = (i + 1) & mask)
+	{
+		u64 home_index = glyph_slot_hash(font_data->glyph_slots[i].codepoint);
+		bool can_move = ((i - home_index) & mask) >= ((i - empty_index) & mask);
 
-		if (bitmap_height < glyph_height)
+		if (can_move)
 		{
-			bitmap_height = glyph_height;
+			font_data->glyph_slots[empty_index] = font_data->glyph_slots[i];
+			empty_index = i;
 		}
+	}
 
-		bitmap_width += glyph_width;
+	font_data->glyph_slots[empty_index] = { .codepoint = 0, .entry_index = -1 };
+}
+
+void glyph_lru_unlink(FontData* font_data, s32 entry_index)
+{
+	GlyphCacheEntry* entry = &font_data->glyphs[entry_index];
+
+	if (0 <= entry->lru_prev) font_data->glyphs[entry->lru_prev].lru_next = entry->lru_next;
+	else font_data->lru_head = entry->lru_next;
+
+	if (0 <= entry->lru_next) font_data->glyphs[entry->lru_next].lru_prev = entry->lru_prev;
+	else font_data->lru_tail = entry->lru_prev;
+
+	entry->lru_prev = -1;
+	entry->lru_next = -1;
+}
+
+void glyph_lru_push_front(FontData* font_data, s32 entry_index)
+{
+	GlyphCacheEntry* entry = &font_data->glyphs[entry_index];
+	entry->lru_prev = -1;
+	entry->lru_next = font_data->lru_head;
+
+	if (0 <= font_data->lru_head) font_data->glyphs[font_data->lru_head].lru_prev = entry_index;
+	else font_data->lru_tail = entry_index;
+
+	font_data->lru_head = entry_index;
+}
+
+// Oldest glyph not drawn this frame and not in a cached text run whose atlas rect can hold the new glyph
+s32 glyph_cache_evict(FontData* font_data, s32 rect_width, s32 rect_height, s64 frame)
+{
+	for (s32 i = font_data->lru_tail; 0 <= i; i = font_data->glyphs[i].lru_prev)
+	{
+		GlyphCacheEntry* entry = &font_data->glyphs[i];
+		if (entry->last_used_frame == frame) return -1;
+		if (0 < entry->run_references) continue;
+		if (entry->rect_width < rect_width || entry->rect_height < rect_height) continue;
+
+		glyph_cache_remove_slot(font_data, entry->codepoint);
+		glyph_lru_unlink(font_data, i);
+		font_data->glyphs_evicted++;
+		return i;
 	}
 
-	int bitmap_size = bitmap_width * bitmap_height;
-	assert(bitmap_size < TEMP_MEMORY.size);
+	return -1;
+}
+
+s32 rasterize_glyph(FontData* font_data, u32 codepoint, s64 frame)
+{
+	FT_Face ft_face = (FT_Face)font_data->ft_face;
+	s32 spread = FONT_SDF_SPREAD_PX;
+
+	FT_Error load_char_err = FT_Load_Char(ft_face, codepoint, FT_LOAD_RENDER);
+	if (load_char_err != 0) return -1;
+
+	FT_GlyphSlot glyph = ft_face->glyph;
+	s32 glyph_width = glyph->bitmap.width;
+	s32 glyph_height = glyph->bitmap.rows;
+
+	CharData new_char_data = { 0 };
 
-	byte* bitmap_memory = TEMP_MEMORY.memory;
+	// To advance cursors for next glyph
+	// bitshift by 6 to get value in pixels
+	// (2^6 = 64 (divide amount of 1/64th pixels by 64 to get amount of pixels))
+	// (note that advance is number of 1/64 pixels)
+	new_char_data.advance = (glyph->advance.x >> 6);
 
-	// Add spacebar
+	bool has_bitmap = 0 < glyph_width && 0 < glyph_height;
+
+	if (has_bitmap)
 	{
-		for (int y = 0; y < bitmap_height; y++)
-		{
-			int src_index = ((bitmap_height - 1) * spacebar_width) - y * spacebar_width;
-			int dest_index = y * bitmap_width;
-			memset(&bitmap_memory[dest_index], 0x00, spacebar_width);
-		}
+		new_char_data.width = glyph_width + 2 * spread;
+		new_char_data.height = glyph_height + 2 * spread;
+		new_char_data.x_offset = glyph->bitmap_left - spread;
+		new_char_data.y_offset = glyph->bitmap_top - glyph_height - spread;
+		if (FONT_GLYPH_FIELD_MAX_PX < new_char_data.width || FONT_GLYPH_FIELD_MAX_PX < new_char_data.height) return -1;
+	}
 
-		CharData new_char_data = { 0 };
-		new_char_data.character = static_cast<char>(' ');
-		new_char_data.width = spacebar_width;
-		new_char_data.advance = spacebar_width;
-		new_char_data.height = font_height_px;
-		new_char_data.UV_x0 = 0.0f;
-		new_char_data.UV_y0 = 1.0f;
-		new_char_data.UV_x1 = normalize_value(spacebar_width, bitmap_width, 1.0f);
-		new_char_data.UV_y1 = 1.0f;
-		font_data->char_data[0] = new_char_data;
+	// One texel gap so linear filtering does not bleed between glyphs
+	s32 rect_width = has_bitmap ? new_char_data.width + 1 : 0;
+	s32 rect_height = has_bitmap ? new_char_data.height + 1 : 0;
+	s32 rect_x = 0;
+	s32 rect_y = 0;
+	s32 entry_index = -1;
+
+	bool is_packed = !has_bitmap || skyline_packer_insert(&font_data->packer, rect_width, rect_height, &rect_x, &rect_y);
+
+	if (is_packed && font_data->glyphs_count < FONT_GLYPH_CACHE_MAX_COUNT)
+	{
+		entry_index = static_cast<s32>(font_data->glyphs_count++);
+	}
+	else
+	{
+		// The atlas rect is lost if the entries run out, but then the atlas is close to full anyway
+		entry_index = glyph_cache_evict(font_data, rect_width, rect_height, frame);
+		if (entry_index < 0) return -1;
+
+		GlyphCacheEntry* evicted = &font_data->glyphs[entry_index];
+		rect_x = evicted->rect_x;
+		rect_y = evicted->rect_y;
+		rect_width = evicted->rect_width;
+		rect_height = evicted->rect_height;
 	}
 
-	int bitmap_x_offset = spacebar_width;
-	int char_data_index = 1;
+	if (has_bitmap)
+	{
+		write_glyph_distance_field(&glyph->bitmap, spread, new_char_data.width, new_char_data.height, font_data->field_scratch);
+
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		gl_bind_texture(GL_TEXTURE_2D, font_data->texture_id);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, rect_x, rect_y, new_char_data.width, new_char_data.height, GL_RED, GL_UNSIGNED_BYTE, font_data->field_scratch);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		g_frame_data.bytes_uploaded += new_char_data.width * new_char_data.height;
+
+		f32 atlas_size = static_cast<f32>(FONT_ATLAS_SIZE_PX);
+		new_char_data.UV_x0 = normalize_value(rect_x, atlas_size, 1.0f);
+		new_char_data.UV_y0 = normalize_value(rect_y, atlas_size, 1.0f);
+		new_char_data.UV_x1 = normalize_value(rect_x + new_char_data.width, atlas_size, 1.0f);
+		new_char_data.UV_y1 = normalize_value(rect_y + new_char_data.height, atlas_size, 1.0f);
+	}
+
+	font_data->glyphs[entry_index] = {
+		.char_data = new_char_data,
+		.codepoint = codepoint,
+		.rect_x = rect_x,
+		.rect_y = rect_y,
+		.rect_width = rect_width,
+		.rect_height = rect_height,
+		.last_used_frame = frame,
+		.run_references = 0,
+		.lru_prev = -1,
+		.lru_next = -1
+	};
+
+	glyph_cache_insert_slot(font_data, codepoint, entry_index);
+	glyph_lru_push_front(font_data, entry_index);
+	font_data->glyphs_rasterized++;
+	return entry_index;
+}
+
+void touch_font_glyph(FontData* font_data, s32 entry_index)
+{
+	if (font_data->lru_head != entry_index)
+	{
+		glyph_lru_unlink(font_data, entry_index);
+		glyph_lru_push_front(font_data, entry_index);
+	}
+
+	font_data->glyphs[entry_index].last_used_frame = static_cast<s64>(g_game_metrics.frames);
+}
+
+s32 get_font_glyph_entry(FontData* font_data, u32 codepoint)
+{
+	s32 entry_index = glyph_cache_find(font_data, codepoint);
 
-	for (int c = starting_char; c < last_char; c++)
+	if (entry_index < 0)
 	{
-		int character = c;
+		entry_index = rasterize_glyph(font_data, codepoint, static_cast<s64>(g_game_metrics.frames));
 
-		FT_Error load_char_err = FT_Load_Char(ft_face, character, FT_LOAD_RENDER);
-		assert(load_char_err == 0);
+		// Out of atlas space for this frame, fall back to the replacement glyph
+		if (entry_index < 0 && codepoint != '?') return get_font_glyph_entry(font_data, '?');
+		return entry_index;
+	}
 
-		unsigned int glyph_width = ft_face->glyph->bitmap.width;
-		unsigned int glyph_height = ft_face->glyph->bitmap.rows;
+	touch_font_glyph(font_data, entry_index);
+	return entry_index;
+}
 
-		int x_offset = ft_face->glyph->bitmap_left;
-		int y_offset = ft_face->glyph->bitmap_top - ft_face->glyph->bitmap.rows;
+CharData* get_font_glyph(FontData* font_data, u32 codepoint)
+{
+	s32 entry_index = get_font_glyph_entry(font_data, codepoint);
+	if (entry_index < 0) return nullptr;
+
+	return &font_data->glyphs[entry_index].char_data;
+}
 
-		for (int y = 0; y < glyph_height; y++)
+u32 utf8_next_codepoint(char** text)
+{
+	byte* bytes = (byte*)*text;
+	u32 codepoint = 0xFFFD;
+	s64 length = 1;
+
+	if (bytes[0] < 0x80) codepoint = bytes[0];
+	else if ((bytes[0] & 0xE0) == 0xC0) { codepoint = bytes[0] & 0x1F; length = 2; }
+	else if ((bytes[0] & 0xF0) == 0xE0) { codepoint = bytes[0] & 0x0F; length = 3; }
+	else if ((bytes[0] & 0xF8) == 0xF0) { codepoint = bytes[0] & 0x07; length = 4; }
+
+	for (s64 i = 1; i < length; i++)
+	{
+		// Truncated or malformed sequence, skip only the lead byte
+		if ((bytes[i] & 0xC0) != 0x80)
 		{
-			int src_index = ((glyph_height - 1) * glyph_width) - y * glyph_width;
-			int dest_index = y * bitmap_width + bitmap_x_offset;
-			memcpy(&bitmap_memory[dest_index], &ft_face->glyph->bitmap.buffer[src_index], glyph_width);
+			*text += 1;
+			return 0xFFFD;
 		}
 
-		// To advance cursors for next glyph
-		// bitshift by 6 to get value in pixels
-		// (2^6 = 64 (divide amount of 1/64th pixels by 64 to get amount of pixels))
-		// (note that advance is number of 1/64 pixels)
-		int advance = (ft_face->glyph->advance.x >> 6);
+		codepoint = (codepoint << 6) | (bytes[i] & 0x3F);
+	}
+
+	*text += length;
+	return codepoint;
+}
 
-		CharData new_char_data = { 0 };
-		new_char_data.character = static_cast<char>(c);
+void load_font(FontData* font_data, int reference_height_px, const char* font_path)
+{
+	PROFILE_ZONE("Load font");
+	FT_Library ft_lib;
+	FT_Face ft_face;
+
+	FT_Error init_ft_err = FT_Init_FreeType(&ft_lib);
+	assert(init_ft_err == 0);
 
-		new_char_data.width = glyph_width;
-		new_char_data.height = glyph_height;
-		new_char_data.x_offset = x_offset;
-		new_char_data.y_offset = y_offset;
-		new_char_data.advance = advance;
+	FT_Error new_face_err = FT_New_Face(ft_lib, font_path, 0, &ft_face);
+	assert(new_face_err == 0);
 
-		float atlas_width = static_cast<float>(bitmap_width);
-		float atlas_height = static_cast<float>(bitmap_height);
+	// The face stays open, glyphs are rasterized when first drawn
+	FT_Set_Pixel_Sizes(ft_face, 0, reference_height_px);
+	font_data->ft_library = ft_lib;
+	font_data->ft_face = ft_face;
+	font_data->font_height_px = reference_height_px;
+	if (font_data->font_scale <= 0.0f) font_data->font_scale = 1.0f;
+
+	s64 sizeof_glyphs = sizeof(GlyphCacheEntry) * FONT_GLYPH_CACHE_MAX_COUNT;
+	s64 sizeof_slots = sizeof(GlyphCacheSlot) * FONT_GLYPH_SLOTS_COUNT;
+	s64 sizeof_scratch = FONT_GLYPH_FIELD_MAX_PX * FONT_GLYPH_FIELD_MAX_PX;
+	memory_buffer_mallocate(&font_data->memory, sizeof_glyphs + sizeof_slots + sizeof_scratch, const_cast<char*>("Font glyph cache"));
+
+	font_data->glyphs = (GlyphCacheEntry*)memory_buffer_suballocate(&font_data->memory, sizeof_glyphs).memory;
+	font_data->glyph_slots = (GlyphCacheSlot*)memory_buffer_suballocate(&font_data->memory, sizeof_slots).memory;
+	font_data->field_scratch = memory_buffer_suballocate(&font_data->memory, sizeof_scratch).memory;
+	font_data->glyphs_count = 0;
+	font_data->lru_head = -1;
+	font_data->lru_tail = -1;
+
+	for (s64 i = 0; i < FONT_GLYPH_SLOTS_COUNT; i++)
+	{
+		font_data->glyph_slots[i] = { .codepoint = 0, .entry_index = -1 };
+	}
 
-		new_char_data.UV_x0 = normalize_value(bitmap_x_offset, atlas_width, 1.0f);
-		new_char_data.UV_y0 = normalize_value(0.0f, atlas_height, 1.0f);
+	skyline_packer_init(&font_data->packer, FONT_ATLAS_SIZE_PX, FONT_ATLAS_SIZE_PX);
 
-		float x1 = bitmap_x_offset + glyph_width;
-		new_char_data.UV_x1 = normalize_value(x1, atlas_width, 1.0f);
-		new_char_data.UV_y1 = normalize_value(glyph_height, atlas_height, 1.0f);
+	s64 temp_memory_used = TEMP_MEMORY.used_sub_allocation_capacity;
+	s64 atlas_bytes = FONT_ATLAS_SIZE_PX * FONT_ATLAS_SIZE_PX;
+	byte* bitmap_memory = memory_buffer_suballocate(&TEMP_MEMORY, atlas_bytes).memory;
+	memset(bitmap_memory, 0x00, atlas_bytes);
+	create_font_atlas_texture(font_data, FONT_ATLAS_SIZE_PX, FONT_ATLAS_SIZE_PX, bitmap_memory);
+	TEMP_MEMORY.used_sub_allocation_capacity = temp_memory_used;
 
-		font_data->char_data[char_data_index++] = new_char_data;
-		bitmap_x_offset += glyph_width;
+	// Printable ASCII is drawn every frame, rasterize it up front
+	for (u32 c = ' '; c < 127; c++)
+	{
+		get_font_glyph(font_data, c);
 	}
 
-	create_font_atlas_texture(font_data, bitmap_width, bitmap_height, bitmap_memory);
+	printf("load_font(): %s, %lld glyphs cached.\n", font_path, font_data->glyphs_count);
+}
+
+void set_font_height(FontData* font_data, int font_height_px)
+{
+	font_data->font_scale = static_cast<f32>(font_height_px) / static_cast<f32>(font_data->font_height_px);
 }
 
 void create_font_atlas_texture(FontData* font_data, s32 bitmap_width, s32 bitmap_height, byte* bitmap_memory)
@@ -138,16 +377,120 @@ void create_font_atlas_texture(FontData* font_data, s32 bitmap_width, s32 bitmap
 
 	GLuint new_texture;
 	GLuint prev_texture = font_data->texture_id;
-	glDeleteTextures(1, &prev_texture);
+	gl_delete_textures(1, &prev_texture);
 	glGenTextures(1, &new_texture);
 	font_data->texture_id = static_cast<int>(new_texture);
-	glBindTexture(GL_TEXTURE_2D, font_data->texture_id);
+	gl_bind_texture(GL_TEXTURE_2D, font_data->texture_id);
 
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_ALPHA, bitmap_width, bitmap_height, 0, GL_ALPHA, GL_UNSIGNED_BYTE, bitmap_memory);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, bitmap_width, bitmap_height, 0, GL_RED, GL_UNSIGNED_BYTE, bitmap_memory);
 
 	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
-}
\ No newline at end of file
+}
+
+void skyline_packer_init(SkylinePacker* packer, s32 width, s32 height)
+{
+	packer->width = width;
+	packer->height = height;
+	packer->nodes_count = 1;
+	packer->nodes[0] = { .x = 0, .y = 0, .width = width };
+}
+
+// Lowest y the rectangle can sit at when its left edge is on the node, -1 if it does not fit
+s32 skyline_packer_fit(SkylinePacker* packer, s64 node_index, s32 width, s32 height)
+{
+	s32 x = packer->nodes[node_index].x;
+	if (packer->width < x + width) return -1;
+
+	s32 y = 0;
+	s32 width_left = width;
+
+	for (s64 i = node_index; 0 < width_left; i++)
+	{
+		y = glm::max(y, packer->nodes[i].y);
+		if (packer->height < y + height) return -1;
+		width_left -= packer->nodes[i].width;
+	}
+
+	return y;
+}
+
+void skyline_packer_remove_node(SkylinePacker* packer, s64 node_index)
+{
+	for (s64 i = node_index; i < packer->nodes_count - 1; i++)
+	{
+		packer->nodes[i] = packer->nodes[i + 1];
+	}
+
+	packer->nodes_count--;
+}
+
+bool skyline_packer_insert(SkylinePacker* packer, s32 width, s32 height, s32* out_x, s32* out_y)
+{
+	s64 best_index = -1;
+	s32 best_top = INT_MAX;
+	s32 best_width = INT_MAX;
+	s32 best_y = 0;
+
+	for (s64 i = 0; i < packer->nodes_count; i++)
+	{
+		s32 y = skyline_packer_fit(packer, i, width, height);
+		if (y < 0) continue;
+
+		SkylineNode node = packer->nodes[i];
+		bool is_better = y + height < best_top || (y + height == best_top && node.width < best_width);
+
+		if (is_better)
+		{
+			best_index = i;
+			best_top = y + height;
+			best_width = node.width;
+			best_y = y;
+		}
+	}
+
+	if (best_index < 0) return false;
+	ASSERT_TRUE(packer->nodes_count < SKYLINE_MAX_NODES, "Skyline has room for a node");
+
+	for (s64 i = packer->nodes_count; best_index < i; i--)
+	{
+		packer->nodes[i] = packer->nodes[i - 1];
+	}
+
+	s32 best_x = packer->nodes[best_index].x;
+	packer->nodes_count++;
+	packer->nodes[best_index] = { .x = best_x, .y = best_y + height, .width = width };
+
+	// Cut the nodes that are now under the new one
+	for (s64 i = best_index + 1; i < packer->nodes_count; )
+	{
+		SkylineNode prev = packer->nodes[i - 1];
+		SkylineNode* node = &packer->nodes[i];
+		s32 overlap = prev.x + prev.width - node->x;
+
+		if (overlap <= 0) break;
+
+		node->x += overlap;
+		node->width -= overlap;
+
+		if (0 < node->width) break;
+		skyline_packer_remove_node(packer, i);
+	}
+
+	for (s64 i = 0; i < packer->nodes_count - 1; )
+	{
+		if (packer->nodes[i].y == packer->nodes[i + 1].y)
+		{
+			packer->nodes[i].width += packer->nodes[i + 1].width;
+			skyline_packer_remove_node(packer, i + 1);
+		}
+		else i++;
+	}
+
+	*out_x = best_x;
+	*out_y = best_y;
+	return true;
+}
@@ -3,6 +3,22 @@
 #include "structs.h"
 #include "types.h"
 
-void load_font(FontData* font_data, int font_height_px, const char* font_path);
+void load_font(FontData* font_data, int reference_height_px, const char* font_path);
+
+void set_font_height(FontData* font_data, int font_height_px);
+
+CharData* get_font_glyph(FontData* font_data, u32 codepoint);
+
+// Glyph cache entry index of a codepoint, -1 when it has no glyph
+s32 get_font_glyph_entry(FontData* font_data, u32 codepoint);
+
+// Marks a glyph as drawn this frame without looking it up
+void touch_font_glyph(FontData* font_data, s32 entry_index);
+
+u32 utf8_next_codepoint(char** text);
 
 void create_font_atlas_texture(FontData* font_data, s32 bitmap_width, s32 bitmap_height, byte* bitmap_memory);
+
+void skyline_packer_init(SkylinePacker* packer, s32 width, s32 height);
+
+bool skyline_packer_insert(SkylinePacker* packer, s32 width, s32 height, s32* out_x, s32* out_y);
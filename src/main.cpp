@@ -16,6 +16,8 @@
 #include "jinput.h"
 #include "j_map.h"
 #include "j_render.h"
+#include "j_render_targets.h"
+#include "j_shadow_atlas.h"
 #include "j_strings.h"
 
 void init_openal()
@@ -80,21 +82,32 @@ void init_window_and_context()
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height)
 {
-	resize_windows_area_settings(width, height);
-	glViewport(0, 0, g_game_metrics.scene_width_px, g_game_metrics.scene_height_px);
+	// Applied once the size stops changing, dragging the window edge would otherwise resize every frame
+	g_pending_resize = {
+		.width_px = width,
+		.height_px = height,
+		.requested_time = glfwGetTime(),
+		.is_pending = true
+	};
+}
+
+void apply_pending_resize()
+{
+	if (!g_pending_resize.is_pending) return;
 
-	glGenFramebuffers(1, &g_scene_framebuffer.id);
-	glBindFramebuffer(GL_FRAMEBUFFER, g_scene_framebuffer.id);
-	init_framebuffer_resize(&g_scene_framebuffer.texture_gpu_id, &g_scene_framebuffer.renderbuffer);
+	bool is_first_size = g_game_metrics.game_width_px == 0;
+	bool has_settled = WINDOW_RESIZE_SETTLE_SECONDS <= glfwGetTime() - g_pending_resize.requested_time;
+	if (!is_first_size && !has_settled) return;
 
-	glGenFramebuffers(1, &editor_framebuffer.id);
-	glBindFramebuffer(GL_FRAMEBUFFER, editor_framebuffer.id);
-	init_framebuffer_resize(&editor_framebuffer.texture_gpu_id, &editor_framebuffer.renderbuffer);
+	s32 width = g_pending_resize.width_px;
+	s32 height = g_pending_resize.height_px;
+	g_pending_resize.is_pending = false;
+
+	resize_windows_area_settings(width, height);
+	gl_viewport(0, 0, g_game_metrics.scene_width_px, g_game_metrics.scene_height_px);
 
-	if (get_allocated_temp_memory() <= 0) allocate_temp_memory(MEGABYTES(1));
 	int font_height_px = normalize_value(debug_font_vh, 100.0f, (float)height);
-	load_font(&g_debug_font, font_height_px, g_debug_font_path);
-	deallocate_temp_memory();
+	set_font_height(&g_debug_font, font_height_px);
 }
 
 void mouse_move_callback(GLFWwindow* window, double xposIn, double yposIn)
@@ -117,9 +130,11 @@ void set_button_state(GLFWwindow* window, ButtonState* button)
 int main(int argc, char* argv[])
 {
 	init_memory_buffers();
+	profiler_init(&g_profiler);
 
 	init_openal();
 	init_window_and_context();
+	gl_state_invalidate(&g_gl_state);
 
 	init_imgui();
 	init_all_shaders();
@@ -134,14 +149,16 @@ int main(int argc, char* argv[])
 
 	load_core_textures();
 	init_framebuffers();
+	gpu_profiler_init(&g_gpu_profiler);
+	load_font(&g_debug_font, FONT_SDF_REFERENCE_PX, g_debug_font_path);
 
 	glfwSetWindowSize(g_window, g_user_settings.window_size_px[0], g_user_settings.window_size_px[1]);
 
-	glEnable(GL_DEPTH_TEST);
-	glEnable(GL_BLEND);
+	gl_enable(GL_DEPTH_TEST);
+	gl_enable(GL_BLEND);
 
-	glEnable(GL_CULL_FACE);
-	glCullFace(GL_BACK);
+	gl_enable(GL_CULL_FACE);
+	gl_cull_face(GL_BACK);
 	glFrontFace(GL_CCW);
 
 	glClearColor(1.0f, 0.0f, 1.0f, 1.0f);
@@ -151,10 +168,18 @@ int main(int argc, char* argv[])
 
 	while (!glfwWindowShouldClose(g_window))
 	{
+		profiler_begin_frame(&g_profiler);
+		PROFILE_ZONE("Frame");
+
 		// -------------
 		// Inputs
 
-		glfwPollEvents();
+		{
+			PROFILE_ZONE("Poll events");
+			glfwPollEvents();
+		}
+
+		apply_pending_resize();
 		imgui_new_frame();
 		right_hand_editor_panel();
 
@@ -205,22 +230,49 @@ int main(int argc, char* argv[])
 		// -------------
 		// Draw OpenGL
 
+		update_shadow_atlas_tiles();
 		update_ubos();
+		update_scene_visibility();
+		build_mesh_instances();
 
-		draw_shadow_map_framebuffers();
-		draw_scene_framebuffer();
-		draw_editor_framebuffer();
-		draw_main_framebuffer();
+		stream_buffer_begin_frame(&g_stream_buffer);
+		bool has_gpu_frame_time = gpu_profiler_begin_frame(&g_gpu_profiler);
 
-		if (DEBUG_SHADOWMAP && g_selected_object.type == ObjectType::Spotlight) draw_selected_shadow_map();
+		frame_graph_reset(&g_frame_graph);
+		build_frame_graph(&g_frame_graph);
+		frame_graph_compile(&g_frame_graph);
+		frame_graph_execute(&g_frame_graph, &g_render_target_pool);
+		render_target_pool_end_frame(&g_render_target_pool);
 
 		print_debug_texts();
+		text_layout_cache_end_frame(&g_text_layout_cache);
 		imgui_end_frame();
-		glfwSwapBuffers(g_window);
+		stream_buffer_end_frame(&g_stream_buffer);
+
+		// CPU time up to the swap, GPU time of the newest frame the profiler has read back
+		f32 cpu_frame_ms = (f32)(profiler_now_ns() - g_profiler.frame_begin_ns) / 1000000.0f;
+		frame_time_series_push(&g_frame_times.cpu, cpu_frame_ms);
+		if (has_gpu_frame_time) frame_time_series_push(&g_frame_times.gpu, g_gpu_profiler.frame_gpu_ms);
+
+		{
+			PROFILE_ZONE("Swap buffers");
+			glfwSwapBuffers(g_window);
+		}
 
 		g_game_metrics.frames++;
 		g_game_metrics.fps_frames++;
 		g_frame_data.draw_calls = 0;
+		g_frame_data.state_changes = 0;
+		g_frame_data.shadow_cache_hits = 0;
+		g_frame_data.shadow_cache_misses = 0;
+		g_frame_data.shadow_casters_drawn = 0;
+		g_frame_data.bytes_uploaded = 0;
+		g_frame_data.bytes_streamed = 0;
+		g_frame_data.text_layout_hits = 0;
+		g_frame_data.text_layout_misses = 0;
+		g_frame_data.render_targets_aliased = 0;
+		g_frame_data.gl_calls_issued = 0;
+		g_frame_data.gl_calls_skipped = 0;
 	}
 
 	glfwTerminate();
@@ -7,6 +7,8 @@ void enable_cursor(bool enable);
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 
+void apply_pending_resize();
+
 void mouse_move_callback(GLFWwindow* window, double xposIn, double yposIn);
 
 void set_button_state(GLFWwindow* window, ButtonState* button);
@@ -74,6 +74,7 @@ void save_scene(char* filepath)
 
 void load_scene(char* filepath)
 {
+	PROFILE_ZONE("Load scene");
 	float h_aspect = (float)g_game_metrics.scene_width_px / (float)g_game_metrics.scene_height_px;
 
 	ASSERT_TRUE(std::filesystem::exists(filepath), "Scene filepath exists");
@@ -183,6 +184,7 @@ void new_scene()
 
 void try_get_mouse_selection(s32 xpos, s32 ypos)
 {
+	PROFILE_ZONE("Mouse selection");
 	glm::vec3 ray_origin = g_scene_camera.position;
 	glm::vec3 ray_direction = get_camera_ray_from_scene_px(xpos, ypos);
 
@@ -4,6 +4,7 @@
 #include "types.h"
 #include "constants.h"
 #include "j_array.h"
+#include "j_buffers.h"
 
 typedef struct Transforms {
 	glm::vec3 translation;
@@ -30,11 +31,18 @@ typedef struct MaterialData {
 	f32 shininess;
 } MaterialData;
 
+typedef struct Aabb {
+	glm::vec3 min;
+	glm::vec3 max;
+} Aabb;
+
 typedef struct Mesh {
 	Transforms transforms;
 	Material* material;
 	MeshType mesh_type;
 	f32 uv_multiplier;
+	Transforms bounds_transforms; // Transforms the cached bounds were computed from
+	Aabb bounds;
 } Mesh;
 
 typedef struct MeshData {
@@ -44,12 +52,114 @@ typedef struct MeshData {
 	f32 uv_multiplier;
 } MeshData;
 
+// Per-instance vertex attributes, locations 3 - 10
+typedef struct MeshInstance {
+	glm::mat4 model;
+	glm::mat3 normal_matrix;
+	f32 uv_multiplier;
+} MeshInstance;
+
+typedef struct MeshBatch {
+	MeshType mesh_type;
+	Material* material;
+	bool is_visible;
+	s64 first_instance;
+	s64 instances_count;
+} MeshBatch;
+
+// Scene meshes sorted by (mesh type, visibility, material), rebuilt every frame
+typedef struct MeshInstances {
+	u32 vbo;
+	JArray instances;
+	JArray batches;
+	s64 type_first_instance[PRIMITIVE_MESH_TYPES_COUNT];
+	s64 type_instances_count[PRIMITIVE_MESH_TYPES_COUNT];
+	s32* scene_instance_slots; // Instance of each plane, then each mesh, in scene order
+} MeshInstances;
+
+typedef struct BillboardInstance {
+	glm::vec3 position;
+	f32 scale;
+	f32 texture_layer;
+} BillboardInstance;
+
+// Billboards collected during the frame, drawn back to front in one instanced call
+typedef struct BillboardBatch {
+	u32 vbo;
+	u32 texture_array_id;
+	JArray instances;
+} BillboardBatch;
+
+typedef struct LightClusterBuffers {
+	u32 grid_buffer;
+	u32 grid_texture;
+	u32 indices_buffer;
+	u32 indices_texture;
+} LightClusterBuffers;
+
+// Instances of the casters visible to one spotlight, rebuilt for every shadow map drawn
+typedef struct ShadowCasters {
+	u32 vbo;
+	s64 vbo_instances_used;
+	JArray instances;
+	s32* caster_indices;
+	s64 type_first_instance[PRIMITIVE_MESH_TYPES_COUNT];
+	s64 type_instances_count[PRIMITIVE_MESH_TYPES_COUNT];
+} ShadowCasters;
+
+typedef struct PrimitiveRange {
+	s64 base_vertex;
+	s64 first_index;
+	s64 index_count;
+} PrimitiveRange;
+
+typedef struct PrimitiveGeometry {
+	u32 vbo;
+	u32 ibo;
+	PrimitiveRange ranges[PRIMITIVE_MESH_TYPES_COUNT];
+} PrimitiveGeometry;
+
 typedef struct Framebuffer {
 	u32 id;
 	u32 texture_gpu_id;
 	u32 renderbuffer;
 } Framebuffer;
 
+typedef struct RenderTargetDesc {
+	s32 width_px;
+	s32 height_px;
+	u32 color_formats[RENDER_TARGET_MAX_COLORS]; // Internal formats, 0 for unused attachments
+	u32 depth_format; // 0 for no depth
+} RenderTargetDesc;
+
+// Framebuffer with its own textures, handed out by the render target pool
+typedef struct RenderTarget {
+	RenderTargetDesc desc;
+	u32 id;
+	u32 color_textures[RENDER_TARGET_MAX_COLORS];
+	u32 depth_texture;
+	s32 draw_buffers_count; // Fewer than its color attachments while it aliases a smaller desc
+	s64 size_bytes;
+	s64 last_used_frame;
+	bool in_use;
+} RenderTarget;
+
+typedef struct RenderTargetPool {
+	RenderTarget targets[RENDER_TARGET_POOL_MAX_COUNT];
+	s64 targets_count;
+	s64 targets_in_use;
+	s64 bytes_allocated;
+	s64 created_count;
+	s64 destroyed_count;
+} RenderTargetPool;
+
+typedef struct WindowResize {
+	s32 width_px;
+	s32 height_px;
+	f64 requested_time;
+	bool is_pending;
+} WindowResize;
+
 typedef struct Pointlight {
 	Transforms transforms;
 	glm::vec3 diffuse;
@@ -59,8 +169,23 @@ typedef struct Pointlight {
 	bool is_on;
 } Pointlight;
 
+typedef struct ShadowAtlasTile {
+	s64 x_px;
+	s64 y_px;
+	s64 size_px; // Zero when the light has no shadow
+	s64 requested_px; // Size wanted when the tile was granted, larger than size_px when the atlas was full
+} ShadowAtlasTile;
+
+typedef struct ShadowAtlas {
+	u32 framebuffer_id;
+	u32 texture_id;
+	s64 size_px;
+	bool cells_used[SHADOW_ATLAS_CELLS_PER_ROW * SHADOW_ATLAS_CELLS_PER_ROW];
+	s64 cells_used_count; // After the last tile update
+} ShadowAtlas;
+
 typedef struct Spotlight {
-	Framebuffer shadow_map;
+	ShadowAtlasTile shadow_tile;
 	Transforms transforms;
 	glm::vec3 diffuse;
 	f32 specular;
@@ -68,8 +193,49 @@ typedef struct Spotlight {
 	f32 fov;
 	f32 outer_cutoff_fov;
 	bool is_on;
+	bool shadow_dirty; // Shadow map is redrawn only when set
+	s64 shadow_casters_count; // From the last time the shadow map was drawn
 } Spotlight;
 
+// std140 mirrors of the Lights uniform block in lighting_common_fs.glsl
+
+typedef struct PointlightStd140 {
+	glm::vec3 position;
+	f32 range;
+	glm::vec3 diffuse;
+	f32 specular;
+	f32 intensity;
+	f32 padding[3];
+} PointlightStd140;
+
+typedef struct SpotlightStd140 {
+	glm::mat4 light_space_matrix;
+	glm::vec4 shadow_rect; // Atlas uv offset in xy, uv scale in zw
+	glm::vec3 position;
+	f32 range;
+	glm::vec3 direction;
+	f32 cutoff;
+	glm::vec3 diffuse;
+	f32 specular;
+	f32 outer_cutoff;
+	f32 padding[3];
+} SpotlightStd140;
+
+typedef struct LightsBlock {
+	glm::vec4 view_coords;
+	glm::vec4 global_ambient_light;
+	s32 pointlights_count;
+	s32 spotlights_count;
+	s32 padding[2];
+	glm::vec4 cluster_scale; // Clusters per pixel in xy, depth slice scale and bias in zw
+	PointlightStd140 pointlights[LIGHTS_UBO_POINTLIGHTS_MAX_COUNT];
+	SpotlightStd140 spotlights[LIGHTS_UBO_SPOTLIGHTS_MAX_COUNT];
+} LightsBlock;
+
+static_assert(sizeof(PointlightStd140) == 48, "PointlightStd140 does not match std140 layout");
+static_assert(sizeof(SpotlightStd140) == 144, "SpotlightStd140 does not match std140 layout");
+static_assert(sizeof(LightsBlock) <= 16384, "LightsBlock exceeds the minimum GL_MAX_UNIFORM_BLOCK_SIZE");
+
 typedef struct SpotlightSerialized {
 	Transforms transforms;
 	glm::vec3 diffuse;
@@ -150,6 +316,21 @@ typedef struct GameMetrics {
 
 typedef struct FrameData {
 	s64 draw_calls;
+	s64 state_changes;
+	s64 bytes_uploaded;
+	s64 bytes_streamed;
+	s64 objects_visible;
+	s64 objects_culled;
+	f32 culling_ms;
+	s64 shadow_cache_hits;
+	s64 shadow_cache_misses;
+	s64 shadow_casters_drawn;
+	s64 light_cluster_indices;
+	s64 text_layout_hits;
+	s64 text_layout_misses;
+	s64 render_targets_aliased; // Acquires served by a target with more color attachments
+	s64 gl_calls_issued;
+	s64 gl_calls_skipped;
 	f32 mouse_x;
 	f32 mouse_y;
 	f32 mouse_move_x;
@@ -181,14 +362,63 @@ typedef struct CharData {
 	int x_offset;
 	int y_offset;
 	int advance;
-	char character;
 } CharData;
 
+typedef struct UiTextVertex {
+	glm::vec3 position;
+	glm::vec2 uv;
+	u32 color; // RGBA8, R in the lowest byte
+} UiTextVertex;
+
+typedef struct SkylineNode {
+	s32 x;
+	s32 y;
+	s32 width;
+} SkylineNode;
+
+// Bottom-left skyline rectangle packer, nodes are the top edges of the packed area from left to right
+typedef struct SkylinePacker {
+	s32 width;
+	s32 height;
+	s64 nodes_count;
+	SkylineNode nodes[SKYLINE_MAX_NODES];
+} SkylinePacker;
+
+typedef struct GlyphCacheEntry {
+	CharData char_data;
+	u32 codepoint;
+	s32 rect_x; // Atlas rect the glyph owns, reused when the glyph is evicted
+	s32 rect_y;
+	s32 rect_width;
+	s32 rect_height;
+	s64 last_used_frame;
+	s32 run_references; // Cached text layout runs drawing this glyph, it is not evicted while any are
+	s32 lru_prev;
+	s32 lru_next;
+} GlyphCacheEntry;
+
+typedef struct GlyphCacheSlot {
+	u32 codepoint;
+	s32 entry_index; // -1 when empty
+} GlyphCacheSlot;
+
+// Glyphs are rasterized into the atlas the first time a codepoint is drawn
 typedef struct FontData {
-	std::array<CharData, 96> char_data = { 0 };
+	MemoryBuffer memory;
+	void* ft_library;
+	void* ft_face;
+	GlyphCacheEntry* glyphs;
+	s64 glyphs_count;
+	GlyphCacheSlot* glyph_slots;
+	s32 lru_head; // Most recently used
+	s32 lru_tail;
+	byte* field_scratch;
+	SkylinePacker packer;
 	int texture_id;
-	float font_scale;
-	int font_height_px;
+	float font_scale; // Drawn height / font_height_px
+	int font_height_px; // Height the atlas was rendered at
+	s64 glyphs_rasterized;
+	s64 glyphs_evicted;
 } FontData;
 
 typedef struct UserSettings {
@@ -197,6 +427,8 @@ typedef struct UserSettings {
 	f32 transform_clip;
 	f32 transform_rotation_clip;
 	bool use_skybox;
+	bool use_deferred_shading;
+	bool use_depth_prepass;
 } UserSettings;
 
 typedef struct MaterialIdData {
@@ -204,10 +436,19 @@ typedef struct MaterialIdData {
 	s64 material_id;
 } MaterialIdData;
 
+typedef struct ShaderUniform {
+	u32 name_hash;
+	s32 location;
+} ShaderUniform;
+
 typedef struct SimpleShader {
 	u32 id;
 	u32 vao;
 	u32 vbo;
+	s64 uniforms_count;
+	s64 uniform_blocks_count;
+	ShaderUniform uniforms[SHADER_UNIFORMS_CAPACITY];
+	ShaderUniform uniform_blocks[SHADER_UNIFORM_BLOCKS_CAPACITY];
 } SimpleShader;
 
 typedef struct PostProcessingSettings {
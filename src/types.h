@@ -38,12 +38,24 @@ enum class MeshType {
 	Cube
 };
 
+// Layers of the billboard texture array
+enum class BillboardLayer {
+	Pointlight,
+	Spotlight
+};
+
 enum class TransformMode {
 	Translate,
 	Rotate,
 	Scale
 };
 
+enum class FrameGraphResourceType {
+	Transient,
+	Backbuffer,
+	External
+};
+
 enum class ObjectType {
 	None,
 	Plane,
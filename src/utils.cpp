@@ -9,6 +9,7 @@
 #include "j_assert.h"
 #include "j_buffers.h"
 #include "j_render.h"
+#include "j_shadow_atlas.h"
 #include "j_strings.h"
 
 glm::mat4 get_projection_matrix()
@@ -307,39 +308,10 @@ Framebuffer framebuffer_init()
 	return buffer;
 }
 
-Framebuffer init_spotlight_shadow_map()
-{
-	Framebuffer shadow_map = framebuffer_init();
-
-	glGenFramebuffers(1, &shadow_map.id);
-	glGenTextures(1, &shadow_map.texture_gpu_id);
-	glBindTexture(GL_TEXTURE_2D, shadow_map.texture_gpu_id);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, SHADOW_MAP_WIDTH, SHADOW_MAP_HEIGHT, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
-
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
-
-	float borderColor[] = { 1.0f, 1.0f, 1.0f, 1.0f };
-	glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, borderColor);
-
-	glBindFramebuffer(GL_FRAMEBUFFER, shadow_map.id);
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, shadow_map.texture_gpu_id, 0);
-	glDrawBuffer(GL_NONE);
-	glDrawBuffer(GL_NONE);
-	glReadBuffer(GL_NONE);
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
-
-	ASSERT_TRUE(shadow_map.id != 0 && shadow_map.texture_gpu_id != 0, "Shadow map creation");
-
-	return shadow_map;
-}
-
 Spotlight spotlight_init()
 {
 	Spotlight sp = {
-		.shadow_map = init_spotlight_shadow_map(),
+		.shadow_tile = {},
 		.transforms = transforms_init(),
 		.diffuse = glm::vec3(1),
 		.specular = 2.0f,
@@ -347,6 +319,7 @@ Spotlight spotlight_init()
 		.fov = 90.0f,
 		.outer_cutoff_fov = 90.0f,
 		.is_on = true,
+		.shadow_dirty = true,
 	};
 	return sp;
 }
@@ -400,38 +373,103 @@ SimpleShader simple_shader_init()
 		.id = 0,
 		.vao = 0,
 		.vbo = 0,
+		.uniforms_count = 0,
+		.uniform_blocks_count = 0,
 	};
 	return shader;
 }
 
 void print_debug_texts()
 {
+	PROFILE_ZONE("Debug texts");
 	char debug_str[256];
+	glm::vec4 text_color = glm::vec4(0.9f, 0.9f, 0.9f, 1.0f);
+	glm::vec4 fps_color = glm::vec4(0.4f, 0.9f, 0.4f, 1.0f);
+
+	if (g_game_metrics.fps < 30) fps_color = glm::vec4(0.9f, 0.3f, 0.3f, 1.0f);
+	else if (g_game_metrics.fps < 60) fps_color = glm::vec4(0.9f, 0.8f, 0.3f, 1.0f);
 
 	sprintf_s(debug_str, "FPS: %d", g_game_metrics.fps);
-	append_ui_text(&g_debug_font, debug_str, 0.5f, 100.0f);
+	append_ui_text(&g_debug_font, debug_str, 0.5f, 100.0f, fps_color);
 
 	float display_deltatime = g_frame_data.deltatime * 1000;
 	sprintf_s(debug_str, "Delta: %.2fms", display_deltatime);
-	append_ui_text(&g_debug_font, debug_str, 4.5f, 100.0f);
+	append_ui_text(&g_debug_font, debug_str, 4.5f, 100.0f, text_color);
 
 	sprintf_s(debug_str, "Frames: %lu", g_game_metrics.frames);
-	append_ui_text(&g_debug_font, debug_str, 10.5f, 100.0f);
+	append_ui_text(&g_debug_font, debug_str, 10.5f, 100.0f, text_color);
 
 	sprintf_s(debug_str, "Draw calls: %lld", ++g_frame_data.draw_calls);
-	append_ui_text(&g_debug_font, debug_str, 17.0f, 100.0f);
+	append_ui_text(&g_debug_font, debug_str, 17.0f, 100.0f, text_color);
+
+	sprintf_s(debug_str, "State changes: %lld", g_frame_data.state_changes);
+	append_ui_text(&g_debug_font, debug_str, 26.0f, 100.0f, text_color);
+
+	sprintf_s(debug_str, "Uploaded: %.2f KB", (float)g_frame_data.bytes_uploaded / 1024.0f);
+	append_ui_text(&g_debug_font, debug_str, 36.0f, 100.0f, text_color);
+
+	sprintf_s(debug_str, "Streamed: %.2f KB", (float)g_frame_data.bytes_streamed / 1024.0f);
+	append_ui_text(&g_debug_font, debug_str, 47.0f, 100.0f, text_color);
 
 	sprintf_s(debug_str, "Camera X=%.2f Y=%.2f Z=%.2f", g_scene_camera.position.x, g_scene_camera.position.y, g_scene_camera.position.z);
-	append_ui_text(&g_debug_font, debug_str, 0.5f, 99.0f);
+	append_ui_text(&g_debug_font, debug_str, 0.5f, 99.0f, text_color);
 
 	sprintf_s(debug_str, "Meshes %lld / %lld", g_scene.meshes.items_count, g_scene.meshes.max_items);
-	append_ui_text(&g_debug_font, debug_str, 0.5f, 98.0f);
+	append_ui_text(&g_debug_font, debug_str, 0.5f, 98.0f, text_color);
 
 	sprintf_s(debug_str, "Pointlights %lld / %lld", g_scene.pointlights.items_count, g_scene.pointlights.max_items);
-	append_ui_text(&g_debug_font, debug_str, 0.5f, 97.0f);
+	append_ui_text(&g_debug_font, debug_str, 0.5f, 97.0f, text_color);
 
 	sprintf_s(debug_str, "Spotlights %lld / %lld", g_scene.spotlights.items_count, g_scene.spotlights.max_items);
-	append_ui_text(&g_debug_font, debug_str, 0.5f, 96.0f);
+	append_ui_text(&g_debug_font, debug_str, 0.5f, 96.0f, text_color);
+
+	sprintf_s(debug_str, "Visible %lld, culled %lld (%.3fms)", g_frame_data.objects_visible, g_frame_data.objects_culled, g_frame_data.culling_ms);
+	append_ui_text(&g_debug_font, debug_str, 0.5f, 95.0f, text_color);
+
+	sprintf_s(debug_str, "Shadow maps cached %lld, redrawn %lld, casters %lld, atlas %lldpx", g_frame_data.shadow_cache_hits, g_frame_data.shadow_cache_misses, g_frame_data.shadow_casters_drawn, g_shadow_atlas.size_px);
+	append_ui_text(&g_debug_font, debug_str, 0.5f, 94.0f, text_color);
+
+	sprintf_s(debug_str, "Light cluster indices %lld / %lld", g_frame_data.light_cluster_indices, LIGHT_CLUSTER_INDICES_MAX_COUNT);
+	append_ui_text(&g_debug_font, debug_str, 0.5f, 93.0f, text_color);
+
+	sprintf_s(debug_str, "Glyphs cached %lld / %lld, rasterized %lld, evicted %lld", g_debug_font.glyphs_count, FONT_GLYPH_CACHE_MAX_COUNT, g_debug_font.glyphs_rasterized, g_debug_font.glyphs_evicted);
+	append_ui_text(&g_debug_font, debug_str, 0.5f, 92.0f, text_color);
+
+	sprintf_s(debug_str, "Text layouts cached %lld, laid out %lld", g_frame_data.text_layout_hits, g_frame_data.text_layout_misses);
+	append_ui_text(&g_debug_font, debug_str, 0.5f, 91.0f, text_color);
+
+	RenderTargetPool* pool = &g_render_target_pool;
+	f32 render_targets_mb = (f32)pool->bytes_allocated / (1024.0f * 1024.0f);
+	sprintf_s(debug_str, "Render targets %lld (%.2f MB), created %lld, deleted %lld, aliased %lld", pool->targets_count, render_targets_mb, pool->created_count, pool->destroyed_count, g_frame_data.render_targets_aliased);
+	append_ui_text(&g_debug_font, debug_str, 0.5f, 90.0f, text_color);
+
+	FrameGraph* graph = &g_frame_graph;
+	sprintf_s(debug_str, "Frame graph passes %lld, culled %lld, clears %lld", graph->passes_count - graph->culled_passes_count, graph->culled_passes_count, graph->clears_count);
+	append_ui_text(&g_debug_font, debug_str, 0.5f, 89.0f, text_color);
+
+	// One row per frame graph pass or zone run recently, GPU results lag GPU_PROFILER_FRAMES behind
+	s64 pass_rows_count = 0;
+
+	for (s64 i = 0; i < g_gpu_profiler.passes_count; i++)
+	{
+		ProfiledPass* pass = &g_gpu_profiler.passes[i];
+		if (!gpu_profiler_pass_is_active(&g_gpu_profiler, pass)) continue;
+
+		sprintf_s(debug_str, "%s GPU avg %.3fms max %.3fms, CPU avg %.3fms max %.3fms",
+			pass->name, pass->gpu.average_ms, pass->gpu.max_ms, pass->cpu.average_ms, pass->cpu.max_ms);
+		append_ui_text(&g_debug_font, debug_str, 0.5f, 88.0f - (f32)pass_rows_count, text_color);
+		pass_rows_count++;
+	}
+
+	FrameTimeSeries* cpu_times = &g_frame_times.cpu;
+	FrameTimeSeries* gpu_times = &g_frame_times.gpu;
+	sprintf_s(debug_str, "CPU frame p50 %.2fms p95 %.2fms p99 %.2fms max %.2fms, GPU p50 %.2fms p99 %.2fms, spikes %lld",
+		cpu_times->p50_ms, cpu_times->p95_ms, cpu_times->p99_ms, cpu_times->max_ms, gpu_times->p50_ms, gpu_times->p99_ms, g_profiler.spikes_count);
+	append_ui_text(&g_debug_font, debug_str, 0.5f, 88.0f - (f32)pass_rows_count, text_color);
+
+	// Calls made so far this frame, ImGui bypasses the cache and is not counted
+	sprintf_s(debug_str, "GL state calls issued %lld, skipped %lld", g_frame_data.gl_calls_issued, g_frame_data.gl_calls_skipped);
+	append_ui_text(&g_debug_font, debug_str, 0.5f, 87.0f - (f32)pass_rows_count, text_color);
 
 	char* t_mode = nullptr;
 	const char* tt = "Translate";
@@ -444,8 +482,8 @@ void print_debug_texts()
 	if (g_transform_mode.mode == TransformMode::Scale)		t_mode = const_cast<char*>(ts);
 
 	sprintf_s(debug_str, transform_mode_debug_str_format, t_mode);
-	append_ui_text(&g_debug_font, debug_str, 0.5f, 2.0f);
-	draw_ui_text(&g_debug_font, 0.9f, 0.9f, 0.9f);
+	append_ui_text(&g_debug_font, debug_str, 0.5f, 2.0f, text_color);
+	draw_ui_text(&g_debug_font);
 }
 
 void resize_windows_area_settings(s64 width_px, s64 height_px)
@@ -460,27 +498,6 @@ void resize_windows_area_settings(s64 width_px, s64 height_px)
 		(float)g_game_metrics.scene_width_px / (float)g_game_metrics.scene_height_px;
 }
 
-void init_framebuffer_resize(unsigned int* framebuffer_texture_id, unsigned int* renderbuffer_id)
-{
-	glDeleteTextures(1, framebuffer_texture_id);
-	glDeleteRenderbuffers(1, renderbuffer_id);
-
-	glGenTextures(1, framebuffer_texture_id);
-	glBindTexture(GL_TEXTURE_2D, *framebuffer_texture_id);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, g_game_metrics.scene_width_px, g_game_metrics.scene_height_px, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, *framebuffer_texture_id, 0);
-
-	glGenRenderbuffers(1, renderbuffer_id);
-	glBindRenderbuffer(GL_RENDERBUFFER, *renderbuffer_id);
-	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, g_game_metrics.scene_width_px, g_game_metrics.scene_height_px);
-	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, *renderbuffer_id);
-
-	ASSERT_TRUE(glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE, "Framebuffer successfull");
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
-}
-
 void allocate_temp_memory(s64 bytes)
 {
 	memory_buffer_mallocate(&TEMP_MEMORY, bytes, const_cast<char*>("Temp memory"));
@@ -502,12 +519,44 @@ void init_memory_buffers()
 
 	// Scene objects
 	{
-		memory_buffer_mallocate(&g_scene_planes_memory, sizeof(Mesh) * SCENE_MESHES_MAX_COUNT, const_cast<char*>("Scene plane meshes"));
+		memory_buffer_mallocate(&g_scene_planes_memory, sizeof(Mesh) * SCENE_PLANES_MAX_COUNT, const_cast<char*>("Scene plane meshes"));
 		g_scene.planes = j_array_init(SCENE_PLANES_MAX_COUNT, sizeof(Mesh), g_scene_planes_memory.memory);
 
 		memory_buffer_mallocate(&g_scene_meshes_memory, sizeof(Mesh) * SCENE_MESHES_MAX_COUNT, const_cast<char*>("Scene 3D meshes"));
 		g_scene.meshes = j_array_init(SCENE_MESHES_MAX_COUNT, sizeof(Mesh), g_scene_meshes_memory.memory);
 
+		s64 sizeof_instances = sizeof(MeshInstance) * MESH_INSTANCES_MAX_COUNT;
+		s64 sizeof_batches = sizeof(MeshBatch) * MESH_BATCHES_MAX_COUNT;
+		s64 sizeof_slots = sizeof(s32) * MESH_INSTANCES_MAX_COUNT;
+		memory_buffer_mallocate(&g_mesh_instances_memory, 2 * (sizeof_instances + sizeof_slots) + sizeof_batches, const_cast<char*>("Mesh instances"));
+		MemoryBuffer instances_memory = memory_buffer_suballocate(&g_mesh_instances_memory, sizeof_instances);
+		MemoryBuffer batches_memory = memory_buffer_suballocate(&g_mesh_instances_memory, sizeof_batches);
+		MemoryBuffer slots_memory = memory_buffer_suballocate(&g_mesh_instances_memory, sizeof_slots);
+		g_mesh_instances.instances = j_array_init(MESH_INSTANCES_MAX_COUNT, sizeof(MeshInstance), instances_memory.memory);
+		g_mesh_instances.batches = j_array_init(MESH_BATCHES_MAX_COUNT, sizeof(MeshBatch), batches_memory.memory);
+		g_mesh_instances.scene_instance_slots = (s32*)slots_memory.memory;
+
+		MemoryBuffer casters_memory = memory_buffer_suballocate(&g_mesh_instances_memory, sizeof_instances);
+		MemoryBuffer caster_indices_memory = memory_buffer_suballocate(&g_mesh_instances_memory, sizeof_slots);
+		g_shadow_casters.instances = j_array_init(MESH_INSTANCES_MAX_COUNT, sizeof(MeshInstance), casters_memory.memory);
+		g_shadow_casters.caster_indices = (s32*)caster_indices_memory.memory;
+
+		s64 sizeof_render_queue = (sizeof(DrawPacket) + 2 * sizeof(RenderQueueEntry)) * RENDER_QUEUE_MAX_PACKETS;
+		memory_buffer_mallocate(&g_render_queue_memory, sizeof_render_queue, const_cast<char*>("Scene render queue"));
+		g_scene_render_queue = render_queue_init(&g_render_queue_memory, RENDER_QUEUE_MAX_PACKETS);
+
+		memory_buffer_mallocate(&g_billboards_memory, sizeof(BillboardInstance) * BILLBOARDS_MAX_COUNT, const_cast<char*>("Billboard instances"));
+		g_billboard_batch.instances = j_array_init(BILLBOARDS_MAX_COUNT, sizeof(BillboardInstance), g_billboards_memory.memory);
+
+		s64 sizeof_scene_visibility = (6 * sizeof(f32) + sizeof(s32) + sizeof(bool)) * CULLING_BOUNDS_MAX_COUNT;
+		memory_buffer_mallocate(&g_culling_memory, sizeof_scene_visibility, const_cast<char*>("Scene visibility"));
+		g_scene_visibility = scene_visibility_init(&g_culling_memory, CULLING_BOUNDS_MAX_COUNT);
+
+		s64 clustered_lights_max_count = LIGHTS_UBO_POINTLIGHTS_MAX_COUNT + LIGHTS_UBO_SPOTLIGHTS_MAX_COUNT;
+		s64 sizeof_light_clusters = light_clusters_memory_size(clustered_lights_max_count, LIGHT_CLUSTER_INDICES_MAX_COUNT);
+		memory_buffer_mallocate(&g_light_clusters_memory, sizeof_light_clusters, const_cast<char*>("Light clusters"));
+		g_light_clusters = light_clusters_init(&g_light_clusters_memory, clustered_lights_max_count, LIGHT_CLUSTER_INDICES_MAX_COUNT);
+
 		memory_buffer_mallocate(&g_scene_pointlights_memory, sizeof(Pointlight) * SCENE_POINTLIGHTS_MAX_COUNT, const_cast<char*>("Scene pointlights"));
 		g_scene.pointlights = j_array_init(SCENE_POINTLIGHTS_MAX_COUNT, sizeof(Pointlight), g_scene_pointlights_memory.memory);
 
@@ -521,6 +570,14 @@ void init_memory_buffers()
 		g_materials = j_array_init(SCENE_TEXTURES_MAX_COUNT, sizeof(Material), g_materials_memory.memory);
 	}
 
+	// Debug lines and UI text vertices, grow when a frame needs more
+	transient_vertices_init(&g_line_vertices, LINE_VERICIES / 2 * sizeof(float), LINES_INITIAL_COUNT * 2, const_cast<char*>("Line vertices"));
+	transient_vertices_init(&g_ui_text_vertices, sizeof(UiTextVertex), UI_CHARS_INITIAL_COUNT * UI_CHAR_VERTICIES, const_cast<char*>("UI text vertices"));
+
+	s64 sizeof_text_layout_cache = text_layout_cache_memory_size(TEXT_LAYOUT_CACHE_RUNS_COUNT, TEXT_LAYOUT_CACHE_VERTICES_COUNT);
+	memory_buffer_mallocate(&g_text_layout_cache_memory, sizeof_text_layout_cache, const_cast<char*>("Text layout cache"));
+	g_text_layout_cache = text_layout_cache_init(&g_text_layout_cache_memory, TEXT_LAYOUT_CACHE_RUNS_COUNT, TEXT_LAYOUT_CACHE_VERTICES_COUNT);
+
 	// Material names string list
 	constexpr const s64 material_names_arr_size = FILENAME_LEN * SCENE_TEXTURES_MAX_COUNT;
 	memory_buffer_mallocate(&g_material_names_memory, material_names_arr_size, const_cast<char*>("Material strings"));
@@ -577,6 +634,23 @@ glm::mat4 get_model_matrix(Mesh* mesh)
 	return model;
 }
 
+bool transforms_equal(Transforms* a, Transforms* b)
+{
+	return a->translation == b->translation && a->rotation == b->rotation && a->scale == b->scale;
+}
+
+MeshInstance mesh_instance_init(Mesh* mesh)
+{
+	glm::mat4 model = get_model_matrix(mesh);
+
+	MeshInstance instance = {
+		.model = model,
+		.normal_matrix = glm::mat3(glm::transpose(glm::inverse(model))),
+		.uv_multiplier = mesh->uv_multiplier,
+	};
+	return instance;
+}
+
 glm::mat4 get_rotation_matrix(glm::vec3 rotation)
 {
 	glm::quat quaternionX = glm::angleAxis(glm::radians(rotation.x), glm::vec3(1.0f, 0.0f, 0.0f));
@@ -639,7 +713,7 @@ Mesh mesh_deserialize(MeshData data)
 Spotlight spotlight_deserialize(SpotlightSerialized serialized)
 {
 	Spotlight spotlight = {
-		.shadow_map = init_spotlight_shadow_map(),
+		.shadow_tile = {},
 		.transforms = serialized.transforms,
 		.diffuse = serialized.diffuse,
 		.specular = serialized.specular,
@@ -647,6 +721,7 @@ Spotlight spotlight_deserialize(SpotlightSerialized serialized)
 		.fov = serialized.fov,
 		.outer_cutoff_fov = serialized.outer_cutoff_fov,
 		.is_on = serialized.is_on,
+		.shadow_dirty = true,
 	};
 	return spotlight;
 }
@@ -761,6 +836,7 @@ s64 get_materials_from_manifest(Material materials[], s64 max_items)
 
 void load_material_textures(Material materials[], s64 materials_count)
 {
+	PROFILE_ZONE("Load material textures");
 	for (int i = 0; i < materials_count; i++)
 	{
 		char filepath[FILE_PATH_LEN] = {};
@@ -806,29 +882,22 @@ void load_materials_into_memory(Material materials[], s64 materials_count)
 
 void load_core_textures()
 {
+	PROFILE_ZONE("Load core textures");
 	g_use_linear_texture_filtering = true;
 	g_generate_texture_mipmaps = true;
 	g_load_texture_sRGB = false;
 
-	char path_str[FILE_PATH_LEN] = { 0 };
-	strcpy_s(path_str, pointlight_image_path);
-	pointlight_texture = texture_load_from_filepath(path_str);
-
-	strcpy_s(path_str, spotlight_image_path);
-	spotlight_texture = texture_load_from_filepath(path_str);
+	// Layer order follows BillboardLayer
+	const char* billboard_image_paths[] = { pointlight_image_path, spotlight_image_path };
+	g_billboard_batch.texture_array_id = load_images_into_texture_array(billboard_image_paths, 2);
 
 	g_skybox_cubemap = load_cubemap();
 }
 
 void init_framebuffers()
 {
-	glGenFramebuffers(1, &g_scene_framebuffer.id);
-	glBindFramebuffer(GL_FRAMEBUFFER, g_scene_framebuffer.id);
-	init_framebuffer_resize(&g_scene_framebuffer.texture_gpu_id, &g_scene_framebuffer.renderbuffer);
-
-	glGenFramebuffers(1, &editor_framebuffer.id);
-	glBindFramebuffer(GL_FRAMEBUFFER, editor_framebuffer.id);
-	init_framebuffer_resize(&editor_framebuffer.texture_gpu_id, &editor_framebuffer.renderbuffer);
+	// Scene sized targets come from g_render_target_pool each frame
+	init_shadow_atlas(&g_shadow_atlas);
 }
 
 void update_frame_data()
@@ -849,6 +918,7 @@ void update_frame_data()
 
 void register_frame_inputs()
 {
+	PROFILE_ZONE("Inputs");
 	int key_state;
 	int buttons_count = sizeof(g_inputs) / sizeof(ButtonState);
 	g_frame_data.mouse_clicked = false;
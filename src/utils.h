@@ -12,8 +12,6 @@ glm::mat4 get_projection_matrix();
 
 glm::mat4 get_view_matrix();
 
-Framebuffer init_spotlight_shadow_map();
-
 glm::mat4 get_spotlight_light_space_matrix(Spotlight spotlight);
 
 inline float vw_into_screen_px(float value, float screen_width_px)
@@ -53,6 +51,10 @@ inline glm::vec3 clip_vec3(glm::vec3 vec3, float clip_amount)
 
 glm::mat4 get_model_matrix(Mesh* mesh);
 
+bool transforms_equal(Transforms* a, Transforms* b);
+
+MeshInstance mesh_instance_init(Mesh* mesh);
+
 glm::mat4 get_rotation_matrix(glm::vec3 rotation);
 
 inline float get_vec3_val_by_axis(glm::vec3 vec, Axis axis)
@@ -116,8 +118,6 @@ void print_debug_texts();
 
 void resize_windows_area_settings(s64 width_px, s64 height_px);
 
-void init_framebuffer_resize(unsigned int* framebuffer_texture_id, unsigned int* renderbuffer_id);
-
 void init_memory_buffers();
 
 glm::vec3 get_camera_ray_from_scene_px(int x, int y);